@@ -0,0 +1,109 @@
+#ifndef BLUE_NOISE_H
+#define BLUE_NOISE_H
+
+#include<cmath>
+#include<random>
+#include<vector>
+#include<algorithm>
+
+/*
+Tileable blue noise by void-and-cluster (Ulichney 1993): a binary pattern is relaxed
+by moving its tightest cluster into its largest void, then every pixel is ranked by
+removing clusters and filling voids. The ranks, scaled to [0, 1), have no low
+frequencies, so per-pixel values derived from them leave only fine grain behind.
+Energies use a Gaussian on the torus so the tile wraps seamlessly.
+*/
+class BlueNoise {
+public:
+	//size * size values in [0, 1), rows bottom to top like a GL texture
+	static std::vector<float> generate(int size, unsigned int seed) {
+		BlueNoise noise(size);
+		int count = size * size;
+		std::vector<bool> pattern(count, false);
+		std::vector<int> rank(count, 0);
+
+		//initial binary pattern, a tenth of the pixels
+		std::mt19937 eng(seed);
+		std::uniform_int_distribution<int> dist(0, count - 1);
+		int ones = 0;
+		while (ones < count / 10) {
+			int i = dist(eng);
+			if (!pattern[i]) {
+				pattern[i] = true;
+				noise.splat(i, 1.0f);
+				++ones;
+			}
+		}
+		//relax until the tightest cluster is also the largest void
+		for (int step = 0; step < count; ++step) {
+			int cluster = noise.extreme(pattern, true);
+			pattern[cluster] = false;
+			noise.splat(cluster, -1.0f);
+			int hole = noise.extreme(pattern, false);
+			pattern[hole] = true;
+			noise.splat(hole, 1.0f);
+			if (hole == cluster)
+				break;
+		}
+
+		//rank the initial points by removing clusters
+		std::vector<bool> prototype(pattern);
+		BlueNoise energy(noise);
+		for (int r = ones - 1; r >= 0; --r) {
+			int cluster = noise.extreme(pattern, true);
+			pattern[cluster] = false;
+			noise.splat(cluster, -1.0f);
+			rank[cluster] = r;
+		}
+		//rank the rest by filling voids
+		pattern.swap(prototype);
+		noise = energy;
+		for (int r = ones; r < count; ++r) {
+			int hole = noise.extreme(pattern, false);
+			pattern[hole] = true;
+			noise.splat(hole, 1.0f);
+			rank[hole] = r;
+		}
+
+		std::vector<float> values(count);
+		for (int i = 0; i < count; ++i)
+			values[i] = (rank[i] + 0.5f) / count;
+		return values;
+	}
+
+private:
+	int size;
+	std::vector<float> kernel;	//Gaussian of the wrapped offset
+	std::vector<float> energy;
+
+	BlueNoise(int size) : size(size), kernel((size_t)size * size), energy((size_t)size * size, 0.0f) {
+		const float SIGMA = 1.5f;
+		for (int y = 0; y < size; ++y)
+			for (int x = 0; x < size; ++x) {
+				int dx = std::min(x, size - x), dy = std::min(y, size - y);
+				kernel[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * SIGMA * SIGMA));
+			}
+	}
+
+	void splat(int pixel, float sign) {
+		int px = pixel % size, py = pixel / size;
+		for (int y = 0; y < size; ++y) {
+			int ky = (y - py + size) % size;
+			for (int x = 0; x < size; ++x)
+				energy[y * size + x] += sign * kernel[ky * size + (x - px + size) % size];
+		}
+	}
+
+	//highest energy among the set pixels, or lowest among the empty ones
+	int extreme(const std::vector<bool>& pattern, bool cluster) const {
+		int best = -1;
+		for (int i = 0; i < (int)energy.size(); ++i) {
+			if (pattern[i] != cluster)
+				continue;
+			if (best < 0 || (cluster ? energy[i] > energy[best] : energy[i] < energy[best]))
+				best = i;
+		}
+		return best;
+	}
+};
+#endif
@@ -0,0 +1,407 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include<glm/glm.hpp>
+
+#include<vector>
+#include<algorithm>
+#include<cfloat>
+#include<cstdlib>
+#include<cstdint>
+#include<new>
+
+//Axis aligned bounding box
+struct AABB {
+	glm::vec3 min;
+	glm::vec3 max;
+
+	AABB() : min(FLT_MAX), max(-FLT_MAX) {}
+	AABB(const glm::vec3& mn, const glm::vec3& mx) : min(mn), max(mx) {}
+
+	void grow(const glm::vec3& p) {
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+	void grow(const AABB& b) {
+		min = glm::min(min, b.min);
+		max = glm::max(max, b.max);
+	}
+	bool valid() const {
+		return min.x <= max.x && min.y <= max.y && min.z <= max.z;
+	}
+	glm::vec3 center() const {
+		return (min + max) * 0.5f;
+	}
+	float area() const {
+		glm::vec3 e = max - min;
+		return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+	}
+	//bounds of the eight transformed corners
+	AABB transform(const glm::mat4& m) const {
+		AABB result;
+		for (int i = 0; i < 8; ++i) {
+			glm::vec3 corner((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z);
+			result.grow(glm::vec3(m * glm::vec4(corner, 1.0f)));
+		}
+		return result;
+	}
+	bool intersectsSphere(const glm::vec3& c, float radius) const {
+		glm::vec3 d = glm::clamp(c, min, max) - c;
+		return glm::dot(d, d) <= radius * radius;
+	}
+	bool operator==(const AABB& b) const {
+		return min == b.min && max == b.max;
+	}
+};
+
+//Six planes extracted from a view-projection matrix, normals pointing inwards
+struct Frustum {
+	glm::vec4 planes[6];
+
+	Frustum() {}
+	explicit Frustum(const glm::mat4& viewProj) {
+		glm::mat4 m = glm::transpose(viewProj);
+		planes[0] = m[3] + m[0];	//left
+		planes[1] = m[3] - m[0];	//right
+		planes[2] = m[3] + m[1];	//bottom
+		planes[3] = m[3] - m[1];	//top
+		planes[4] = m[3] + m[2];	//near
+		planes[5] = m[3] - m[2];	//far
+		for (int i = 0; i < 6; ++i)
+			planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+	bool intersects(const AABB& b) const {
+		for (int i = 0; i < 6; ++i) {
+			//the corner furthest along the plane normal
+			glm::vec3 p(planes[i].x > 0.0f ? b.max.x : b.min.x,
+				planes[i].y > 0.0f ? b.max.y : b.min.y,
+				planes[i].z > 0.0f ? b.max.z : b.min.z);
+			if (glm::dot(glm::vec3(planes[i]), p) + planes[i].w < 0.0f)
+				return false;
+		}
+		return true;
+	}
+};
+
+struct Ray {
+	glm::vec3 origin;
+	glm::vec3 direction;
+
+	Ray(const glm::vec3& o, const glm::vec3& d) : origin(o), direction(d) {}
+};
+
+//slab test, returns the entry distance in tNear
+inline bool intersectRayAABB(const glm::vec3& origin, const glm::vec3& invDir, const AABB& b, float tMax, float& tNear) {
+	glm::vec3 t0 = (b.min - origin) * invDir;
+	glm::vec3 t1 = (b.max - origin) * invDir;
+	glm::vec3 tSmall = glm::min(t0, t1);
+	glm::vec3 tBig = glm::max(t0, t1);
+	float tmin = std::max(std::max(tSmall.x, tSmall.y), std::max(tSmall.z, 0.0f));
+	float tmax = std::min(std::min(tBig.x, tBig.y), std::min(tBig.z, tMax));
+	tNear = tmin;
+	return tmin <= tmax;
+}
+
+//Allocator returning memory aligned to Alignment bytes, used to keep sibling nodes on one cache line
+template <typename T, std::size_t Alignment>
+struct AlignedAllocator {
+	typedef T value_type;
+	template <typename U> struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+	AlignedAllocator() {}
+	template <typename U> AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+	T* allocate(std::size_t n) {
+		void* raw = std::malloc(n * sizeof(T) + Alignment + sizeof(void*));
+		if (raw == NULL)
+			throw std::bad_alloc();
+		std::uintptr_t aligned = (reinterpret_cast<std::uintptr_t>(raw) + sizeof(void*) + Alignment - 1) & ~(std::uintptr_t)(Alignment - 1);
+		reinterpret_cast<void**>(aligned)[-1] = raw;
+		return reinterpret_cast<T*>(aligned);
+	}
+	void deallocate(T* p, std::size_t) {
+		if (p != NULL)
+			std::free(reinterpret_cast<void**>(p)[-1]);
+	}
+	template <typename U> bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+	template <typename U> bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+//32 byte node: two siblings share one 64 byte cache line
+struct BVHNode {
+	glm::vec3 min;
+	int32_t leftFirst;	//first child for inner nodes, first object for leaves
+	glm::vec3 max;
+	int32_t count;		//0 for inner nodes
+
+	bool isLeaf() const { return count > 0; }
+	AABB bounds() const { return AABB(min, max); }
+};
+
+/*
+Bounding volume hierarchy over scene object bounds.
+Built top-down with binned SAH and stored flattened: the root sits at index 0 and
+every sibling pair starts at an even index, so a traversal step touches one cache line.
+Children always have larger indices than their parent, which lets refit run bottom-up.
+*/
+class BVH {
+public:
+	static const int BIN_COUNT = 16;
+	static const int MAX_LEAF_SIZE = 4;
+	static const int MAX_DEPTH = 48;
+
+	void build(const std::vector<AABB>& bounds) {
+		objectBounds = bounds;
+		int n = (int)bounds.size();
+		objectIndices.resize(n);
+		for (int i = 0; i < n; ++i)
+			objectIndices[i] = i;
+		centroids.resize(n);
+		for (int i = 0; i < n; ++i)
+			centroids[i] = bounds[i].center();
+
+		nodes.clear();
+		nodes.reserve(n > 0 ? 2 * n + 1 : 2);
+		//index 1 is padding so sibling pairs stay line aligned
+		nodes.resize(2);
+		nodes[0].leftFirst = 0;
+		nodes[0].count = n;
+		parents.assign(2, -1);
+		if (n == 0) {
+			nodes[0].min = nodes[0].max = glm::vec3(0.0f);
+			return;
+		}
+		updateBounds(0);
+		subdivide(0, 0);
+
+		objectLeaf.resize(n);
+		for (int i = 0; i < (int)nodes.size(); ++i) {
+			if (!nodes[i].isLeaf())
+				continue;
+			for (int j = 0; j < nodes[i].count; ++j)
+				objectLeaf[objectIndices[nodes[i].leftFirst + j]] = i;
+		}
+	}
+
+	bool empty() const {
+		return objectIndices.empty();
+	}
+
+	//move one object and walk up to the root, stopping once bounds no longer change
+	void refit(int object, const AABB& bounds) {
+		objectBounds[object] = bounds;
+		int node = objectLeaf[object];
+		while (node >= 0) {
+			AABB old = nodes[node].bounds();
+			updateBounds(node);
+			if (old == nodes[node].bounds())
+				break;
+			node = parents[node];
+		}
+	}
+
+	//refit every node after many objects moved
+	void refit(const std::vector<AABB>& bounds) {
+		objectBounds = bounds;
+		if (empty())
+			return;
+		for (int i = (int)nodes.size() - 1; i >= 0; --i) {
+			if (i == 1)
+				continue;
+			updateBounds(i);
+		}
+	}
+
+	//collect objects whose bounds pass test, test is also applied to the nodes
+	template <typename Test>
+	void query(const Test& test, std::vector<int>& out) const {
+		out.clear();
+		if (empty())
+			return;
+		int stack[MAX_DEPTH + 2];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0) {
+			const BVHNode& node = nodes[stack[--top]];
+			if (!test(node.bounds()))
+				continue;
+			if (node.isLeaf()) {
+				for (int i = 0; i < node.count; ++i) {
+					int object = objectIndices[node.leftFirst + i];
+					if (node.count == 1 || test(objectBounds[object]))
+						out.push_back(object);
+				}
+			}
+			else {
+				stack[top++] = node.leftFirst + 1;
+				stack[top++] = node.leftFirst;
+			}
+		}
+	}
+
+	void queryFrustum(const Frustum& frustum, std::vector<int>& out) const {
+		query([&frustum](const AABB& b) { return frustum.intersects(b); }, out);
+	}
+
+	//objects touching a point light's sphere of influence
+	void querySphere(const glm::vec3& center, float radius, std::vector<int>& out) const {
+		query([&center, radius](const AABB& b) { return b.intersectsSphere(center, radius); }, out);
+	}
+
+	//nearest object whose bounds the ray hits, -1 if none
+	int raycast(const Ray& ray, float& tHit, float tMax = FLT_MAX) const {
+		int hit = -1;
+		tHit = tMax;
+		if (empty())
+			return hit;
+		glm::vec3 invDir = 1.0f / ray.direction;
+		float t;
+		if (!intersectRayAABB(ray.origin, invDir, nodes[0].bounds(), tHit, t))
+			return hit;
+		int stack[MAX_DEPTH + 2];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0) {
+			const BVHNode& node = nodes[stack[--top]];
+			if (node.isLeaf()) {
+				for (int i = 0; i < node.count; ++i) {
+					int object = objectIndices[node.leftFirst + i];
+					if (intersectRayAABB(ray.origin, invDir, objectBounds[object], tHit, t)) {
+						tHit = t;
+						hit = object;
+					}
+				}
+				continue;
+			}
+			int a = node.leftFirst, b = node.leftFirst + 1;
+			float ta, tb;
+			bool hitA = intersectRayAABB(ray.origin, invDir, nodes[a].bounds(), tHit, ta);
+			bool hitB = intersectRayAABB(ray.origin, invDir, nodes[b].bounds(), tHit, tb);
+			//push the far child first so the near one is visited first
+			if (hitA && hitB) {
+				if (ta > tb) {
+					std::swap(a, b);
+				}
+				stack[top++] = b;
+				stack[top++] = a;
+			}
+			else if (hitA)
+				stack[top++] = a;
+			else if (hitB)
+				stack[top++] = b;
+		}
+		return hit;
+	}
+
+	AABB bounds() const {
+		return empty() ? AABB() : nodes[0].bounds();
+	}
+
+private:
+	std::vector<BVHNode, AlignedAllocator<BVHNode, 64> > nodes;
+	std::vector<int> parents;
+	std::vector<int> objectIndices;
+	std::vector<int> objectLeaf;
+	std::vector<AABB> objectBounds;
+	std::vector<glm::vec3> centroids;
+
+	void updateBounds(int index) {
+		BVHNode& node = nodes[index];
+		AABB b;
+		if (node.isLeaf()) {
+			for (int i = 0; i < node.count; ++i)
+				b.grow(objectBounds[objectIndices[node.leftFirst + i]]);
+		}
+		else {
+			b.grow(nodes[node.leftFirst].bounds());
+			b.grow(nodes[node.leftFirst + 1].bounds());
+		}
+		node.min = b.min;
+		node.max = b.max;
+	}
+
+	void subdivide(int index, int depth) {
+		int first = nodes[index].leftFirst;
+		int count = nodes[index].count;
+		//the traversal stacks are sized for MAX_DEPTH
+		if (count <= 1 || depth >= MAX_DEPTH)
+			return;
+
+		AABB centroidBounds;
+		for (int i = 0; i < count; ++i)
+			centroidBounds.grow(centroids[objectIndices[first + i]]);
+
+		//binned SAH over the centroid extent
+		int bestAxis = -1;
+		int bestSplit = 0;
+		float bestCost = FLT_MAX;
+		for (int axis = 0; axis < 3; ++axis) {
+			float lo = centroidBounds.min[axis], hi = centroidBounds.max[axis];
+			if (hi <= lo)
+				continue;
+			AABB binBounds[BIN_COUNT];
+			int binCount[BIN_COUNT] = { 0 };
+			float scale = BIN_COUNT / (hi - lo);
+			for (int i = 0; i < count; ++i) {
+				int object = objectIndices[first + i];
+				int bin = std::min(BIN_COUNT - 1, (int)((centroids[object][axis] - lo) * scale));
+				binCount[bin]++;
+				binBounds[bin].grow(objectBounds[object]);
+			}
+			float leftArea[BIN_COUNT - 1];
+			int leftCount[BIN_COUNT - 1];
+			AABB acc;
+			int sum = 0;
+			for (int i = 0; i < BIN_COUNT - 1; ++i) {
+				acc.grow(binBounds[i]);
+				sum += binCount[i];
+				leftCount[i] = sum;
+				leftArea[i] = acc.valid() ? acc.area() : 0.0f;
+			}
+			acc = AABB();
+			sum = 0;
+			for (int i = BIN_COUNT - 1; i > 0; --i) {
+				acc.grow(binBounds[i]);
+				sum += binCount[i];
+				if (leftCount[i - 1] == 0 || sum == 0)
+					continue;
+				float cost = leftCount[i - 1] * leftArea[i - 1] + sum * acc.area();
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = i;
+				}
+			}
+		}
+
+		float leafCost = count * nodes[index].bounds().area();
+		if (bestAxis < 0 || (count <= MAX_LEAF_SIZE && bestCost >= leafCost))
+			return;
+
+		float lo = centroidBounds.min[bestAxis];
+		float scale = BIN_COUNT / (centroidBounds.max[bestAxis] - lo);
+		int* begin = &objectIndices[first];
+		int* mid = std::partition(begin, begin + count, [&](int object) {
+			return std::min(BIN_COUNT - 1, (int)((centroids[object][bestAxis] - lo) * scale)) < bestSplit;
+		});
+		int leftCount = (int)(mid - begin);
+		if (leftCount == 0 || leftCount == count)
+			return;
+
+		int left = (int)nodes.size();
+		nodes.resize(left + 2);
+		parents.resize(left + 2, index);
+		nodes[left].leftFirst = first;
+		nodes[left].count = leftCount;
+		nodes[left + 1].leftFirst = first + leftCount;
+		nodes[left + 1].count = count - leftCount;
+		nodes[index].leftFirst = left;
+		nodes[index].count = 0;
+
+		updateBounds(left);
+		updateBounds(left + 1);
+		subdivide(left, depth + 1);
+		subdivide(left + 1, depth + 1);
+	}
+};
+#endif
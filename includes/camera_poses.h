@@ -0,0 +1,48 @@
+#ifndef CAMERA_POSES_H
+#define CAMERA_POSES_H
+
+#include<glm/glm.hpp>
+
+#include<cstdio>
+#include<string>
+#include<vector>
+#include<iostream>
+
+//a camera of the batch renderer, angles in degrees like Camera's
+struct CameraPose {
+	glm::vec3 position;
+	float yaw, pitch;
+};
+
+//one pose per line: x y z yaw pitch; blank lines and lines starting with # are skipped
+inline bool readCameraPoses(const std::string& path, std::vector<CameraPose>& poses) {
+	FILE* file = std::fopen(path.c_str(), "r");
+	if (!file) {
+		std::cout << "ERROR::CAMERA_POSES::READ_FAILED " << path << "\n";
+		return false;
+	}
+	poses.clear();
+	char line[256];
+	int number = 0;
+	bool ok = true;
+	while (ok && std::fgets(line, sizeof(line), file)) {
+		++number;
+		char first = ' ';
+		if (std::sscanf(line, " %c", &first) != 1 || first == '#')
+			continue;
+		CameraPose pose;
+		if (std::sscanf(line, "%f %f %f %f %f", &pose.position.x, &pose.position.y, &pose.position.z, &pose.yaw, &pose.pitch) != 5) {
+			std::cout << "ERROR::CAMERA_POSES::BAD_LINE " << path << ":" << number << "\n";
+			ok = false;
+		}
+		else
+			poses.push_back(pose);
+	}
+	std::fclose(file);
+	if (ok && poses.empty()) {
+		std::cout << "ERROR::CAMERA_POSES::EMPTY " << path << "\n";
+		ok = false;
+	}
+	return ok;
+}
+#endif
@@ -0,0 +1,707 @@
+#ifndef CPU_RENDERER_H
+#define CPU_RENDERER_H
+
+#include<glm/glm.hpp>
+
+#include<cmath>
+#include<vector>
+#include<algorithm>
+
+#include "scene.h"
+#include "simd.h"
+#include "thread_pool.h"
+#include "lpv.h"
+#include "probe_grid.h"
+#include "lightmap.h"
+#include "ism.h"
+
+//Everything the RSM shaders read from uniforms, shared by the GL and the CPU path
+struct RenderParams {
+	int width, height;
+	int rsmWidth, rsmHeight;
+	glm::mat4 projection, view, lightSpaceMatrix;
+	glm::vec3 viewPos;
+	glm::vec3 lightPos;
+	glm::vec3 lightAmbient, lightDiffuse, lightSpecular;
+	glm::vec3 materialAmbient, materialSpecular;
+	float shininess;
+	float nearPlane, farPlane;	//light projection
+	float shadowBias;
+	int sampleNum;
+	float sampleRadius;
+	bool halfRSM;				//16-bit float normal/position and 16-bit depth targets
+	bool blueNoise;				//rotate the samples per pixel by the blue noise
+	float noiseOffset;			//added to the blue noise, animates it over frames
+	bool adaptiveSampling;		//stop gathering once the error estimate is small
+	int adaptiveBatch;			//samples between two error checks
+	float adaptiveThreshold;	//standard error of the scaled indirect light
+	bool lpv;					//indirect light from a light propagation volume instead of the gather
+	int lpvIterations;
+	float lpvIntensity;			//scale of the volume's irradiance to the gather's indirect term
+	bool probes;				//indirect light from the baked irradiance probes
+	int probeGrid;				//probes per axis
+	float probeIntensity;
+	bool lightmap;				//indirect light from the baked lightmap, see setLightmap
+	bool ism;					//gather samples tested against imperfect shadow maps
+	float ismBias;				//fraction of its distance a receiver may lie behind a map
+	glm::vec3 clearColor;
+
+	RenderParams() : width(0), height(0), rsmWidth(0), rsmHeight(0),
+		projection(1.0f), view(1.0f), lightSpaceMatrix(1.0f), viewPos(0.0f), lightPos(0.0f),
+		lightAmbient(0.2f), lightDiffuse(0.6f), lightSpecular(1.0f),
+		materialAmbient(0.1f), materialSpecular(0.1f), shininess(8.0f),
+		nearPlane(0.5f), farPlane(20.0f), shadowBias(0.05f), sampleNum(0), sampleRadius(0.3f),
+		halfRSM(false), blueNoise(false), noiseOffset(0.0f),
+		adaptiveSampling(false), adaptiveBatch(32), adaptiveThreshold(0.005f),
+		lpv(false), lpvIterations(8), lpvIntensity(0.02f), probes(false), probeGrid(8), probeIntensity(1e-4f), lightmap(false),
+		ism(false), ismBias(0.2f), clearColor(0.1f) {}
+};
+
+/*
+Software implementation of the RSM pipeline: lightSpaceShader into depth, normal,
+world position and flux buffers, then result_shader per camera pixel. Both passes are
+split into TILE_SIZE tiles run on a work-stealing pool; every tile rasterizes the
+triangles overlapping it and then shades its pixels in batches of eight, one SIMD lane
+per pixel. Rasterization follows GL conventions (pixel centers, perspective-correct
+attributes, near plane clipping, depth test LESS) and textures are sampled like the GL
+ones: nearest filtering, border color 1, flux quantized to 8 bits.
+*/
+class CpuRenderer {
+public:
+	static const int TILE_SIZE = 32;
+	static const int SUBPIXEL_BITS = 8;
+
+	//RGBA8, rows top to bottom
+	std::vector<unsigned char> color;
+
+	explicit CpuRenderer(ThreadPool& pool) : pool(pool), noiseSize(0), lightmap(NULL) {}
+
+	//tile used for the per-pixel sample rotation, size * size values in [0, 1)
+	void setBlueNoise(const std::vector<float>& noise, int size) {
+		blueNoise = noise;
+		noiseSize = size;
+	}
+	//baked indirect light read when params.lightmap is set, must outlive the renderer
+	void setLightmap(const Lightmap* map) {
+		lightmap = map;
+	}
+
+	void render(const Scene& scene, const RenderParams& params, const std::vector<glm::vec3>& samples) {
+		renderLight(scene, params);
+		renderCamera(scene, params, samples);
+	}
+
+	//the passes that only depend on the light: RSM, shadow maps, volume and probes;
+	//renderCamera() reuses them for any number of views of the same light
+	void renderLight(const Scene& scene, const RenderParams& params) {
+		renderRSM(scene, params);
+		if (params.ism)
+			splatShadowMaps(scene, params);
+		if (params.lpv)
+			volume.build(pool, LpvLayout::fit(scene), params.lpvIterations, rsmNormal, rsmWorldPos, rsmFlux,
+				params.rsmWidth, params.rsmHeight);
+		//baked once per light, like the GL path
+		if (params.probes && (irradianceProbes.size != params.probeGrid || !irradianceProbes.bakedFor(params.lightSpaceMatrix, params.lightDiffuse))) {
+			irradianceProbes.init(scene, params.probeGrid);
+			irradianceProbes.bake(pool, rsmNormal, rsmWorldPos, rsmFlux, params.rsmWidth, params.rsmHeight, params.lightSpaceMatrix, params.lightDiffuse);
+		}
+	}
+
+	//result_shader for every pixel of params.width x params.height into color
+	void renderCamera(const Scene& scene, const RenderParams& params, const std::vector<glm::vec3>& samples) {
+		int w = params.width, h = params.height;
+		depth.assign((size_t)w * h, 1.0f);
+		objectIds.assign((size_t)w * h, -1);
+		positions.resize((size_t)w * h);
+		normals.resize((size_t)w * h);
+		lightmapUVs.resize((size_t)w * h);
+		color.resize((size_t)w * h * 4);
+
+		glm::mat4 viewProj = params.projection * params.view;
+		std::vector<int> visible;
+		scene.cull(Frustum(viewProj), visible);
+		setupTriangles(scene, visible, viewProj, w, h);
+
+		int tilesX = (w + TILE_SIZE - 1) / TILE_SIZE;
+		int tilesY = (h + TILE_SIZE - 1) / TILE_SIZE;
+		pool.parallelFor(tilesX * tilesY, [&](int tile) {
+			int x0 = tile % tilesX * TILE_SIZE, y0 = tile / tilesX * TILE_SIZE;
+			int x1 = std::min(x0 + TILE_SIZE, w), y1 = std::min(y0 + TILE_SIZE, h);
+			rasterizeTile(x0, y0, x1, y1, w, depth,
+				[&](size_t index, int object, const glm::vec3& worldPos, const glm::vec3& normal, const glm::vec2& lightmapUV) {
+				objectIds[index] = object;
+				positions[index] = worldPos;
+				normals[index] = normal;
+				lightmapUVs[index] = lightmapUV;
+			});
+			for (int y = y0; y < y1; ++y)
+				for (int x = x0; x < x1; x += Float8::WIDTH)
+					shadeBatch(scene, params, samples, x, y, std::min((int)Float8::WIDTH, x1 - x));
+		});
+	}
+
+	//gather the indirect term of every lightmap texel with all samples, unrotated and
+	//without the adaptive stop, the texels of the map are overwritten
+	void bakeLightmap(const Scene& scene, const RenderParams& params, const std::vector<glm::vec3>& samples, Lightmap& map) {
+		renderRSM(scene, params);
+		if (params.ism)
+			splatShadowMaps(scene, params);
+		int w = map.width, h = map.height;
+		depth.assign((size_t)w * h, 1.0f);
+		objectIds.assign((size_t)w * h, -1);
+		positions.resize((size_t)w * h);
+		normals.resize((size_t)w * h);
+
+		//every triangle drawn at its atlas position
+		triangles.clear();
+		for (size_t o = 0; o < scene.objects.size(); ++o) {
+			const SceneObject& object = scene.objects[o];
+			const Mesh& mesh = scene.geometry.meshes[object.mesh];
+			glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(object.model)));
+			for (GLsizei i = 0; i < mesh.indexCount; i += 3) {
+				ClipVertex corners[3];
+				for (int k = 0; k < 3; ++k) {
+					int vertex = mesh.baseVertex + scene.geometry.indices[mesh.firstIndex + i + k];
+					const float* data = &scene.geometry.vertices[vertex * SceneGeometry::VERTEX_STRIDE];
+					glm::vec2 uv = atlasUV(scene, object, vertex);
+					corners[k].clip = glm::vec4(uv * 2.0f - 1.0f, 0.0f, 1.0f);
+					corners[k].worldPos = glm::vec3(object.model * glm::vec4(data[0], data[1], data[2], 1.0f));
+					corners[k].normal = normalMatrix * glm::vec3(data[3], data[4], data[5]);
+					corners[k].lightmapUV = uv;
+				}
+				addTriangle(corners[0], corners[1], corners[2], (int)o, w, h);
+			}
+		}
+		int tilesX = (w + TILE_SIZE - 1) / TILE_SIZE;
+		int tilesY = (h + TILE_SIZE - 1) / TILE_SIZE;
+		pool.parallelFor(tilesX * tilesY, [&](int tile) {
+			int x0 = tile % tilesX * TILE_SIZE, y0 = tile / tilesX * TILE_SIZE;
+			rasterizeTile(x0, y0, std::min(x0 + TILE_SIZE, w), std::min(y0 + TILE_SIZE, h), w, depth,
+				[&](size_t index, int object, const glm::vec3& worldPos, const glm::vec3& normal, const glm::vec2&) {
+				objectIds[index] = object;
+				positions[index] = worldPos;
+				normals[index] = normal;
+			});
+		});
+
+		RenderParams bake = params;
+		bake.sampleNum = (int)samples.size();
+		bake.adaptiveSampling = false;
+		bake.lpv = bake.probes = bake.lightmap = false;
+		const int W = Float8::WIDTH;
+		int batches = (w + W - 1) / W;
+		pool.parallelFor(batches * h, [&](int batch) {
+			int x = batch % batches * W, y = batch / batches;
+			int count = std::min(W, w - x);
+			size_t first = (size_t)y * w + x;
+			float lanes[6][W];
+			bool covered = false;
+			for (int i = 0; i < W; ++i) {
+				bool inside = i < count && objectIds[first + i] >= 0;
+				glm::vec3 p = inside ? positions[first + i] : glm::vec3(0.0f);
+				glm::vec3 n = inside ? normals[first + i] : glm::vec3(0.0f, 1.0f, 0.0f);
+				for (int c = 0; c < 3; ++c) {
+					lanes[c][i] = p[c];
+					lanes[3 + c][i] = n[c];
+				}
+				covered = covered || inside;
+			}
+			if (!covered)
+				return;
+			Vec8 P(Float8::load(lanes[0]), Float8::load(lanes[1]), Float8::load(lanes[2]));
+			Vec8 N(Float8::load(lanes[3]), Float8::load(lanes[4]), Float8::load(lanes[5]));
+			Float8 projX, projY, projZ;
+			project(bake, P, projX, projY, projZ);
+			Vec8 indirect = gather(bake, samples, P, N, projX, projY, Float8(1.0f), Float8(0.0f));
+			indirect.x.store(lanes[0]);
+			indirect.y.store(lanes[1]);
+			indirect.z.store(lanes[2]);
+			for (int i = 0; i < count; ++i)
+				if (objectIds[first + i] >= 0)
+					map.texels[first + i] = glm::vec3(lanes[0][i], lanes[1][i], lanes[2][i]);
+		});
+
+		std::vector<bool> covered(objectIds.size());
+		for (size_t i = 0; i < objectIds.size(); ++i)
+			covered[i] = objectIds[i] >= 0;
+		map.dilate(covered);
+	}
+
+private:
+	//counter-clockwise, positions snapped to fixed point so shared edges are rasterized exactly once
+	struct RasterTriangle {
+		long long x[3], y[3];		//window coordinates in 1 / 2^SUBPIXEL_BITS pixels
+		float z[3];					//window depth in [0, 1]
+		float invW[3];
+		glm::vec3 worldPos[3];		//divided by w
+		glm::vec3 normal[3];		//divided by w
+		long long area;				//twice the area, fixed point
+		int minX, minY, maxX, maxY;	//pixel bounds, inclusive
+		glm::vec2 lightmapUV[3];	//divided by w
+		int object;
+	};
+	struct ClipVertex {
+		glm::vec4 clip;
+		glm::vec3 worldPos;
+		glm::vec3 normal;
+		glm::vec2 lightmapUV;
+	};
+
+	ThreadPool& pool;
+	std::vector<float> blueNoise;
+	int noiseSize;
+	const Lightmap* lightmap;
+	std::vector<RasterTriangle> triangles;
+
+	std::vector<float> rsmDepth;
+	std::vector<glm::vec3> rsmNormal, rsmWorldPos, rsmFlux;
+	LpvVolume volume;
+	ProbeGrid irradianceProbes;
+	ImperfectShadowMaps shadowMaps;
+
+	std::vector<float> depth;
+	std::vector<int> objectIds;
+	std::vector<glm::vec3> positions, normals;
+	std::vector<glm::vec2> lightmapUVs;
+
+	void renderRSM(const Scene& scene, const RenderParams& params) {
+		int w = params.rsmWidth, h = params.rsmHeight;
+		rsmDepth.assign((size_t)w * h, 1.0f);
+		rsmNormal.assign((size_t)w * h, glm::vec3(0.0f));
+		rsmWorldPos.assign((size_t)w * h, glm::vec3(0.0f));
+		rsmFlux.assign((size_t)w * h, glm::vec3(0.0f));
+
+		std::vector<int> visible;
+		scene.cull(Frustum(params.lightSpaceMatrix), visible);
+		setupTriangles(scene, visible, params.lightSpaceMatrix, w, h);
+
+		int tilesX = (w + TILE_SIZE - 1) / TILE_SIZE;
+		int tilesY = (h + TILE_SIZE - 1) / TILE_SIZE;
+		pool.parallelFor(tilesX * tilesY, [&](int tile) {
+			int x0 = tile % tilesX * TILE_SIZE, y0 = tile / tilesX * TILE_SIZE;
+			rasterizeTile(x0, y0, std::min(x0 + TILE_SIZE, w), std::min(y0 + TILE_SIZE, h), w, rsmDepth,
+				[&](size_t index, int object, const glm::vec3& worldPos, const glm::vec3& normal, const glm::vec2&) {
+				//lightSpaceShader.frag, flux goes to an 8-bit target
+				glm::vec3 lightDir = glm::normalize(params.lightPos - worldPos);
+				float diff = std::max(0.0f, glm::dot(glm::normalize(normal), lightDir));
+				glm::vec3 flux = diff * scene.objects[object].diffuse * params.lightDiffuse;
+				rsmNormal[index] = params.halfRSM ? toHalf(normal) : normal;
+				rsmWorldPos[index] = params.halfRSM ? toHalf(worldPos) : worldPos;
+				rsmFlux[index] = glm::floor(glm::clamp(flux, 0.0f, 1.0f) * 255.0f + 0.5f) / 255.0f;
+			});
+			//DEPTH_COMPONENT16 keeps 16-bit unorm depth
+			if (params.halfRSM)
+				for (int y = y0; y < std::min(y0 + TILE_SIZE, h); ++y)
+					for (int x = x0; x < std::min(x0 + TILE_SIZE, w); ++x) {
+						float& d = rsmDepth[(size_t)y * w + x];
+						d = std::floor(d * 65535.0f + 0.5f) / 65535.0f;
+					}
+		});
+	}
+
+	//the points are sampled on first use, the scene is static
+	void splatShadowMaps(const Scene& scene, const RenderParams& params) {
+		if (shadowMaps.points.empty())
+			shadowMaps.init(scene);
+		shadowMaps.splat(pool, rsmNormal, rsmWorldPos, params.rsmWidth, params.rsmHeight);
+	}
+
+	//round through a 16-bit float like an RGB16F target
+	static glm::vec3 toHalf(const glm::vec3& v) {
+		return glm::vec3(roundHalf(v.x), roundHalf(v.y), roundHalf(v.z));
+	}
+	//nearest 16-bit float, ties to even: 11 significant bits, steps of 2^-24 below the
+	//smallest normal, infinity from 65520 on
+	static float roundHalf(float x) {
+		float a = std::fabs(x);
+		if (!(a < 65520.0f))
+			return a == a ? std::copysign(INFINITY, x) : x;
+		int exponent;
+		std::frexp(a, &exponent);
+		int shift = std::max(exponent - 11, -24);
+		return std::copysign(std::ldexp(std::nearbyint(std::ldexp(a, -shift)), shift), x);
+	}
+
+	//transform, near-clip and project the triangles of the visible objects
+	void setupTriangles(const Scene& scene, const std::vector<int>& visible, const glm::mat4& viewProj, int width, int height) {
+		triangles.clear();
+		for (size_t v = 0; v < visible.size(); ++v) {
+			const SceneObject& object = scene.objects[visible[v]];
+			const Mesh& mesh = scene.geometry.meshes[object.mesh];
+			glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(object.model)));
+			glm::mat4 mvp = viewProj * object.model;
+			for (GLsizei i = 0; i < mesh.indexCount; i += 3) {
+				ClipVertex polygon[4];
+				for (int k = 0; k < 3; ++k) {
+					const float* vertex = &scene.geometry.vertices[(mesh.baseVertex + scene.geometry.indices[mesh.firstIndex + i + k]) * SceneGeometry::VERTEX_STRIDE];
+					glm::vec4 position(vertex[0], vertex[1], vertex[2], 1.0f);
+					polygon[k].clip = mvp * position;
+					polygon[k].worldPos = glm::vec3(object.model * position);
+					polygon[k].normal = normalMatrix * glm::vec3(vertex[3], vertex[4], vertex[5]);
+					polygon[k].lightmapUV = atlasUV(scene, object, mesh.baseVertex + scene.geometry.indices[mesh.firstIndex + i + k]);
+				}
+				int count = clipNear(polygon);
+				for (int k = 1; k + 1 < count; ++k)
+					addTriangle(polygon[0], polygon[k], polygon[k + 1], visible[v], width, height);
+			}
+		}
+	}
+
+	//result_shader.vert's LightmapUV, zero without lightmap UVs
+	static glm::vec2 atlasUV(const Scene& scene, const SceneObject& object, int vertex) {
+		if (scene.geometry.lightmapUVs.empty())
+			return glm::vec2(0.0f);
+		glm::vec2 uv(scene.geometry.lightmapUVs[vertex * 2], scene.geometry.lightmapUVs[vertex * 2 + 1]);
+		return uv * glm::vec2(object.lightmap) + glm::vec2(object.lightmap.z, object.lightmap.w);
+	}
+
+	//clip against z >= -w, a triangle becomes at most a quad
+	static int clipNear(ClipVertex polygon[4]) {
+		ClipVertex in[3] = { polygon[0], polygon[1], polygon[2] };
+		int count = 0;
+		for (int k = 0; k < 3; ++k) {
+			const ClipVertex& a = in[k];
+			const ClipVertex& b = in[(k + 1) % 3];
+			float da = a.clip.z + a.clip.w, db = b.clip.z + b.clip.w;
+			if (da >= 0.0f)
+				polygon[count++] = a;
+			if ((da >= 0.0f) != (db >= 0.0f)) {
+				float t = da / (da - db);
+				ClipVertex& c = polygon[count++];
+				c.clip = glm::mix(a.clip, b.clip, t);
+				c.worldPos = glm::mix(a.worldPos, b.worldPos, t);
+				c.normal = glm::mix(a.normal, b.normal, t);
+				c.lightmapUV = glm::mix(a.lightmapUV, b.lightmapUV, t);
+			}
+		}
+		return count;
+	}
+
+	void addTriangle(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c, int object, int width, int height) {
+		const ClipVertex* vertices[3] = { &a, &b, &c };
+		//guard band keeping the edge function products inside 64 bits
+		const float limit = 4194304.0f;
+		const float scale = (float)(1 << SUBPIXEL_BITS);
+		RasterTriangle t;
+		for (int k = 0; k < 3; ++k) {
+			const ClipVertex& v = *vertices[k];
+			float invW = 1.0f / v.clip.w;
+			float x = glm::clamp((v.clip.x * invW * 0.5f + 0.5f) * width, -limit, limit);
+			float y = glm::clamp((v.clip.y * invW * 0.5f + 0.5f) * height, -limit, limit);
+			t.x[k] = (long long)std::floor(x * scale + 0.5f);
+			t.y[k] = (long long)std::floor(y * scale + 0.5f);
+			t.z[k] = v.clip.z * invW * 0.5f + 0.5f;
+			t.invW[k] = invW;
+			t.worldPos[k] = v.worldPos * invW;
+			t.normal[k] = v.normal * invW;
+			t.lightmapUV[k] = v.lightmapUV * invW;
+		}
+		t.area = edge(t, 0, 1, t.x[2], t.y[2]);
+		if (t.area == 0)
+			return;
+		if (t.area < 0) {
+			std::swap(t.x[1], t.x[2]);
+			std::swap(t.y[1], t.y[2]);
+			std::swap(t.z[1], t.z[2]);
+			std::swap(t.invW[1], t.invW[2]);
+			std::swap(t.worldPos[1], t.worldPos[2]);
+			std::swap(t.normal[1], t.normal[2]);
+			std::swap(t.lightmapUV[1], t.lightmapUV[2]);
+			t.area = -t.area;
+		}
+		//pixels whose centers can lie inside
+		const long long half = 1 << (SUBPIXEL_BITS - 1);
+		long long minX = std::min(t.x[0], std::min(t.x[1], t.x[2])) - half;
+		long long maxX = std::max(t.x[0], std::max(t.x[1], t.x[2])) - half;
+		long long minY = std::min(t.y[0], std::min(t.y[1], t.y[2])) - half;
+		long long maxY = std::max(t.y[0], std::max(t.y[1], t.y[2])) - half;
+		t.minX = (int)std::max(0LL, (minX + (1 << SUBPIXEL_BITS) - 1) >> SUBPIXEL_BITS);
+		t.minY = (int)std::max(0LL, (minY + (1 << SUBPIXEL_BITS) - 1) >> SUBPIXEL_BITS);
+		t.maxX = (int)std::min((long long)width - 1, maxX >> SUBPIXEL_BITS);
+		t.maxY = (int)std::min((long long)height - 1, maxY >> SUBPIXEL_BITS);
+		if (t.minX > t.maxX || t.minY > t.maxY)
+			return;
+		t.object = object;
+		triangles.push_back(t);
+	}
+
+	//twice the signed area of (v[i], v[j], p), positive when p is left of i -> j
+	static long long edge(const RasterTriangle& t, int i, int j, long long px, long long py) {
+		return (t.x[j] - t.x[i]) * (py - t.y[i]) - (t.y[j] - t.y[i]) * (px - t.x[i]);
+	}
+	//a pixel center exactly on an edge belongs to one of the two triangles sharing it
+	static bool ownsEdge(const RasterTriangle& t, int i, int j) {
+		long long dy = t.y[j] - t.y[i];
+		return dy < 0 || (dy == 0 && t.x[j] < t.x[i]);
+	}
+
+	//depth-tested rasterization of all triangles into the pixels [x0, x1) x [y0, y1)
+	template <typename Fragment>
+	void rasterizeTile(int x0, int y0, int x1, int y1, int width, std::vector<float>& depthBuffer, Fragment fragment) const {
+		const long long half = 1 << (SUBPIXEL_BITS - 1);
+		for (size_t i = 0; i < triangles.size(); ++i) {
+			const RasterTriangle& t = triangles[i];
+			int px0 = std::max(x0, t.minX), px1 = std::min(x1, t.maxX + 1);
+			int py0 = std::max(y0, t.minY), py1 = std::min(y1, t.maxY + 1);
+			long long bias0 = ownsEdge(t, 1, 2) ? 0 : -1;
+			long long bias1 = ownsEdge(t, 2, 0) ? 0 : -1;
+			long long bias2 = ownsEdge(t, 0, 1) ? 0 : -1;
+			float invArea = 1.0f / (float)t.area;
+			for (int y = py0; y < py1; ++y) {
+				long long sy = ((long long)y << SUBPIXEL_BITS) + half;
+				for (int x = px0; x < px1; ++x) {
+					long long sx = ((long long)x << SUBPIXEL_BITS) + half;
+					long long e0 = edge(t, 1, 2, sx, sy), e1 = edge(t, 2, 0, sx, sy), e2 = edge(t, 0, 1, sx, sy);
+					if (e0 + bias0 < 0 || e1 + bias1 < 0 || e2 + bias2 < 0)
+						continue;
+					float b0 = e0 * invArea, b1 = e1 * invArea, b2 = e2 * invArea;
+					float z = b0 * t.z[0] + b1 * t.z[1] + b2 * t.z[2];
+					size_t index = (size_t)y * width + x;
+					if (z >= depthBuffer[index] || z > 1.0f)
+						continue;
+					depthBuffer[index] = z;
+					float w = 1.0f / (b0 * t.invW[0] + b1 * t.invW[1] + b2 * t.invW[2]);
+					glm::vec3 worldPos = (b0 * t.worldPos[0] + b1 * t.worldPos[1] + b2 * t.worldPos[2]) * w;
+					glm::vec3 normal = (b0 * t.normal[0] + b1 * t.normal[1] + b2 * t.normal[2]) * w;
+					glm::vec2 lightmapUV = (b0 * t.lightmapUV[0] + b1 * t.lightmapUV[1] + b2 * t.lightmapUV[2]) * w;
+					fragment(index, t.object, worldPos, normal, lightmapUV);
+				}
+			}
+		}
+	}
+
+	//nearest texel of an RSM buffer, -1 outside the texture (border)
+	int rsmTexel(float u, float v, const RenderParams& params) const {
+		if (!(u >= 0.0f && u < 1.0f && v >= 0.0f && v < 1.0f))
+			return -1;
+		int x = std::min((int)(u * params.rsmWidth), params.rsmWidth - 1);
+		int y = std::min((int)(v * params.rsmHeight), params.rsmHeight - 1);
+		return y * params.rsmWidth + x;
+	}
+
+	static Float8 linearizeDepth(Float8 depth, const RenderParams& params) {
+		Float8 z = depth * 2.0f - 1.0f;
+		return Float8(2.0f * params.nearPlane * params.farPlane) /
+			(Float8(params.farPlane + params.nearPlane) - z * (params.farPlane - params.nearPlane));
+	}
+
+	//result_shader.frag for up to eight pixels of one row
+	void shadeBatch(const Scene& scene, const RenderParams& params, const std::vector<glm::vec3>& samples, int x, int y, int count) {
+		const int W = Float8::WIDTH;
+		size_t first = (size_t)y * params.width + x;
+		unsigned char* out = &color[((size_t)(params.height - 1 - y) * params.width + x) * 4];
+
+		float lanes[9][W];
+		glm::vec2 lightmapUV[W];
+		bool covered = false;
+		for (int i = 0; i < W; ++i) {
+			int object = i < count ? objectIds[first + i] : -1;
+			glm::vec3 p = object >= 0 ? positions[first + i] : glm::vec3(0.0f);
+			glm::vec3 n = object >= 0 ? normals[first + i] : glm::vec3(0.0f, 1.0f, 0.0f);
+			glm::vec3 albedo = object >= 0 ? scene.objects[object].diffuse : glm::vec3(0.0f);
+			for (int c = 0; c < 3; ++c) {
+				lanes[c][i] = p[c];
+				lanes[3 + c][i] = n[c];
+				lanes[6 + c][i] = albedo[c];
+			}
+			lightmapUV[i] = object >= 0 ? lightmapUVs[first + i] : glm::vec2(0.0f);
+			covered = covered || object >= 0;
+		}
+		if (covered) {
+			Vec8 P(Float8::load(lanes[0]), Float8::load(lanes[1]), Float8::load(lanes[2]));
+			Vec8 N(Float8::load(lanes[3]), Float8::load(lanes[4]), Float8::load(lanes[5]));
+			Vec8 albedo(Float8::load(lanes[6]), Float8::load(lanes[7]), Float8::load(lanes[8]));
+			//blue noise rotation, window coordinates like gl_FragCoord
+			float cosines[W], sines[W];
+			for (int i = 0; i < W; ++i) {
+				float noise = 0.0f;
+				if (params.blueNoise && noiseSize > 0) {
+					noise = blueNoise[(y % noiseSize) * noiseSize + (x + i) % noiseSize] + params.noiseOffset;
+					noise -= std::floor(noise);
+				}
+				cosines[i] = std::cos(6.2831853f * noise);
+				sines[i] = std::sin(6.2831853f * noise);
+			}
+			Vec8 result = shade(params, samples, P, N, albedo, Float8::load(cosines), Float8::load(sines), lightmapUV);
+			result.x.store(lanes[0]);
+			result.y.store(lanes[1]);
+			result.z.store(lanes[2]);
+		}
+
+		for (int i = 0; i < count; ++i) {
+			glm::vec3 c = params.clearColor;
+			if (objectIds[first + i] >= 0)
+				c = glm::pow(glm::vec3(lanes[0][i], lanes[1][i], lanes[2][i]), glm::vec3(1.0f / 2.2f));
+			c = glm::clamp(c, 0.0f, 1.0f);
+			out[i * 4 + 0] = (unsigned char)(c.r * 255.0f + 0.5f);
+			out[i * 4 + 1] = (unsigned char)(c.g * 255.0f + 0.5f);
+			out[i * 4 + 2] = (unsigned char)(c.b * 255.0f + 0.5f);
+			out[i * 4 + 3] = 255;
+		}
+	}
+
+	//light space texture coordinates and depth of P
+	static void project(const RenderParams& params, const Vec8& P, Float8& projX, Float8& projY, Float8& projZ) {
+		const glm::mat4& m = params.lightSpaceMatrix;
+		Float8 lx = P.x * m[0][0] + P.y * m[1][0] + P.z * m[2][0] + m[3][0];
+		Float8 ly = P.x * m[0][1] + P.y * m[1][1] + P.z * m[2][1] + m[3][1];
+		Float8 lz = P.x * m[0][2] + P.y * m[1][2] + P.z * m[2][2] + m[3][2];
+		Float8 lw = P.x * m[0][3] + P.y * m[1][3] + P.z * m[2][3] + m[3][3];
+		Float8 invW = Float8(1.0f) / lw;
+		projX = lx * invW * 0.5f + 0.5f;
+		projY = ly * invW * 0.5f + 0.5f;
+		projZ = lz * invW * 0.5f + 0.5f;
+	}
+
+	//RSM indirect term of result_shader.frag, lanes drop out of the adaptive gather independently
+	Vec8 gather(const RenderParams& params, const std::vector<glm::vec3>& samples, const Vec8& P, const Vec8& N,
+		const Float8& projX, const Float8& projY, const Float8& rotCos, const Float8& rotSin) const {
+		const int W = Float8::WIDTH;
+		float u[W], v[W], gathered[9][W], receiver[3][W];
+		Vec8 indirect(Float8(0.0f), Float8(0.0f), Float8(0.0f));
+		int sampleNum = std::min(params.sampleNum, (int)samples.size());
+		//tested off the surface so the receiver does not shadow itself at grazing angles
+		Vec8 offset = P + normalize(N) * ImperfectShadowMaps::RECEIVER_OFFSET;
+		offset.x.store(receiver[0]);
+		offset.y.store(receiver[1]);
+		offset.z.store(receiver[2]);
+		float active[W], lumSum[W], lumSqSum[W], taken[W];
+		for (int i = 0; i < W; ++i)
+			active[i] = 1.0f;
+		Float8 activeMask = Float8(1.0f) > Float8(0.0f);
+		Float8 lumSum8(0.0f), lumSqSum8(0.0f), taken8(0.0f);
+		for (int s = 0; s < sampleNum; ++s) {
+			const glm::vec3& r = samples[s];
+			Float8 sampleX = projX + (rotCos * r.x - rotSin * r.y) * params.sampleRadius;
+			Float8 sampleY = projY + (rotSin * r.x + rotCos * r.y) * params.sampleRadius;
+			sampleX.store(u);
+			sampleY.store(v);
+			for (int i = 0; i < W; ++i) {
+				int texel = rsmTexel(u[i], v[i], params);
+				glm::vec3 n = texel < 0 ? glm::vec3(1.0f) : rsmNormal[texel];
+				glm::vec3 p = texel < 0 ? glm::vec3(1.0f) : rsmWorldPos[texel];
+				glm::vec3 f = texel < 0 ? glm::vec3(1.0f) : rsmFlux[texel];
+				if (params.ism && !shadowMaps.visible(glm::vec3(receiver[0][i], receiver[1][i], receiver[2][i]), n, u[i], v[i], params.ismBias))
+					f = glm::vec3(0.0f);
+				for (int c = 0; c < 3; ++c) {
+					gathered[c][i] = n[c];
+					gathered[3 + c][i] = p[c];
+					gathered[6 + c][i] = f[c];
+				}
+			}
+			Vec8 targetNormal = normalize(Vec8(Float8::load(gathered[0]), Float8::load(gathered[1]), Float8::load(gathered[2])));
+			Vec8 targetPos(Float8::load(gathered[3]), Float8::load(gathered[4]), Float8::load(gathered[5]));
+			Vec8 targetFlux(Float8::load(gathered[6]), Float8::load(gathered[7]), Float8::load(gathered[8]));
+
+			Vec8 d = P - targetPos;
+			Float8 emit = max(dot(targetNormal, d), Float8(0.0f));
+			Float8 receive = max(Float8(0.0f) - dot(N, d), Float8(0.0f));
+			Float8 distance2 = dot(d, d);
+			Float8 weight = emit * receive / (distance2 * distance2) * r.z;
+			weight = select(activeMask, select(distance2 > Float8(0.0f), weight, Float8(0.0f)), Float8(0.0f));
+			Vec8 contribution = targetFlux * weight;
+			indirect += contribution;
+			taken8 += select(activeMask, Float8(1.0f), Float8(0.0f));
+
+			if (params.adaptiveSampling) {
+				Float8 lum = contribution.x * 0.2126f + contribution.y * 0.7152f + contribution.z * 0.0722f;
+				lumSum8 += lum;
+				lumSqSum8 += lum * lum;
+				int n = s + 1;
+				if (n % params.adaptiveBatch == 0 && n < sampleNum) {
+					lumSum8.store(lumSum);
+					lumSqSum8.store(lumSqSum);
+					taken8.store(taken);
+					bool any = false;
+					for (int i = 0; i < W; ++i) {
+						if (active[i] == 0.0f)
+							continue;
+						float mean = lumSum[i] / taken[i];
+						float variance = std::max(lumSqSum[i] / taken[i] - mean * mean, 0.0f);
+						if (20.0f * std::sqrt(variance / taken[i]) < params.adaptiveThreshold)
+							active[i] = 0.0f;
+						any = any || active[i] != 0.0f;
+					}
+					if (!any)
+						break;
+					activeMask = Float8::load(active) > Float8(0.0f);
+				}
+			}
+		}
+		if (sampleNum > 0) {
+			Float8 inv = Float8(1.0f) / taken8;
+			indirect = Vec8(min(max(indirect.x * inv, Float8(0.0f)), Float8(1.0f)),
+				min(max(indirect.y * inv, Float8(0.0f)), Float8(1.0f)),
+				min(max(indirect.z * inv, Float8(0.0f)), Float8(1.0f)));
+		}
+		return indirect;
+	}
+
+	//linear color before gamma
+	//rotCos/rotSin rotate the sample pattern of each lane, lightmapUV holds one coordinate per lane
+	Vec8 shade(const RenderParams& params, const std::vector<glm::vec3>& samples, const Vec8& P, const Vec8& N, const Vec8& albedo,
+		const Float8& rotCos, const Float8& rotSin, const glm::vec2* lightmapUV) const {
+		const int W = Float8::WIDTH;
+		Float8 projX, projY, projZ;
+		project(params, P, projX, projY, projZ);
+
+		float u[W], v[W], gathered[3][W];
+		projX.store(u);
+		projY.store(v);
+
+		//shadow
+		for (int i = 0; i < W; ++i) {
+			int texel = rsmTexel(u[i], v[i], params);
+			gathered[0][i] = texel < 0 ? 1.0f : rsmDepth[texel];
+		}
+		Float8 depthValue = linearizeDepth(Float8::load(gathered[0]), params);
+		Float8 shadow = select(linearizeDepth(projZ, params) - params.shadowBias > depthValue, Float8(0.05f), Float8(1.0f));
+
+		Vec8 indirect(Float8(0.0f), Float8(0.0f), Float8(0.0f));
+		if (!params.lpv && !params.probes && !params.lightmap)
+			indirect = gather(params, samples, P, N, projX, projY, rotCos, rotSin);
+		else {
+			float lanes[6][W];
+			P.x.store(lanes[0]);
+			P.y.store(lanes[1]);
+			P.z.store(lanes[2]);
+			N.x.store(lanes[3]);
+			N.y.store(lanes[4]);
+			N.z.store(lanes[5]);
+			for (int i = 0; i < W; ++i) {
+				glm::vec3 p(lanes[0][i], lanes[1][i], lanes[2][i]), n(lanes[3][i], lanes[4][i], lanes[5][i]);
+				glm::vec3 e;
+				if (params.lightmap)
+					e = lightmap != NULL ? lightmap->sample(lightmapUV[i]) : glm::vec3(0.0f);
+				else
+					e = params.lpv ? volume.irradiance(p, n) * params.lpvIntensity : irradianceProbes.irradiance(p, n) * params.probeIntensity;
+				e = glm::clamp(e, 0.0f, 1.0f);
+				for (int c = 0; c < 3; ++c)
+					gathered[c][i] = e[c];
+			}
+			indirect = Vec8(Float8::load(gathered[0]), Float8::load(gathered[1]), Float8::load(gathered[2]));
+		}
+
+		//direct
+		Vec8 lightPos(Float8(params.lightPos.x), Float8(params.lightPos.y), Float8(params.lightPos.z));
+		Vec8 viewPos(Float8(params.viewPos.x), Float8(params.viewPos.y), Float8(params.viewPos.z));
+		Vec8 lightDir = normalize(lightPos - P);
+		Vec8 norm = normalize(N);
+		Float8 diff = max(dot(norm, lightDir), Float8(0.0f));
+		Vec8 halfway = normalize(lightDir + normalize(viewPos - P));
+		float specBase[W];
+		max(dot(norm, halfway), Float8(0.0f)).store(specBase);
+		for (int i = 0; i < W; ++i)
+			specBase[i] = std::pow(specBase[i], params.shininess);
+		Float8 spec = Float8::load(specBase);
+
+		glm::vec3 ambient = params.lightAmbient * params.materialAmbient;
+		glm::vec3 specular = params.lightSpecular * params.materialSpecular;
+		Vec8 result;
+		result.x = Float8(ambient.x) + (albedo.x * diff * params.lightDiffuse.x + spec * specular.x) * shadow + indirect.x * 20.0f;
+		result.y = Float8(ambient.y) + (albedo.y * diff * params.lightDiffuse.y + spec * specular.y) * shadow + indirect.y * 20.0f;
+		result.z = Float8(ambient.z) + (albedo.z * diff * params.lightDiffuse.z + spec * specular.z) * shadow + indirect.z * 20.0f;
+		return result;
+	}
+};
+#endif
@@ -0,0 +1,144 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include<cmath>
+#include<algorithm>
+
+/*
+Render scale that holds a GPU frame time budget.
+Each frame is fed the GPU time of the passes whose cost follows the pixel count and
+of the fixed ones (light view, volumes, presenting). Over budget, the scale drops at
+once to what the pixel passes can afford in the time the fixed ones leave, assuming
+their cost goes with the area; it rises by one STEP only after RAISE_FRAMES frames
+whose predicted cost at the next step stays below HEADROOM of the budget, so it does
+not oscillate. Scales are multiples of STEP, which keeps the number of target sizes
+the pool sees small. With the quality ladder on, a frame still over budget at the
+minimum scale halves the gather samples, then the RSM size; they come back in the
+reverse order before the scale rises again.
+After every change the measurements are dropped for SETTLE_FRAMES frames, the pass
+times lag behind the settings.
+*/
+class DynamicResolution {
+public:
+	static constexpr float STEP = 0.0625f;
+	static constexpr float HEADROOM = 0.85f;
+	static constexpr float SMOOTHING = 0.1f;	//weight of a new frame in the running times
+	static const int RAISE_FRAMES = 30;
+	static const int SETTLE_FRAMES = 4;
+	static const int MIN_SAMPLE_NUM = 32;
+	static const int MIN_RSM_SIZE = 256;
+
+	float scale;
+	int sampleNum, rsmSize;
+
+	DynamicResolution() : scale(1.0f), sampleNum(0), rsmSize(0), targetMs(0.0), minScale(1.0f), quality(false),
+		maxSampleNum(0), maxRsmSize(0), fixedMs(-1.0), pixelMs(-1.0), calm(0), settle(0) {}
+
+	//targetMs 0 disables the controller; samples and size are the settings to start from and the ceiling
+	void init(double frameTargetMs, float minimumScale, bool qualityLadder, int samples, int size) {
+		targetMs = frameTargetMs;
+		minScale = std::floor(minimumScale / STEP) * STEP;
+		minScale = minScale < STEP ? STEP : minScale > 1.0f ? 1.0f : minScale;
+		quality = qualityLadder;
+		sampleNum = maxSampleNum = samples;
+		rsmSize = maxRsmSize = size;
+		scale = 1.0f;
+	}
+
+	bool enabled() const {
+		return targetMs > 0.0;
+	}
+
+	//GPU times of one frame, true if the scale or the quality settings changed
+	bool update(double fixedFrameMs, double pixelFrameMs) {
+		if (!enabled() || fixedFrameMs + pixelFrameMs <= 0.0)
+			return false;
+		if (settle > 0) {
+			--settle;
+			return false;
+		}
+		if (fixedMs < 0.0) {
+			fixedMs = fixedFrameMs;
+			pixelMs = pixelFrameMs;
+		}
+		else {
+			fixedMs += SMOOTHING * (fixedFrameMs - fixedMs);
+			pixelMs += SMOOTHING * (pixelFrameMs - pixelMs);
+		}
+
+		bool changed = false;
+		if (fixedMs + pixelMs > targetMs) {
+			calm = 0;
+			changed = lower();
+		}
+		else if (++calm >= RAISE_FRAMES) {
+			calm = 0;
+			changed = raise();
+		}
+		if (changed) {
+			settle = SETTLE_FRAMES;
+			fixedMs = pixelMs = -1.0;
+		}
+		return changed;
+	}
+
+	//size at the current scale, at least one pixel
+	int scaled(int size) const {
+		return std::max(1, (int)(size * scale + 0.5f));
+	}
+
+private:
+	double targetMs;
+	float minScale;
+	bool quality;
+	int maxSampleNum, maxRsmSize;
+	double fixedMs, pixelMs;	//running times, negative until the first frame after a change
+	int calm;		//frames under budget in a row
+	int settle;		//frames left to ignore
+
+	bool lower() {
+		if (scale > minScale) {
+			double budget = targetMs - fixedMs;
+			float wanted = budget > 0.0 && pixelMs > 0.0 ? scale * (float)std::sqrt(budget / pixelMs) : 0.0f;
+			wanted = std::min(std::floor(wanted / STEP) * STEP, scale - STEP);
+			scale = std::max(wanted, minScale);
+			return true;
+		}
+		if (!quality)
+			return false;
+		if (sampleNum > MIN_SAMPLE_NUM) {
+			sampleNum = sampleNum / 2 < MIN_SAMPLE_NUM ? MIN_SAMPLE_NUM : sampleNum / 2;
+			return true;
+		}
+		if (rsmSize > MIN_RSM_SIZE) {
+			rsmSize = rsmSize / 2 < MIN_RSM_SIZE ? MIN_RSM_SIZE : rsmSize / 2;
+			return true;
+		}
+		return false;
+	}
+
+	//one step, if the predicted cost leaves headroom; the RSM scales the fixed passes, the samples the gather
+	bool raise() {
+		double limit = HEADROOM * targetMs;
+		if (quality && rsmSize < maxRsmSize) {
+			if (fixedMs * 4.0 + pixelMs >= limit)
+				return false;
+			rsmSize = std::min(maxRsmSize, rsmSize * 2);
+			return true;
+		}
+		if (quality && sampleNum < maxSampleNum) {
+			if (fixedMs + pixelMs * 2.0 >= limit)
+				return false;
+			sampleNum = std::min(maxSampleNum, sampleNum * 2);
+			return true;
+		}
+		if (scale >= 1.0f)
+			return false;
+		float next = std::min(1.0f, scale + STEP);
+		if (fixedMs + pixelMs * (next * next) / (scale * scale) >= limit)
+			return false;
+		scale = next;
+		return true;
+	}
+};
+#endif
@@ -0,0 +1,296 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <glad/glad.h>
+
+#include<cstdio>
+#include<cstring>
+#include<string>
+#include<vector>
+#include<deque>
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<chrono>
+#include<iostream>
+
+#include "image_io.h"
+#include "gpu_memory.h"
+#include "shm_ring.h"
+
+/*
+Frame capture without pipeline stalls.
+glReadPixels of frame N goes into one of PBO_COUNT pixel pack buffers and returns at
+once; the copy runs on the GPU after the frame's draws. The buffer is only mapped when
+its slot comes around again, after frames N+1 and N+2 were submitted, so its fence has
+long signaled and the readback overlaps their rendering. Mapped pixels are copied into a pooled CPU buffer and handed to a writer
+thread, which flips the rows and encodes the file off the render thread. The writer
+queue is bounded: when the disk cannot keep up the render thread waits instead of
+buffering frames without limit. Every frame keeps the size it was read back at, so
+resize() between frames changes the size of the files that follow.
+The shm format skips the writer: the mapped pixels go straight into a shared memory
+ring (see ShmRing) for another process, which drops frames rather than wait for it.
+A resize beyond the ring's slots moves the ring to a larger segment.
+*/
+class FrameCapture {
+public:
+	static const int PBO_COUNT = 3;
+	static const int MAX_QUEUED = 4;
+	static const int SHM_SLOTS = 4;
+
+	FrameCapture() : width(0), height(0), frame(0), pending(0), written(0), stopping(false), active(false), renderSeconds(0.0) {
+		for (int i = 0; i < PBO_COUNT; ++i) {
+			pbos[i] = 0;
+			fences[i] = 0;
+			captureNs[i] = 0;
+		}
+	}
+	~FrameCapture() {
+		finish();
+	}
+
+	//format is png, ppm, raw or shm; files are named dir/frame_000000.<format>, for shm dir names
+	//the segment; false if nothing will be captured
+	bool init(int captureWidth, int captureHeight, const std::string& captureDir, const std::string& captureFormat) {
+		width = captureWidth;
+		height = captureHeight;
+		dir = captureDir;
+		format = captureFormat;
+		if (format == "shm" && !ring.create(dir, SHM_SLOTS, frameBytes()))
+			return false;
+		glGenBuffers(PBO_COUNT, pbos);
+		for (int i = 0; i < PBO_COUNT; ++i) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+			gpuBufferData(MEMORY_STREAMING, GL_PIXEL_PACK_BUFFER, frameBytes(), NULL, GL_STREAM_READ);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		stopping = false;
+		active = true;
+		if (!ring.valid())
+			writer = std::thread(&FrameCapture::writeLoop, this);
+		return true;
+	}
+
+	//read back the frames in flight at the old size, then capture at the new one
+	void resize(int captureWidth, int captureHeight) {
+		if (!active || (captureWidth == width && captureHeight == height))
+			return;
+		while (pending > 0)
+			collect();
+		width = captureWidth;
+		height = captureHeight;
+		if (ring.valid() && !ring.resize(frameBytes()))
+			std::cout << "ERROR::FRAME_CAPTURE::SHM_RESIZE_FAILED " << width << "x" << height << "\n";
+		for (int i = 0; i < PBO_COUNT; ++i) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+			gpuBufferData(MEMORY_STREAMING, GL_PIXEL_PACK_BUFFER, frameBytes(), NULL, GL_STREAM_READ);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	//queue a readback of the color attachment 0 of fbo, or of the back buffer for 0, call after the
+	//frame's last draw into it
+	void capture(GLuint fbo) {
+		if (!active)
+			return;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		//all slots in flight: collect the oldest, issued PBO_COUNT frames ago
+		if (pending == PBO_COUNT)
+			collect();
+		int slot = frame % PBO_COUNT;
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+		glReadBuffer(fbo == 0 ? GL_BACK : GL_COLOR_ATTACHMENT0);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		captureNs[slot] = ShmRing::now();
+		++frame;
+		++pending;
+		renderSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	//blocking readback for one-off captures, rows top to bottom
+	static void readPixels(GLuint fbo, int width, int height, std::vector<unsigned char>& pixels) {
+		std::vector<unsigned char> rows((size_t)width * height * 4);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rows.data());
+		size_t rowBytes = (size_t)width * 4;
+		pixels.resize(rows.size());
+		for (int y = 0; y < height; ++y)
+			std::memcpy(&pixels[y * rowBytes], &rows[(height - 1 - y) * rowBytes], rowBytes);
+	}
+
+	//frames read back so far, including those still in flight
+	int frames() const {
+		return frame;
+	}
+
+	//read back the frames still in flight, wait for the writer and release the buffers
+	void finish() {
+		if (!active)
+			return;
+		while (pending > 0)
+			collect();
+		if (writer.joinable()) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			queueChanged.notify_all();
+			writer.join();
+		}
+		gpuDeleteBuffers(PBO_COUNT, pbos);
+		active = false;
+		std::cout << "Captured " << written << " frames to " << dir << ", "
+			<< (frame > 0 ? renderSeconds * 1000.0 / frame : 0.0) << " ms per frame on the render thread";
+		if (ring.valid())
+			std::cout << ", " << ring.dropped() << " dropped";
+		std::cout << "\n";
+		ring.close();
+	}
+
+private:
+	struct Job {
+		int index;
+		int width, height;
+		std::vector<unsigned char> pixels;
+	};
+
+	int width, height;
+	std::string dir, format;
+	GLuint pbos[PBO_COUNT];
+	GLsync fences[PBO_COUNT];
+	uint64_t captureNs[PBO_COUNT];	//when each slot's readback was queued
+	int frame;		//frames issued
+	int pending;	//frames issued but not collected
+	int written;
+
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable queueChanged;
+	std::deque<Job> queue;
+	std::vector<std::vector<unsigned char> > freeBuffers;
+	bool stopping;
+	bool active;
+	double renderSeconds;
+	ShmRing ring;	//open for the shm format
+
+	size_t frameBytes() const {
+		return (size_t)width * height * 4;
+	}
+
+	//map the oldest frame in flight and pass a copy to the writer
+	void collect() {
+		int index = frame - pending;
+		int slot = index % PBO_COUNT;
+		while (glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+			;
+		glDeleteSync(fences[slot]);
+		fences[slot] = 0;
+		--pending;
+		if (format == "shm") {
+			publish(index, slot);
+			return;
+		}
+
+		Job job;
+		job.index = index;
+		job.width = width;
+		job.height = height;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			queueChanged.wait(lock, [this] { return (int)queue.size() < MAX_QUEUED; });
+			if (!freeBuffers.empty()) {
+				job.pixels.swap(freeBuffers.back());
+				freeBuffers.pop_back();
+			}
+		}
+		job.pixels.resize(frameBytes());
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+		void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameBytes(), GL_MAP_READ_BIT);
+		if (data != NULL) {
+			std::memcpy(job.pixels.data(), data, frameBytes());
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		if (data == NULL) {
+			std::cout << "ERROR::FRAME_CAPTURE::MAP_FAILED " << index << "\n";
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back(Job());
+			queue.back().index = job.index;
+			queue.back().width = job.width;
+			queue.back().height = job.height;
+			queue.back().pixels.swap(job.pixels);
+		}
+		queueChanged.notify_all();
+	}
+
+	//mapped PBO to the ring, flipped to rows top to bottom on the way; lost if the ring could not be resized
+	void publish(int index, int slot) {
+		if (!ring.valid())
+			return;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+		void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameBytes(), GL_MAP_READ_BIT);
+		if (data != NULL) {
+			if (ring.publish(index, width, height, (const unsigned char*)data, true, captureNs[slot]))
+				++written;
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		if (data == NULL)
+			std::cout << "ERROR::FRAME_CAPTURE::MAP_FAILED " << index << "\n";
+	}
+
+	void writeLoop() {
+		std::vector<unsigned char> flipped;
+		for (;;) {
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				queueChanged.wait(lock, [this] { return stopping || !queue.empty(); });
+				if (queue.empty())
+					return;
+				job.index = queue.front().index;
+				job.width = queue.front().width;
+				job.height = queue.front().height;
+				job.pixels.swap(queue.front().pixels);
+				queue.pop_front();
+			}
+			queueChanged.notify_all();
+
+			//GL rows start at the bottom
+			size_t rowBytes = (size_t)job.width * 4;
+			flipped.resize(job.pixels.size());
+			for (int y = 0; y < job.height; ++y)
+				std::memcpy(&flipped[y * rowBytes], &job.pixels[(job.height - 1 - y) * rowBytes], rowBytes);
+			char name[32];
+			std::snprintf(name, sizeof(name), "/frame_%06d.", job.index);
+			std::string path = dir + name + format;
+			bool ok;
+			if (format == "raw")
+				ok = writeRaw(path, flipped.data(), job.width, job.height, 4);
+			else if (format == "ppm")
+				ok = writePPM(path, flipped.data(), job.width, job.height, 4);
+			else
+				ok = writePNG(path, flipped.data(), job.width, job.height, 4);
+			if (!ok)
+				std::cout << "ERROR::FRAME_CAPTURE::WRITE_FAILED " << path << "\n";
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (ok)
+				++written;
+			freeBuffers.push_back(std::vector<unsigned char>());
+			freeBuffers.back().swap(job.pixels);
+		}
+	}
+};
+#endif
@@ -0,0 +1,199 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <glad/glad.h>
+
+#include<vector>
+#include<thread>
+#include<chrono>
+#include<algorithm>
+#include<iostream>
+
+/*
+Frame pacing of the window loop: how far the CPU may run ahead of the GPU, how often
+frames start, and how long input takes to reach the screen.
+Every frame ends with a GL_TIMESTAMP query and a fence after the swap. With
+maxInFlight frames not yet finished on the GPU, begin() waits on the oldest fence
+before the next frame starts, so input is not sampled while older frames still queue.
+With a frame rate limit, begin() then sleeps until the frame's start time and spins
+for the last SPIN_SECONDS, which sleep would overshoot by up to a scheduler tick.
+The latency of a frame runs from inputSampled() to its timestamp query, the point the
+GPU got to after executing the swap, on the CPU clock through an offset between the two
+clocks that is measured again with every report. Frames whose fence was not collected
+before its slot came around again go unmeasured.
+A frame that renders nothing, e.g. while minimized, ends with skip() instead of end(): the
+wait until the next begin() counts neither as frame time nor towards the report, and the
+frame rate limit starts its schedule over.
+*/
+class FramePacer {
+public:
+	static const int SLOTS = 8;			//frames tracked, the bound on frames in flight is one less
+	static constexpr double SPIN_SECONDS = 0.002;
+	static constexpr double REPORT_SECONDS = 2.0;
+
+	FramePacer() : maxInFlight(0), period(0.0), report(false), skipped(false), issued(0), retired(0), clockOffsetNs(0),
+		reportFrames(0) {
+		for (int i = 0; i < SLOTS; ++i) {
+			queries[i] = 0;
+			fences[i] = 0;
+			inputNs[i] = 0;
+		}
+	}
+	~FramePacer() {
+		for (int i = 0; i < SLOTS; ++i)
+			if (fences[i] != 0)
+				glDeleteSync(fences[i]);
+		if (queries[0] != 0)
+			glDeleteQueries(SLOTS, queries);
+	}
+
+	//framesInFlight 0 leaves the queue depth to the driver, fpsLimit 0 starts frames at once;
+	//report prints frame and latency statistics every REPORT_SECONDS
+	void init(int framesInFlight, double fpsLimit, bool printReport) {
+		maxInFlight = std::min(framesInFlight, SLOTS - 1);
+		period = fpsLimit > 0.0 ? 1.0 / fpsLimit : 0.0;
+		report = printReport;
+		glGenQueries(SLOTS, queries);
+		calibrate();
+		nextStart = reportStart = lastStart = inputTime = clock::now();
+	}
+
+	//before processInput(): waits for a frame slot, then for the frame's start time
+	void begin() {
+		collect(false);
+		while (maxInFlight > 0 && issued - retired >= maxInFlight)
+			collect(true);
+
+		clock::time_point now = clock::now();
+		if (period > 0.0) {
+			nextStart += std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(period));
+			//fell more than a frame behind: restart the schedule instead of catching up with a burst
+			if (skipped || nextStart + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(period)) < now)
+				nextStart = now;
+			waitUntil(nextStart);
+			now = clock::now();
+		}
+		//the time since a skipped frame began is not a frame, and not part of the report
+		if (skipped)
+			reportStart += now - lastStart;
+		else
+			frameTimes.push_back(seconds(lastStart, now) * 1000.0);
+		skipped = false;
+		lastStart = now;
+	}
+
+	//instead of end() for a frame that renders nothing, e.g. while the window is minimized
+	void skip() {
+		skipped = true;
+	}
+
+	//right after the input the frame renders with was read
+	void inputSampled() {
+		inputTime = clock::now();
+	}
+
+	//right after the swap
+	void end() {
+		int slot = issued % SLOTS;
+		//not collected in time, the frame's latency is lost
+		if (fences[slot] != 0) {
+			glDeleteSync(fences[slot]);
+			fences[slot] = 0;
+			++retired;
+		}
+		glQueryCounter(queries[slot], GL_TIMESTAMP);
+		fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		inputNs[slot] = nanoseconds(inputTime);
+		++issued;
+		++reportFrames;
+
+		double elapsed = seconds(reportStart, clock::now());
+		if (elapsed < REPORT_SECONDS)
+			return;
+		if (report)
+			print(elapsed);
+		frameTimes.clear();
+		latencies.clear();
+		reportFrames = 0;
+		reportStart = clock::now();
+		calibrate();
+	}
+
+private:
+	typedef std::chrono::steady_clock clock;
+
+	int maxInFlight;
+	double period;		//seconds between frame starts, 0: no limit
+	bool report;
+	bool skipped;		//the frame begun last rendered nothing
+	GLuint queries[SLOTS];
+	GLsync fences[SLOTS];
+	long long inputNs[SLOTS];
+	long long issued, retired;	//frames ended and frames whose fence was collected
+	long long clockOffsetNs;	//CPU clock minus GL timestamp
+	clock::time_point nextStart, lastStart, reportStart, inputTime;
+	int reportFrames;
+	std::vector<double> frameTimes, latencies;	//ms, since the last report
+
+	static long long nanoseconds(clock::time_point time) {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+	}
+	static double seconds(clock::time_point from, clock::time_point to) {
+		return std::chrono::duration<double>(to - from).count();
+	}
+
+	void calibrate() {
+		GLint64 gpuNs = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpuNs);
+		clockOffsetNs = nanoseconds(clock::now()) - gpuNs;
+	}
+
+	//sleep, then spin out the last SPIN_SECONDS
+	static void waitUntil(clock::time_point deadline) {
+		clock::time_point wake = deadline - std::chrono::microseconds((long long)(SPIN_SECONDS * 1e6));
+		if (clock::now() < wake)
+			std::this_thread::sleep_until(wake);
+		while (clock::now() < deadline)
+			std::this_thread::yield();
+	}
+
+	//retire the frames the GPU finished, in order; wait blocks on the oldest one
+	void collect(bool wait) {
+		while (retired < issued) {
+			int slot = retired % SLOTS;
+			GLenum status = glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 1000000000 : 0);
+			if (status == GL_TIMEOUT_EXPIRED)
+				return;
+			glDeleteSync(fences[slot]);
+			fences[slot] = 0;
+			++retired;
+			if (status != GL_WAIT_FAILED) {
+				GLuint64 gpuNs = 0;
+				glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &gpuNs);
+				latencies.push_back(((long long)gpuNs + clockOffsetNs - inputNs[slot]) / 1e6);
+			}
+			wait = false;
+		}
+	}
+
+	void print(double elapsed) {
+		double frameMean = 0.0, frameMax = 0.0, latencyMean = 0.0, latencyMax = 0.0, latencyP95 = 0.0;
+		for (size_t i = 0; i < frameTimes.size(); ++i) {
+			frameMean += frameTimes[i] / frameTimes.size();
+			frameMax = std::max(frameMax, frameTimes[i]);
+		}
+		for (size_t i = 0; i < latencies.size(); ++i) {
+			latencyMean += latencies[i] / latencies.size();
+			latencyMax = std::max(latencyMax, latencies[i]);
+		}
+		if (!latencies.empty()) {
+			std::vector<double>::iterator p95 = latencies.begin() + (latencies.size() * 95) / 100;
+			std::nth_element(latencies.begin(), p95, latencies.end());
+			latencyP95 = *p95;
+		}
+		std::cout << "pacing: " << reportFrames / elapsed << " fps, frame " << frameMean << " ms (max " << frameMax
+			<< "), input to present " << latencyMean << " ms (p95 " << latencyP95 << ", max " << latencyMax << ", "
+			<< latencies.size() << " frames)\n";
+	}
+};
+#endif
@@ -0,0 +1,177 @@
+#ifndef GPU_MEMORY_H
+#define GPU_MEMORY_H
+
+#include <glad/glad.h>
+
+#include<map>
+#include<cstdio>
+#include<iostream>
+
+enum GpuMemoryCategory {
+	MEMORY_RENDER_TARGETS,	//RSM, scene and pooled targets
+	MEMORY_GEOMETRY,		//vertex and index buffers
+	MEMORY_SAMPLING,		//sample and blue noise tables
+	MEMORY_INDIRECT,		//irradiance cache, LPV, probes, lightmap and shadow maps
+	MEMORY_CULLING,			//culling buffers and Hi-Z pyramids
+	MEMORY_STREAMING,		//uniform ring and capture read backs
+	MEMORY_CATEGORY_COUNT
+};
+
+/*
+Bytes of every live GL texture and buffer by category, with the peaks.
+Sizes are what the storage needs, not what the driver reports: three-channel formats
+count as padded to four like most drivers store them, and mip chains are summed.
+Allocations go through the gpu* wrappers below, which look up the object bound to the
+target, so re-specifying a texture replaces its old size.
+*/
+class GpuMemory {
+public:
+	static GpuMemory& instance() {
+		static GpuMemory memory;
+		return memory;
+	}
+
+	void allocateTexture(GLuint texture, GpuMemoryCategory category, size_t bytes) {
+		allocate(textures, texture, category, bytes);
+	}
+	void allocateBuffer(GLuint buffer, GpuMemoryCategory category, size_t bytes) {
+		allocate(buffers, buffer, category, bytes);
+	}
+	void freeTexture(GLuint texture) {
+		release(textures, texture);
+	}
+	void freeBuffer(GLuint buffer) {
+		release(buffers, buffer);
+	}
+
+	size_t current(GpuMemoryCategory category) const { return currentBytes[category]; }
+	size_t peak(GpuMemoryCategory category) const { return peakBytes[category]; }
+	size_t total() const { return totalBytes; }
+	size_t totalPeak() const { return totalPeakBytes; }
+
+	void report(std::ostream& out) const {
+		static const char* names[MEMORY_CATEGORY_COUNT] = {
+			"render targets", "geometry", "sampling", "indirect", "culling", "streaming"
+		};
+		char line[128];
+		out << "GPU memory          current MB    peak MB\n";
+		for (int c = 0; c < MEMORY_CATEGORY_COUNT; ++c) {
+			std::snprintf(line, sizeof(line), "  %-16s %10.2f %10.2f\n", names[c], megabytes(currentBytes[c]), megabytes(peakBytes[c]));
+			out << line;
+		}
+		std::snprintf(line, sizeof(line), "  %-16s %10.2f %10.2f\n", "total", megabytes(totalBytes), megabytes(totalPeakBytes));
+		out << line;
+	}
+
+	//storage of one texel, 0 for formats this renderer does not use
+	static size_t texelBytes(GLenum internalFormat) {
+		switch (internalFormat) {
+		case GL_R8: return 1;
+		case GL_DEPTH_COMPONENT16: case GL_R16F: return 2;
+		case GL_RGB: case GL_RGB8: case GL_RGBA: case GL_RGBA8: case GL_R32F: case GL_R32UI: case GL_RG16F:
+		case GL_DEPTH_COMPONENT: case GL_DEPTH_COMPONENT24: case GL_DEPTH_COMPONENT32F: return 4;
+		case GL_RGB16F: case GL_RGBA16F: case GL_RG32F: return 8;
+		case GL_RGB32F: case GL_RGBA32F: return 16;
+		default: return 0;
+		}
+	}
+	static size_t textureBytes(GLenum internalFormat, int width, int height, int depth, int levels) {
+		size_t bytes = 0;
+		for (int level = 0; level < levels; ++level) {
+			bytes += (size_t)width * height * depth * texelBytes(internalFormat);
+			width = width > 1 ? width / 2 : 1;
+			height = height > 1 ? height / 2 : 1;
+		}
+		return bytes;
+	}
+
+private:
+	struct Allocation {
+		GpuMemoryCategory category;
+		size_t bytes;
+	};
+	std::map<GLuint, Allocation> textures, buffers;
+	size_t currentBytes[MEMORY_CATEGORY_COUNT], peakBytes[MEMORY_CATEGORY_COUNT];
+	size_t totalBytes, totalPeakBytes;
+
+	GpuMemory() : totalBytes(0), totalPeakBytes(0) {
+		for (int c = 0; c < MEMORY_CATEGORY_COUNT; ++c)
+			currentBytes[c] = peakBytes[c] = 0;
+	}
+
+	void allocate(std::map<GLuint, Allocation>& objects, GLuint object, GpuMemoryCategory category, size_t bytes) {
+		release(objects, object);
+		Allocation allocation = { category, bytes };
+		objects[object] = allocation;
+		currentBytes[category] += bytes;
+		totalBytes += bytes;
+		if (currentBytes[category] > peakBytes[category])
+			peakBytes[category] = currentBytes[category];
+		if (totalBytes > totalPeakBytes)
+			totalPeakBytes = totalBytes;
+	}
+	void release(std::map<GLuint, Allocation>& objects, GLuint object) {
+		std::map<GLuint, Allocation>::iterator it = objects.find(object);
+		if (it == objects.end())
+			return;
+		currentBytes[it->second.category] -= it->second.bytes;
+		totalBytes -= it->second.bytes;
+		objects.erase(it);
+	}
+	static double megabytes(size_t bytes) {
+		return bytes / (1024.0 * 1024.0);
+	}
+};
+
+//tracked versions of the GL allocation calls, for the texture or buffer bound to the target
+inline GLuint boundTexture(GLenum target) {
+	GLint texture;
+	glGetIntegerv(target == GL_TEXTURE_3D ? GL_TEXTURE_BINDING_3D : GL_TEXTURE_BINDING_2D, &texture);
+	return (GLuint)texture;
+}
+inline GLuint boundBuffer(GLenum target) {
+	GLenum binding = GL_ARRAY_BUFFER_BINDING;
+	switch (target) {
+	case GL_ELEMENT_ARRAY_BUFFER: binding = GL_ELEMENT_ARRAY_BUFFER_BINDING; break;
+	case GL_UNIFORM_BUFFER: binding = GL_UNIFORM_BUFFER_BINDING; break;
+	case GL_SHADER_STORAGE_BUFFER: binding = GL_SHADER_STORAGE_BUFFER_BINDING; break;
+	case GL_PIXEL_PACK_BUFFER: binding = GL_PIXEL_PACK_BUFFER_BINDING; break;
+	}
+	GLint buffer;
+	glGetIntegerv(binding, &buffer);
+	return (GLuint)buffer;
+}
+
+inline void gpuTexImage2D(GpuMemoryCategory category, GLenum internalFormat, GLsizei width, GLsizei height,
+	GLenum format, GLenum type, const void* data) {
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, data);
+	GpuMemory::instance().allocateTexture(boundTexture(GL_TEXTURE_2D), category, GpuMemory::textureBytes(internalFormat, width, height, 1, 1));
+}
+inline void gpuTexImage3D(GpuMemoryCategory category, GLenum internalFormat, GLsizei width, GLsizei height, GLsizei depth,
+	GLenum format, GLenum type, const void* data) {
+	glTexImage3D(GL_TEXTURE_3D, 0, internalFormat, width, height, depth, 0, format, type, data);
+	GpuMemory::instance().allocateTexture(boundTexture(GL_TEXTURE_3D), category, GpuMemory::textureBytes(internalFormat, width, height, depth, 1));
+}
+inline void gpuTexStorage2D(GpuMemoryCategory category, GLsizei levels, GLenum internalFormat, GLsizei width, GLsizei height) {
+	glTexStorage2D(GL_TEXTURE_2D, levels, internalFormat, width, height);
+	GpuMemory::instance().allocateTexture(boundTexture(GL_TEXTURE_2D), category, GpuMemory::textureBytes(internalFormat, width, height, 1, levels));
+}
+inline void gpuBufferData(GpuMemoryCategory category, GLenum target, GLsizeiptr size, const void* data, GLenum usage) {
+	glBufferData(target, size, data, usage);
+	GpuMemory::instance().allocateBuffer(boundBuffer(target), category, (size_t)size);
+}
+inline void gpuBufferStorage(GpuMemoryCategory category, GLenum target, GLsizeiptr size, const void* data, GLbitfield flags) {
+	glBufferStorage(target, size, data, flags);
+	GpuMemory::instance().allocateBuffer(boundBuffer(target), category, (size_t)size);
+}
+inline void gpuDeleteTextures(GLsizei count, const GLuint* textures) {
+	for (GLsizei i = 0; i < count; ++i)
+		GpuMemory::instance().freeTexture(textures[i]);
+	glDeleteTextures(count, textures);
+}
+inline void gpuDeleteBuffers(GLsizei count, const GLuint* buffers) {
+	for (GLsizei i = 0; i < count; ++i)
+		GpuMemory::instance().freeBuffer(buffers[i]);
+	glDeleteBuffers(count, buffers);
+}
+#endif
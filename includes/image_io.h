@@ -0,0 +1,193 @@
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include<cstdio>
+#include<cstdint>
+#include<string>
+#include<vector>
+#include<algorithm>
+
+//8-bit RGB(A) image helpers. Rows are stored top to bottom.
+
+inline bool writeRaw(const std::string& path, const unsigned char* pixels, int width, int height, int channels) {
+	FILE* file = std::fopen(path.c_str(), "wb");
+	if (file == NULL)
+		return false;
+	size_t size = (size_t)width * height * channels;
+	bool ok = std::fwrite(pixels, 1, size, file) == size;
+	std::fclose(file);
+	return ok;
+}
+
+inline bool writePPM(const std::string& path, const unsigned char* pixels, int width, int height, int channels) {
+	FILE* file = std::fopen(path.c_str(), "wb");
+	if (file == NULL)
+		return false;
+	std::fprintf(file, "P6\n%d %d\n255\n", width, height);
+	std::vector<unsigned char> row(width * 3);
+	for (int y = 0; y < height; ++y) {
+		const unsigned char* src = pixels + (size_t)y * width * channels;
+		for (int x = 0; x < width; ++x) {
+			row[x * 3 + 0] = src[x * channels + 0];
+			row[x * 3 + 1] = src[x * channels + 1];
+			row[x * 3 + 2] = src[x * channels + 2];
+		}
+		std::fwrite(row.data(), 1, row.size(), file);
+	}
+	std::fclose(file);
+	return true;
+}
+
+//reads binary (P6) 8-bit PPM files into RGB pixels
+inline bool readPPM(const std::string& path, std::vector<unsigned char>& pixels, int& width, int& height) {
+	FILE* file = std::fopen(path.c_str(), "rb");
+	if (file == NULL)
+		return false;
+	int maxValue = 0;
+	bool ok = std::fscanf(file, "P6 %d %d %d", &width, &height, &maxValue) == 3 && maxValue == 255;
+	if (ok) {
+		std::fgetc(file);
+		pixels.resize((size_t)width * height * 3);
+		ok = std::fread(pixels.data(), 1, pixels.size(), file) == pixels.size();
+	}
+	std::fclose(file);
+	return ok;
+}
+
+namespace png_detail {
+	struct CrcTable {
+		uint32_t entries[256];
+		CrcTable() {
+			for (uint32_t i = 0; i < 256; ++i) {
+				uint32_t c = i;
+				for (int k = 0; k < 8; ++k)
+					c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				entries[i] = c;
+			}
+		}
+	};
+	inline uint32_t crc32(uint32_t crc, const unsigned char* data, size_t size) {
+		static const CrcTable table;
+		crc = ~crc;
+		for (size_t i = 0; i < size; ++i)
+			crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
+	//the modulo is deferred over runs of 5552 bytes, the longest run that cannot overflow
+	inline uint32_t adler32(const unsigned char* data, size_t size) {
+		uint32_t a = 1, b = 0;
+		while (size > 0) {
+			size_t run = std::min<size_t>(size, 5552);
+			size -= run;
+			for (size_t i = 0; i < run; ++i) {
+				a += data[i];
+				b += a;
+			}
+			data += run;
+			a %= 65521;
+			b %= 65521;
+		}
+		return (b << 16) | a;
+	}
+	inline void putU32(std::vector<unsigned char>& out, uint32_t v) {
+		out.push_back((v >> 24) & 0xFF);
+		out.push_back((v >> 16) & 0xFF);
+		out.push_back((v >> 8) & 0xFF);
+		out.push_back(v & 0xFF);
+	}
+	inline void writeChunk(FILE* file, const char* type, const std::vector<unsigned char>& data) {
+		std::vector<unsigned char> chunk;
+		putU32(chunk, (uint32_t)data.size());
+		chunk.insert(chunk.end(), type, type + 4);
+		chunk.insert(chunk.end(), data.begin(), data.end());
+		uint32_t crc = crc32(0, chunk.data() + 4, chunk.size() - 4);
+		putU32(chunk, crc);
+		std::fwrite(chunk.data(), 1, chunk.size(), file);
+	}
+}
+
+/*
+PNG writer using stored (uncompressed) deflate blocks. Files are as large as raw
+frames but encoding is a memcpy plus checksums, which keeps a capture writer thread
+ahead of the renderer without pulling in zlib.
+*/
+inline bool writePNG(const std::string& path, const unsigned char* pixels, int width, int height, int channels) {
+	FILE* file = std::fopen(path.c_str(), "wb");
+	if (file == NULL)
+		return false;
+	static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	std::fwrite(signature, 1, 8, file);
+
+	std::vector<unsigned char> header;
+	png_detail::putU32(header, width);
+	png_detail::putU32(header, height);
+	header.push_back(8);						//bit depth
+	header.push_back(channels == 4 ? 6 : 2);	//RGBA or RGB
+	header.push_back(0);
+	header.push_back(0);
+	header.push_back(0);
+	png_detail::writeChunk(file, "IHDR", header);
+
+	//filter byte 0 in front of every row
+	size_t rowBytes = (size_t)width * channels;
+	std::vector<unsigned char> scanlines((rowBytes + 1) * height);
+	for (int y = 0; y < height; ++y) {
+		scanlines[y * (rowBytes + 1)] = 0;
+		const unsigned char* src = pixels + y * rowBytes;
+		std::copy(src, src + rowBytes, scanlines.begin() + y * (rowBytes + 1) + 1);
+	}
+
+	std::vector<unsigned char> zlib;
+	zlib.reserve(scanlines.size() + scanlines.size() / 65535 * 5 + 16);
+	zlib.push_back(0x78);
+	zlib.push_back(0x01);
+	size_t pos = 0;
+	do {
+		size_t blockSize = std::min<size_t>(65535, scanlines.size() - pos);
+		bool last = pos + blockSize == scanlines.size();
+		zlib.push_back(last ? 1 : 0);
+		zlib.push_back(blockSize & 0xFF);
+		zlib.push_back((blockSize >> 8) & 0xFF);
+		zlib.push_back(~blockSize & 0xFF);
+		zlib.push_back((~blockSize >> 8) & 0xFF);
+		zlib.insert(zlib.end(), scanlines.begin() + pos, scanlines.begin() + pos + blockSize);
+		pos += blockSize;
+	} while (pos < scanlines.size());
+	png_detail::putU32(zlib, png_detail::adler32(scanlines.data(), scanlines.size()));
+	png_detail::writeChunk(file, "IDAT", zlib);
+	png_detail::writeChunk(file, "IEND", std::vector<unsigned char>());
+	std::fclose(file);
+	return true;
+}
+
+/*
+Portable float map, RGB 32-bit floats. Rows are stored bottom to top like GL
+textures; a negative scale in the header marks little-endian data.
+*/
+inline bool writePFM(const std::string& path, const float* pixels, int width, int height) {
+	FILE* file = std::fopen(path.c_str(), "wb");
+	if (file == NULL)
+		return false;
+	std::fprintf(file, "PF\n%d %d\n-1.0\n", width, height);
+	size_t size = (size_t)width * height * 3;
+	bool ok = std::fwrite(pixels, sizeof(float), size, file) == size;
+	std::fclose(file);
+	return ok;
+}
+
+//reads little-endian PFM files as written by writePFM
+inline bool readPFM(const std::string& path, std::vector<float>& pixels, int& width, int& height) {
+	FILE* file = std::fopen(path.c_str(), "rb");
+	if (file == NULL)
+		return false;
+	float scale = 0.0f;
+	bool ok = std::fscanf(file, "PF %d %d %f", &width, &height, &scale) == 3 && scale < 0.0f && width > 0 && height > 0;
+	if (ok) {
+		std::fgetc(file);
+		pixels.resize((size_t)width * height * 3);
+		ok = std::fread(pixels.data(), sizeof(float), pixels.size(), file) == pixels.size();
+	}
+	std::fclose(file);
+	return ok;
+}
+#endif
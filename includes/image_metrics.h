@@ -0,0 +1,166 @@
+#ifndef IMAGE_METRICS_H
+#define IMAGE_METRICS_H
+
+#include<cmath>
+#include<vector>
+#include<algorithm>
+
+//Quality of an 8-bit RGB image against a reference
+struct ImageDiff {
+	double psnr;		//dB, infinity for identical images
+	double ssim;		//mean structural similarity of luma, 1 is identical
+	double flip;		//mean perceptual error in [0, 1], 0 is identical
+	double maxFlip;
+};
+
+namespace metrics_detail {
+	inline float srgbToLinear(float c) {
+		return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+	}
+	inline float labCurve(float t) {
+		return t > 0.008856f ? std::cbrt(t) : 7.787f * t + 16.0f / 116.0f;
+	}
+	//CIELAB under D65, three floats per pixel
+	inline void toLab(const unsigned char* rgb, int count, std::vector<float>& lab) {
+		lab.resize((size_t)count * 3);
+		for (int i = 0; i < count; ++i) {
+			float r = srgbToLinear(rgb[i * 3] / 255.0f);
+			float g = srgbToLinear(rgb[i * 3 + 1] / 255.0f);
+			float b = srgbToLinear(rgb[i * 3 + 2] / 255.0f);
+			float x = labCurve((0.4124f * r + 0.3576f * g + 0.1805f * b) / 0.9505f);
+			float y = labCurve(0.2126f * r + 0.7152f * g + 0.0722f * b);
+			float z = labCurve((0.0193f * r + 0.1192f * g + 0.9505f * b) / 1.089f);
+			lab[i * 3] = 116.0f * y - 16.0f;
+			lab[i * 3 + 1] = 500.0f * (x - y);
+			lab[i * 3 + 2] = 200.0f * (y - z);
+		}
+	}
+	//separable 5-tap binomial blur of an interleaved image, edges clamped
+	inline void blur(std::vector<float>& image, int width, int height, int channels) {
+		static const float kernel[5] = { 1.0f / 16, 4.0f / 16, 6.0f / 16, 4.0f / 16, 1.0f / 16 };
+		std::vector<float> temp(image.size());
+		for (int pass = 0; pass < 2; ++pass) {
+			const std::vector<float>& src = pass == 0 ? image : temp;
+			std::vector<float>& dst = pass == 0 ? temp : image;
+			for (int y = 0; y < height; ++y)
+				for (int x = 0; x < width; ++x)
+					for (int c = 0; c < channels; ++c) {
+						float sum = 0.0f;
+						for (int k = -2; k <= 2; ++k) {
+							int sx = pass == 0 ? std::min(std::max(x + k, 0), width - 1) : x;
+							int sy = pass == 1 ? std::min(std::max(y + k, 0), height - 1) : y;
+							sum += kernel[k + 2] * src[((size_t)sy * width + sx) * channels + c];
+						}
+						dst[((size_t)y * width + x) * channels + c] = sum;
+					}
+		}
+	}
+	//Sobel gradient magnitude of the normalized lightness
+	inline float edge(const std::vector<float>& lab, int width, int height, int x, int y) {
+		float l[3][3];
+		for (int j = -1; j <= 1; ++j)
+			for (int i = -1; i <= 1; ++i) {
+				int sx = std::min(std::max(x + i, 0), width - 1);
+				int sy = std::min(std::max(y + j, 0), height - 1);
+				l[j + 1][i + 1] = lab[((size_t)sy * width + sx) * 3] / 100.0f;
+			}
+		float gx = (l[0][2] + 2 * l[1][2] + l[2][2]) - (l[0][0] + 2 * l[1][0] + l[2][0]);
+		float gy = (l[2][0] + 2 * l[2][1] + l[2][2]) - (l[0][0] + 2 * l[0][1] + l[0][2]);
+		return std::sqrt(gx * gx + gy * gy) / 4.0f;
+	}
+}
+
+inline double computePSNR(const unsigned char* a, const unsigned char* b, int width, int height) {
+	double sum = 0.0;
+	size_t count = (size_t)width * height * 3;
+	for (size_t i = 0; i < count; ++i) {
+		double d = (double)a[i] - b[i];
+		sum += d * d;
+	}
+	if (sum == 0.0)
+		return INFINITY;
+	return 10.0 * std::log10(255.0 * 255.0 / (sum / count));
+}
+
+//SSIM of Rec.709 luma over 8x8 windows with a stride of 4
+inline double computeSSIM(const unsigned char* a, const unsigned char* b, int width, int height) {
+	const int WINDOW = 8, STRIDE = 4;
+	const double C1 = (0.01 * 255) * (0.01 * 255), C2 = (0.03 * 255) * (0.03 * 255);
+	std::vector<float> la((size_t)width * height), lb((size_t)width * height);
+	for (size_t i = 0; i < la.size(); ++i) {
+		la[i] = 0.2126f * a[i * 3] + 0.7152f * a[i * 3 + 1] + 0.0722f * a[i * 3 + 2];
+		lb[i] = 0.2126f * b[i * 3] + 0.7152f * b[i * 3 + 1] + 0.0722f * b[i * 3 + 2];
+	}
+	double total = 0.0;
+	int windows = 0;
+	for (int y = 0; y + WINDOW <= height; y += STRIDE)
+		for (int x = 0; x + WINDOW <= width; x += STRIDE) {
+			double sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+			for (int j = 0; j < WINDOW; ++j)
+				for (int i = 0; i < WINDOW; ++i) {
+					size_t index = (size_t)(y + j) * width + x + i;
+					sa += la[index];
+					sb += lb[index];
+					saa += la[index] * la[index];
+					sbb += lb[index] * lb[index];
+					sab += la[index] * lb[index];
+				}
+			double n = WINDOW * WINDOW;
+			double ma = sa / n, mb = sb / n;
+			double va = saa / n - ma * ma, vb = sbb / n - mb * mb, cov = sab / n - ma * mb;
+			total += ((2 * ma * mb + C1) * (2 * cov + C2)) / ((ma * ma + mb * mb + C1) * (va + vb + C2));
+			++windows;
+		}
+	return windows > 0 ? total / windows : 1.0;
+}
+
+/*
+FLIP-style perceptual error per pixel, in [0, 1].
+Like FLIP it combines a color term, computed on images low-passed to mimic the
+eye's contrast sensitivity, with a feature term that boosts the error where edges
+appear or vanish: error = color^(1 - feature). The color term is the CIE76 distance
+in Lab, compressed with FLIP's exponent 0.7; the feature term compares Sobel edge
+strength of the lightness. It is a cheap approximation, not the reference metric.
+*/
+inline void computeFLIP(const unsigned char* a, const unsigned char* b, int width, int height, std::vector<float>& error) {
+	int count = width * height;
+	std::vector<float> labA, labB;
+	metrics_detail::toLab(a, count, labA);
+	metrics_detail::toLab(b, count, labB);
+	std::vector<float> blurA(labA), blurB(labB);
+	metrics_detail::blur(blurA, width, height, 3);
+	metrics_detail::blur(blurB, width, height, 3);
+
+	error.resize(count);
+	for (int y = 0; y < height; ++y)
+		for (int x = 0; x < width; ++x) {
+			size_t i = (size_t)y * width + x;
+			float dl = blurA[i * 3] - blurB[i * 3];
+			float da = blurA[i * 3 + 1] - blurB[i * 3 + 1];
+			float db = blurA[i * 3 + 2] - blurB[i * 3 + 2];
+			float colorError = std::pow(std::min(1.0f, std::sqrt(dl * dl + da * da + db * db) / 100.0f), 0.7f);
+			float edgeA = metrics_detail::edge(labA, width, height, x, y);
+			float edgeB = metrics_detail::edge(labB, width, height, x, y);
+			float featureError = std::sqrt(std::min(1.0f, std::fabs(edgeA - edgeB) / std::sqrt(2.0f)));
+			error[i] = colorError > 0.0f ? std::pow(colorError, 1.0f - featureError) : 0.0f;
+		}
+}
+
+inline ImageDiff compareImages(const unsigned char* image, const unsigned char* reference, int width, int height, std::vector<float>* errorMap = NULL) {
+	ImageDiff diff;
+	diff.psnr = computePSNR(image, reference, width, height);
+	diff.ssim = computeSSIM(image, reference, width, height);
+	std::vector<float> error;
+	computeFLIP(image, reference, width, height, error);
+	double sum = 0.0;
+	diff.maxFlip = 0.0;
+	for (size_t i = 0; i < error.size(); ++i) {
+		sum += error[i];
+		diff.maxFlip = std::max(diff.maxFlip, (double)error[i]);
+	}
+	diff.flip = error.empty() ? 0.0 : sum / error.size();
+	if (errorMap != NULL)
+		errorMap->swap(error);
+	return diff;
+}
+#endif
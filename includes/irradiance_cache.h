@@ -0,0 +1,193 @@
+#ifndef IRRADIANCE_CACHE_H
+#define IRRADIANCE_CACHE_H
+
+#include <glad/glad.h>
+#include<glm/glm.hpp>
+
+#include<utility>
+
+#include "shader.h"
+#include "gpu_memory.h"
+
+/*
+Ward-style irradiance cache for the indirect term.
+The camera pass first writes world position and normal into a G-buffer that shares
+the scene depth, which then serves as the depth pre-pass. Records keep the full RSM
+gather at one surface point together with a validity radius R, the harmonic mean
+distance to the gathered pixel lights. A pixel interpolates every record of its
+screen tile with Ward's weight 1 / (|p - pi| / Ri + sqrt(1 - n.ni)) if that error is
+below the accuracy. Uncovered pixels claim one new record per block, first on a
+coarse then on a fine block grid; pixels still uncovered gather directly.
+Records live in world space and survive to the next frame unless they are too old or
+geometry in front of them moved away, so a slowly moving camera mostly interpolates.
+The G-buffer and the indirect texture only live through a frame; the caller owns them
+and hands them in with setTargets().
+Requires OpenGL 4.3.
+*/
+class IrradianceCache {
+public:
+	static const int TILE_SIZE = 16;
+	static const int MAX_TILE_RECORDS = 64;
+	static const GLuint CAPACITY = 65536;
+	static const int COARSE_BLOCK = 16;
+	static const int FINE_BLOCK = 4;
+
+	float accuracy;			//Ward's a, smaller places more records
+	float minRadius, maxRadius;	//clamp of R in world units
+	float maxAge;			//frames a record is kept
+
+	GLuint fbo;
+	GLuint positionTexture, normalTexture;	//RGBA32F and RGBA16F
+	GLuint indirectTexture;	//RGBA16F interpolated indirect light, read by result_shader
+
+	static bool supported() {
+		return GLAD_GL_VERSION_4_3 != 0;
+	}
+
+	IrradianceCache() : accuracy(0.3f), minRadius(0.05f), maxRadius(1.0f), maxAge(240.0f), fbo(0), positionTexture(0),
+		normalTexture(0), indirectTexture(0), width(0), height(0) {}
+
+	//depth is the scene depth texture the G-buffer pass renders into
+	void init(Shader* shader, GLuint depth, int screenWidth, int screenHeight) {
+		cacheShader = shader;
+		//position, normal and irradiance, three vec4 per record
+		recordBuffers[0] = createBuffer(CAPACITY * 3 * sizeof(glm::vec4));
+		recordBuffers[1] = createBuffer(CAPACITY * 3 * sizeof(glm::vec4));
+		countBuffer = createBuffer(2 * sizeof(GLuint));
+		resize(depth, screenWidth, screenHeight);
+		invalidate();
+	}
+
+	//recreate the framebuffer and tile buffers for a new depth texture, setTargets() must follow
+	//with targets of the new size; the records are in world space and stay valid
+	void resize(GLuint depth, int screenWidth, int screenHeight) {
+		if (fbo != 0) {
+			glDeleteFramebuffers(1, &fbo);
+			GLuint buffers[] = { tileCountBuffer, tileRecordBuffer, claimBuffer };
+			gpuDeleteBuffers(3, buffers);
+		}
+		width = screenWidth;
+		height = screenHeight;
+		tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+		int tileCount = tilesX * ((height + TILE_SIZE - 1) / TILE_SIZE);
+		int blockCount = ((width + FINE_BLOCK - 1) / FINE_BLOCK) * ((height + FINE_BLOCK - 1) / FINE_BLOCK);
+
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+		GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+		glDrawBuffers(2, drawBuffers);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		positionTexture = normalTexture = indirectTexture = 0;
+
+		tileCountBuffer = createBuffer(tileCount * sizeof(GLuint));
+		tileRecordBuffer = createBuffer(tileCount * MAX_TILE_RECORDS * sizeof(GLuint));
+		claimBuffer = createBuffer(blockCount * sizeof(GLuint));
+	}
+
+	//the frame's G-buffer and indirect texture at the screen size, before the G-buffer pass binds fbo;
+	//the framebuffer is only touched when the G-buffer changed
+	void setTargets(GLuint position, GLuint normal, GLuint indirect) {
+		indirectTexture = indirect;
+		if (position == positionTexture && normal == normalTexture)
+			return;
+		positionTexture = position;
+		normalTexture = normal;
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, positionTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTexture, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	//drop every record, e.g. after the light or the RSM settings changed
+	void invalidate() {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	//fill indirectTexture from the G-buffer; RSM and sample textures must be bound and PerFrame set,
+	//the caller issues the texture fetch barrier before indirectTexture is sampled
+	void update(int sampleNum, float sampleRadius, unsigned int frame) {
+		//last frame's new records become this frame's old ones
+		std::swap(recordBuffers[0], recordBuffers[1]);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, countBuffer);
+		glCopyBufferSubData(GL_COPY_WRITE_BUFFER, GL_COPY_WRITE_BUFFER, sizeof(GLuint), 0, sizeof(GLuint));
+		GLuint zero = 0;
+		glBufferSubData(GL_COPY_WRITE_BUFFER, sizeof(GLuint), sizeof(GLuint), &zero);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileCountBuffer);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, recordBuffers[0]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, recordBuffers[1]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, countBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, tileCountBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, tileRecordBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, claimBuffer);
+		glBindImageTexture(0, indirectTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+		glActiveTexture(GL_TEXTURE6);
+		glBindTexture(GL_TEXTURE_2D, positionTexture);
+		glActiveTexture(GL_TEXTURE7);
+		glBindTexture(GL_TEXTURE_2D, normalTexture);
+
+		cacheShader->use();
+		cacheShader->setInt("sample_num", sampleNum);
+		cacheShader->setFloat("sample_radius", sampleRadius);
+		cacheShader->setFloat("accuracy", accuracy);
+		cacheShader->setFloat("min_radius", minRadius);
+		cacheShader->setFloat("max_radius", maxRadius);
+		cacheShader->setFloat("frame", (float)frame);
+		cacheShader->setFloat("max_age", maxAge);
+		glUniform2i(glGetUniformLocation(cacheShader->ID, "screen_size"), width, height);
+		cacheShader->setInt("tile_size", TILE_SIZE);
+		cacheShader->setInt("tiles_x", tilesX);
+		cacheShader->setInt("max_tile_records", MAX_TILE_RECORDS);
+		glUniform1ui(glGetUniformLocation(cacheShader->ID, "capacity"), CAPACITY);
+
+		const GLbitfield barriers = GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+		glMemoryBarrier(barriers | GL_BUFFER_UPDATE_BARRIER_BIT);
+		run(PASS_SPLAT, CAPACITY);
+		int blockSizes[] = { COARSE_BLOCK, FINE_BLOCK };
+		for (int block : blockSizes) {
+			int blocksX = (width + block - 1) / block;
+			int blockCount = blocksX * ((height + block - 1) / block);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, claimBuffer);
+			GLuint unclaimed = 0xFFFFFFFFu;
+			glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, blockCount * sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, &unclaimed);
+			cacheShader->setInt("block_size", block);
+			cacheShader->setInt("blocks_x", blocksX);
+			cacheShader->setInt("fallback", 0);
+			glMemoryBarrier(barriers | GL_BUFFER_UPDATE_BARRIER_BIT);
+			run(PASS_INTERPOLATE, width * height);
+			glMemoryBarrier(barriers);
+			run(PASS_CREATE, blockCount);
+			glMemoryBarrier(barriers);
+		}
+		cacheShader->setInt("fallback", 1);
+		run(PASS_INTERPOLATE, width * height);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+private:
+	enum Pass { PASS_SPLAT, PASS_INTERPOLATE, PASS_CREATE };
+
+	Shader* cacheShader;
+	int width, height, tilesX;
+	GLuint recordBuffers[2];
+	GLuint countBuffer, tileCountBuffer, tileRecordBuffer, claimBuffer;
+
+	void run(Pass pass, GLuint invocations) {
+		cacheShader->setInt("cache_pass", pass);
+		glDispatchCompute((invocations + 63) / 64, 1, 1);
+	}
+
+	static GLuint createBuffer(GLsizeiptr size) {
+		GLuint buffer;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+		gpuBufferData(MEMORY_INDIRECT, GL_SHADER_STORAGE_BUFFER, size, NULL, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		return buffer;
+	}
+};
+#endif
@@ -0,0 +1,216 @@
+#ifndef ISM_H
+#define ISM_H
+
+#include <glad/glad.h>
+#include<glm/glm.hpp>
+
+#include<cmath>
+#include<random>
+#include<vector>
+#include<algorithm>
+
+#include "scene.h"
+#include "shader.h"
+#include "thread_pool.h"
+#include "gpu_memory.h"
+
+/*
+Imperfect shadow maps (Ritschel et al. 2008) for the visibility of the gather's pixel lights.
+The RSM is split into VPL_GRID x VPL_GRID cells and the texel at the center of a cell is
+its VPL. The scene is approximated once by points spread over the triangles by area;
+VPL i splats its own block of POINTS_PER_VPL points into a TILE x TILE paraboloid map
+around its normal, all VPLs in one point draw, so the cost depends on the point count and
+not on the geometry. A gather sample counts only if the receiver is not behind the map of
+the VPL of its cell. Maps hold the distance to the VPL divided by far; the outermost texel
+of a tile stays empty so splats do not reach the neighbours.
+A texel covers several degrees, so surfaces seen at grazing angles span a large depth
+range within it; the bias is therefore a fraction of the receiver's distance.
+A sample is tested against a VPL up to half a cell away, so a fine grid matters more than
+dense maps: sparse blocks leave holes, which let light through like no test would, while
+a distant VPL wrongly shadows samples whose view differs from its own.
+*/
+class ImperfectShadowMaps {
+public:
+	static const int VPL_GRID = 32;
+	static const int VPL_COUNT = VPL_GRID * VPL_GRID;
+	static const int TILE = 32;
+	static const int ATLAS = VPL_GRID * TILE;
+	static const int POINTS_PER_VPL = 512;
+	static const int POINT_SIZE = 1;		//larger splats fill holes but widen thin occluders over whole texels
+	static constexpr float SAME_SURFACE = 0.9f;	//cosine between a sample's and its VPL's normal
+	static constexpr float RECEIVER_OFFSET = 0.05f;	//along the receiver's normal, against self-shadowing
+
+	float far;							//largest distance in the scene
+	std::vector<glm::vec3> points;		//block i belongs to VPL i
+	GLuint fbo, depthTexture;			//ATLAS x ATLAS, read by result_shader
+
+	ImperfectShadowMaps() : far(1.0f), fbo(0), depthTexture(0), splatShader(NULL), vao(0), vbo(0) {}
+
+	//sample the points, the objects must not move afterwards
+	void init(const Scene& scene) {
+		const SceneGeometry& geometry = scene.geometry;
+		std::vector<glm::vec3> corners;
+		std::vector<float> area;	//running sum over the triangles
+		AABB bounds;
+		for (size_t o = 0; o < scene.objects.size(); ++o) {
+			const SceneObject& object = scene.objects[o];
+			const Mesh& mesh = geometry.meshes[object.mesh];
+			bounds.grow(object.bounds);
+			for (GLsizei i = 0; i < mesh.indexCount; i += 3) {
+				glm::vec3 p[3];
+				for (int k = 0; k < 3; ++k) {
+					const float* vertex = &geometry.vertices[(mesh.baseVertex + geometry.indices[mesh.firstIndex + i + k]) * SceneGeometry::VERTEX_STRIDE];
+					p[k] = glm::vec3(object.model * glm::vec4(vertex[0], vertex[1], vertex[2], 1.0f));
+					corners.push_back(p[k]);
+				}
+				float a = 0.5f * glm::length(glm::cross(p[1] - p[0], p[2] - p[0]));
+				area.push_back((area.empty() ? 0.0f : area.back()) + a);
+			}
+		}
+		far = glm::length(bounds.max - bounds.min);
+
+		//every point picks its triangle independently, so any block is a random subset
+		std::default_random_engine eng;
+		std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+		eng.seed(1);
+		points.resize((size_t)VPL_COUNT * POINTS_PER_VPL);
+		for (size_t i = 0; i < points.size(); ++i) {
+			float pick = dist(eng) * area.back();
+			size_t t = std::min((size_t)(std::upper_bound(area.begin(), area.end(), pick) - area.begin()), area.size() - 1);
+			float r1 = std::sqrt(dist(eng)), r2 = dist(eng);
+			const glm::vec3* p = &corners[t * 3];
+			points[i] = p[0] * (1.0f - r1) + p[1] * (r1 * (1.0f - r2)) + p[2] * (r1 * r2);
+		}
+	}
+
+	void upload(Shader* shader) {
+		splatShader = shader;
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &vbo);
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		gpuBufferData(MEMORY_INDIRECT, GL_ARRAY_BUFFER, points.size() * sizeof(glm::vec3), points.data(), GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+		glEnableVertexAttribArray(0);
+		glBindVertexArray(0);
+
+		glGenTextures(1, &depthTexture);
+		glBindTexture(GL_TEXTURE_2D, depthTexture);
+		gpuTexImage2D(MEMORY_INDIRECT, GL_DEPTH_COMPONENT32F, ATLAS, ATLAS, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		splatShader->use();
+		splatShader->setInt("normalMap", 1);
+		splatShader->setInt("worldPosMap", 2);
+		splatShader->setInt("ism_grid", VPL_GRID);
+		splatShader->setInt("ism_tile", TILE);
+		splatShader->setInt("ism_points", POINTS_PER_VPL);
+		splatShader->setFloat("ism_far", far);
+	}
+
+	//splat the maps of the current RSM, which must be bound to units 1 and 2; leaves the viewport to the caller
+	void render() {
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glViewport(0, 0, ATLAS, ATLAS);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		glPointSize((float)POINT_SIZE);
+		splatShader->use();
+		glBindVertexArray(vao);
+		glDrawArrays(GL_POINTS, 0, (GLsizei)points.size());
+		glBindVertexArray(0);
+	}
+
+	//CPU splat of the maps from an RSM, rows bottom to top
+	void splat(ThreadPool& pool, const std::vector<glm::vec3>& normals, const std::vector<glm::vec3>& positions, int rsmWidth, int rsmHeight) {
+		depth.assign((size_t)ATLAS * ATLAS, 1.0f);
+		frames.resize(VPL_COUNT);
+		//every VPL writes its own tile only
+		pool.parallelFor(VPL_COUNT, [&](int vpl) {
+			Frame& frame = frames[vpl];
+			int texel = vplTexel(vpl, rsmWidth, rsmHeight);
+			frame.valid = glm::dot(normals[texel], normals[texel]) >= 0.25f;
+			if (!frame.valid)
+				return;
+			frame.set(positions[texel], glm::normalize(normals[texel]));
+			glm::ivec2 tile(vpl % VPL_GRID * TILE, vpl / VPL_GRID * TILE);
+			const glm::vec3* block = &points[(size_t)vpl * POINTS_PER_VPL];
+			for (int i = 0; i < POINTS_PER_VPL; ++i) {
+				glm::vec2 coord;
+				float distance;
+				if (!frame.project(block[i], tile, coord, distance))
+					continue;
+				float d = distance / far;
+				//pixel centers inside the square of a GL point
+				int x0 = (int)std::ceil(coord.x - 0.5f * POINT_SIZE - 0.5f), y0 = (int)std::ceil(coord.y - 0.5f * POINT_SIZE - 0.5f);
+				for (int y = std::max(y0, tile.y); y < std::min(y0 + POINT_SIZE, tile.y + TILE); ++y)
+					for (int x = std::max(x0, tile.x); x < std::min(x0 + POINT_SIZE, tile.x + TILE); ++x) {
+						float& stored = depth[(size_t)y * ATLAS + x];
+						stored = std::min(stored, d);
+					}
+			}
+		});
+	}
+
+	//CPU lookup after splat(), like ismVisibility in result_shader; samples outside the RSM
+	//and samples on another surface than their cell's VPL are not represented and count as visible
+	bool visible(const glm::vec3& receiver, const glm::vec3& sampleNormal, float u, float v, float bias) const {
+		if (!(u >= 0.0f && u < 1.0f && v >= 0.0f && v < 1.0f))
+			return true;
+		glm::ivec2 cell = glm::min(glm::ivec2((int)(u * VPL_GRID), (int)(v * VPL_GRID)), glm::ivec2(VPL_GRID - 1));
+		const Frame& frame = frames[cell.y * VPL_GRID + cell.x];
+		glm::vec2 coord;
+		float distance;
+		if (!frame.valid || glm::dot(frame.n, sampleNormal) < SAME_SURFACE * glm::length(sampleNormal)
+			|| !frame.project(receiver, cell * TILE, coord, distance))
+			return true;
+		glm::ivec2 texel(coord);
+		return distance * (1.0f - bias) <= depth[(size_t)texel.y * ATLAS + texel.x] * far;
+	}
+
+	//RSM texel of a VPL, the center of its cell
+	static int vplTexel(int vpl, int rsmWidth, int rsmHeight) {
+		int x = vpl % VPL_GRID * rsmWidth / VPL_GRID + rsmWidth / (2 * VPL_GRID);
+		int y = vpl / VPL_GRID * rsmHeight / VPL_GRID + rsmHeight / (2 * VPL_GRID);
+		return y * rsmWidth + x;
+	}
+
+private:
+	//paraboloid around a VPL's normal
+	struct Frame {
+		glm::vec3 origin, t, b, n;
+		bool valid;
+
+		void set(const glm::vec3& position, const glm::vec3& normal) {
+			origin = position;
+			n = normal;
+			t = glm::normalize(glm::cross(std::abs(n.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f), n));
+			b = glm::cross(n, t);
+		}
+		//atlas coordinate in pixels and distance of p, false behind the VPL
+		bool project(const glm::vec3& p, const glm::ivec2& tile, glm::vec2& coord, float& distance) const {
+			glm::vec3 d = p - origin;
+			distance = glm::length(d);
+			if (distance <= 1e-4f)
+				return false;
+			glm::vec3 local = glm::vec3(glm::dot(d, t), glm::dot(d, b), glm::dot(d, n)) / distance;
+			if (local.z <= 0.0f)
+				return false;
+			glm::vec2 uv = glm::vec2(local) / (1.0f + local.z);
+			coord = glm::vec2(tile + 1) + (uv * 0.5f + 0.5f) * (float)(TILE - 2);
+			return true;
+		}
+	};
+
+	Shader* splatShader;
+	GLuint vao, vbo;
+	std::vector<float> depth;	//CPU maps, rows bottom to top
+	std::vector<Frame> frames;
+};
+#endif
@@ -0,0 +1,276 @@
+#ifndef LIGHTMAP_H
+#define LIGHTMAP_H
+
+#include <glad/glad.h>
+#include<glm/glm.hpp>
+
+#include<map>
+#include<array>
+#include<cmath>
+#include<string>
+#include<vector>
+#include<iostream>
+#include<functional>
+#include<algorithm>
+
+#include "scene.h"
+#include "image_io.h"
+#include "gpu_memory.h"
+
+/*
+Lightmap of the indirect term for static geometry and a fixed light.
+Every mesh is unwrapped into planar charts, connected triangles with the same face
+normal projected onto their plane at DENSITY texels per unit, packed on a sheet of
+its own. Every object then gets a rectangle of the atlas the size of its mesh's sheet,
+so instances of a mesh share the UVs and differ in the scale and offset of their
+per-draw data. Charts keep PADDING texels of margin that dilate() fills, so bilinear
+lookups at chart borders never reach empty texels.
+Meshes are unwrapped in their own space, so objects must not be scaled.
+*/
+class Lightmap {
+public:
+	static const int DENSITY = 16;			//texels per world unit
+	static const int ATLAS_WIDTH = 512;
+	static const int PADDING = 2;
+
+	int width, height;
+	std::vector<glm::vec3> texels;	//rows bottom to top
+	GLuint texture;
+
+	Lightmap() : width(0), height(0), texture(0) {}
+
+	//fill geometry.lightmapUVs, must run before the geometry is uploaded
+	bool unwrap(SceneGeometry& geometry) {
+		size_t vertexCount = geometry.vertices.size() / SceneGeometry::VERTEX_STRIDE;
+		geometry.lightmapUVs.assign(vertexCount * 2, 0.0f);
+		std::vector<int> owner(vertexCount, -1);	//chart of each vertex
+		sheets.clear();
+		for (size_t m = 0; m < geometry.meshes.size(); ++m) {
+			const Mesh& mesh = geometry.meshes[m];
+			std::vector<Chart> charts = findCharts(geometry, mesh);
+			//shelf packing, tallest chart first
+			std::vector<int> order(charts.size());
+			float area = 0.0f;
+			int widest = 0;
+			for (size_t c = 0; c < charts.size(); ++c) {
+				order[c] = (int)c;
+				area += (float)charts[c].size.x * charts[c].size.y;
+				widest = std::max(widest, charts[c].size.x);
+			}
+			std::sort(order.begin(), order.end(), [&](int a, int b) { return charts[a].size.y > charts[b].size.y; });
+			int sheetWidth = std::max(widest, (int)std::ceil(std::sqrt(area)));
+			glm::ivec2 cursor(0), sheet(0);
+			int shelf = 0;
+			for (size_t i = 0; i < order.size(); ++i) {
+				Chart& chart = charts[order[i]];
+				if (cursor.x + chart.size.x > sheetWidth) {
+					cursor = glm::ivec2(0, cursor.y + shelf);
+					shelf = 0;
+				}
+				chart.origin = cursor;
+				cursor.x += chart.size.x;
+				shelf = std::max(shelf, chart.size.y);
+				sheet = glm::max(sheet, cursor + glm::ivec2(0, shelf));
+			}
+			sheets.push_back(sheet);
+
+			for (size_t c = 0; c < charts.size(); ++c) {
+				const Chart& chart = charts[c];
+				for (size_t t = 0; t < chart.triangles.size(); ++t)
+					for (int k = 0; k < 3; ++k) {
+						int vertex = mesh.baseVertex + geometry.indices[mesh.firstIndex + chart.triangles[t] * 3 + k];
+						if (owner[vertex] >= 0 && owner[vertex] != (int)(m * 65536 + c)) {
+							std::cout << "ERROR::LIGHTMAP::VERTEX_SHARED_BY_CHARTS mesh " << m << "\n";
+							return false;
+						}
+						owner[vertex] = (int)(m * 65536 + c);
+						glm::vec2 p = chart.project(position(geometry, vertex)) * (float)DENSITY
+							+ glm::vec2(chart.origin + PADDING);
+						geometry.lightmapUVs[vertex * 2] = p.x / sheet.x;
+						geometry.lightmapUVs[vertex * 2 + 1] = p.y / sheet.y;
+					}
+			}
+		}
+		return true;
+	}
+
+	//give every object its atlas rectangle, after unwrap() and once all objects are added
+	void pack(Scene& scene) {
+		std::vector<int> order(scene.objects.size());
+		for (size_t i = 0; i < order.size(); ++i)
+			order[i] = (int)i;
+		std::sort(order.begin(), order.end(), [&](int a, int b) {
+			return sheets[scene.objects[a].mesh].y > sheets[scene.objects[b].mesh].y;
+		});
+		std::vector<glm::ivec2> origins(scene.objects.size());
+		glm::ivec2 cursor(0);
+		int shelf = 0;
+		width = ATLAS_WIDTH;
+		height = 0;
+		for (size_t i = 0; i < order.size(); ++i) {
+			glm::ivec2 sheet = sheets[scene.objects[order[i]].mesh];
+			if (cursor.x + sheet.x > width) {
+				cursor = glm::ivec2(0, cursor.y + shelf);
+				shelf = 0;
+			}
+			origins[order[i]] = cursor;
+			cursor.x += sheet.x;
+			shelf = std::max(shelf, sheet.y);
+			height = std::max(height, cursor.y + shelf);
+		}
+		for (size_t i = 0; i < scene.objects.size(); ++i) {
+			glm::vec2 sheet(sheets[scene.objects[i].mesh]);
+			scene.objects[i].lightmap = glm::vec4(sheet.x / width, sheet.y / height,
+				(float)origins[i].x / width, (float)origins[i].y / height);
+		}
+		texels.assign((size_t)width * height, glm::vec3(0.0f));
+	}
+
+	//grow the baked texels into the empty ones around them, covered marks the baked texels
+	void dilate(std::vector<bool>& covered) {
+		for (int step = 0; step < PADDING; ++step) {
+			std::vector<bool> next(covered);
+			for (int y = 0; y < height; ++y)
+				for (int x = 0; x < width; ++x) {
+					if (covered[(size_t)y * width + x])
+						continue;
+					glm::vec3 sum(0.0f);
+					int count = 0;
+					for (int dy = -1; dy <= 1; ++dy)
+						for (int dx = -1; dx <= 1; ++dx) {
+							int nx = x + dx, ny = y + dy;
+							if (nx < 0 || ny < 0 || nx >= width || ny >= height || !covered[(size_t)ny * width + nx])
+								continue;
+							sum += texels[(size_t)ny * width + nx];
+							++count;
+						}
+					if (count > 0) {
+						texels[(size_t)y * width + x] = sum / (float)count;
+						next[(size_t)y * width + x] = true;
+					}
+				}
+			covered.swap(next);
+		}
+	}
+
+	bool save(const std::string& path) const {
+		return writePFM(path, &texels[0].x, width, height);
+	}
+	//the file must match the layout of pack()
+	bool load(const std::string& path) {
+		std::vector<float> pixels;
+		int fileWidth, fileHeight;
+		if (!readPFM(path, pixels, fileWidth, fileHeight)) {
+			std::cout << "ERROR::LIGHTMAP::READ_FAILED " << path << "\n";
+			return false;
+		}
+		if (fileWidth != width || fileHeight != height) {
+			std::cout << "ERROR::LIGHTMAP::SIZE_MISMATCH " << path << "\n";
+			return false;
+		}
+		for (size_t i = 0; i < texels.size(); ++i)
+			texels[i] = glm::vec3(pixels[i * 3], pixels[i * 3 + 1], pixels[i * 3 + 2]);
+		return true;
+	}
+
+	void upload() {
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		gpuTexImage2D(MEMORY_INDIRECT, GL_RGB16F, width, height, GL_RGB, GL_FLOAT, texels.data());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+
+	//bilinear like the GL texture
+	glm::vec3 sample(const glm::vec2& uv) const {
+		glm::vec2 p = uv * glm::vec2(width, height) - 0.5f;
+		glm::vec2 base = glm::floor(p);
+		glm::vec2 f = p - base;
+		glm::vec3 result(0.0f);
+		for (int corner = 0; corner < 4; ++corner) {
+			int x = glm::clamp((int)base.x + (corner & 1), 0, width - 1);
+			int y = glm::clamp((int)base.y + (corner >> 1), 0, height - 1);
+			float w = ((corner & 1) ? f.x : 1.0f - f.x) * ((corner >> 1) ? f.y : 1.0f - f.y);
+			result += w * texels[(size_t)y * width + x];
+		}
+		return result;
+	}
+
+private:
+	struct Chart {
+		std::vector<int> triangles;	//within the mesh
+		glm::vec3 normal, u, v;
+		glm::vec2 min;				//of the projected vertices
+		glm::ivec2 size;			//texels, padding included
+		glm::ivec2 origin;			//on the mesh's sheet
+
+		glm::vec2 project(const glm::vec3& p) const {
+			return glm::vec2(glm::dot(p, u), glm::dot(p, v)) - min;
+		}
+	};
+	std::vector<glm::ivec2> sheets;	//texel size of each mesh's charts
+
+	static glm::vec3 position(const SceneGeometry& geometry, int vertex) {
+		const float* data = &geometry.vertices[(size_t)vertex * SceneGeometry::VERTEX_STRIDE];
+		return glm::vec3(data[0], data[1], data[2]);
+	}
+
+	//connected triangles sharing a face normal, found by merging over shared vertex positions
+	static std::vector<Chart> findCharts(const SceneGeometry& geometry, const Mesh& mesh) {
+		int count = mesh.indexCount / 3;
+		std::vector<glm::vec3> normals(count);
+		std::vector<int> parent(count);
+		std::map<std::array<float, 3>, std::vector<int> > corners;
+		for (int t = 0; t < count; ++t) {
+			glm::vec3 p[3];
+			for (int k = 0; k < 3; ++k) {
+				p[k] = position(geometry, mesh.baseVertex + geometry.indices[mesh.firstIndex + t * 3 + k]);
+				std::array<float, 3> key = { { p[k].x, p[k].y, p[k].z } };
+				corners[key].push_back(t);
+			}
+			normals[t] = glm::normalize(glm::cross(p[1] - p[0], p[2] - p[0]));
+			parent[t] = t;
+		}
+		std::function<int(int)> root = [&](int t) { return parent[t] == t ? t : parent[t] = root(parent[t]); };
+		for (std::map<std::array<float, 3>, std::vector<int> >::const_iterator it = corners.begin(); it != corners.end(); ++it)
+			for (size_t i = 1; i < it->second.size(); ++i)
+				for (size_t j = 0; j < i; ++j) {
+					int a = it->second[i], b = it->second[j];
+					if (glm::dot(normals[a], normals[b]) > 0.999f)
+						parent[root(a)] = root(b);
+				}
+
+		std::vector<Chart> charts;
+		std::vector<int> chartOf(count, -1);
+		for (int t = 0; t < count; ++t) {
+			int r = root(t);
+			if (chartOf[r] < 0) {
+				chartOf[r] = (int)charts.size();
+				Chart chart;
+				chart.normal = normals[r];
+				glm::vec3 axis = std::abs(chart.normal.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+				chart.u = glm::normalize(glm::cross(axis, chart.normal));
+				chart.v = glm::cross(chart.normal, chart.u);
+				chart.min = glm::vec2(0.0f);
+				charts.push_back(chart);
+			}
+			charts[chartOf[r]].triangles.push_back(t);
+		}
+		for (size_t c = 0; c < charts.size(); ++c) {
+			Chart& chart = charts[c];
+			glm::vec2 lo(1e30f), hi(-1e30f);
+			for (size_t t = 0; t < chart.triangles.size(); ++t)
+				for (int k = 0; k < 3; ++k) {
+					glm::vec2 p = chart.project(position(geometry, mesh.baseVertex + geometry.indices[mesh.firstIndex + chart.triangles[t] * 3 + k]));
+					lo = glm::min(lo, p);
+					hi = glm::max(hi, p);
+				}
+			chart.min = lo;
+			chart.size = glm::ivec2(glm::ceil((hi - lo) * (float)DENSITY)) + 2 * PADDING;
+		}
+		return charts;
+	}
+};
+#endif
@@ -0,0 +1,317 @@
+#ifndef LPV_H
+#define LPV_H
+
+#include <glad/glad.h>
+#include<glm/glm.hpp>
+
+#include<cmath>
+#include<vector>
+#include<algorithm>
+
+#include "scene.h"
+#include "shader.h"
+#include "thread_pool.h"
+#include "gpu_memory.h"
+
+//two band spherical harmonics, the convention of the LPV shaders
+namespace sh {
+	const float C0 = 0.282094792f, C1 = 0.488602512f;
+	//projection of a clamped cosine lobe around a direction
+	const float COS_C0 = 0.886226925f, COS_C1 = 1.02332671f;
+
+	inline glm::vec4 basis(const glm::vec3& d) {
+		return glm::vec4(C0, -C1 * d.y, C1 * d.z, -C1 * d.x);
+	}
+	inline glm::vec4 cosineLobe(const glm::vec3& d) {
+		return glm::vec4(COS_C0, -COS_C1 * d.y, COS_C1 * d.z, -COS_C1 * d.x);
+	}
+}
+
+//cubic cells over the scene, shared by the GL volume and the CPU renderer
+struct LpvLayout {
+	static const int GRID = 32;
+	static const int INJECT_SIZE = 128;		//VPLs per RSM side
+	//solid angles of the faces of a cell seen from the center of its neighbour, over PI
+	static constexpr float DIRECT_FACE = 0.4006696846f / 3.14159265f;
+	static constexpr float SIDE_FACE = 0.4234413544f / 3.14159265f;
+
+	glm::vec3 origin;
+	float cellSize;
+
+	LpvLayout() : origin(0.0f), cellSize(1.0f) {}
+
+	//the volume covers the scene with a cell of margin
+	static LpvLayout fit(const Scene& scene) {
+		AABB bounds;
+		for (size_t i = 0; i < scene.objects.size(); ++i)
+			bounds.grow(scene.objects[i].bounds);
+		LpvLayout layout;
+		glm::vec3 extent = bounds.max - bounds.min;
+		layout.cellSize = std::max(extent.x, std::max(extent.y, extent.z)) / (GRID - 2);
+		layout.origin = bounds.center() - glm::vec3(layout.cellSize * GRID * 0.5f);
+		return layout;
+	}
+};
+
+/*
+Light propagation volume on the CPU (Kaplanyan and Dachsbacher 2010), the reference of
+the GL one. RSM texels are injected as VPLs: the clamped cosine lobe of their normal,
+scaled by their flux, is added to the cell half a cell in front of them. Each
+propagation step moves the intensity of every cell to its six neighbours through the
+five faces they can see and adds the result to the accumulated volume. There is no
+geometry volume, so propagated light is not occluded.
+*/
+class LpvVolume {
+public:
+	LpvLayout layout;
+
+	void build(ThreadPool& pool, const LpvLayout& volumeLayout, int iterations, const std::vector<glm::vec3>& normals,
+		const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& flux, int rsmWidth, int rsmHeight) {
+		const int G = LpvLayout::GRID;
+		layout = volumeLayout;
+		size_t cells = (size_t)G * G * G;
+		std::vector<glm::vec4> current[3], next[3];
+		for (int c = 0; c < 3; ++c) {
+			current[c].assign(cells, glm::vec4(0.0f));
+			next[c].assign(cells, glm::vec4(0.0f));
+			accumulated[c].assign(cells, glm::vec4(0.0f));
+		}
+
+		//injection, in the same order as the GL points so the sums match
+		const int S = LpvLayout::INJECT_SIZE;
+		float weight = injectWeight();
+		for (int i = 0; i < S * S; ++i) {
+			int texel = (i / S) * rsmHeight / S * rsmWidth + (i % S) * rsmWidth / S;
+			if (flux[texel] == glm::vec3(0.0f))
+				continue;
+			glm::ivec3 cell;
+			if (!cellOf(positions[texel] + glm::normalize(normals[texel]) * (0.5f * layout.cellSize), cell))
+				continue;
+			glm::vec4 lobe = sh::cosineLobe(glm::normalize(normals[texel])) * weight;
+			size_t index = this->index(cell);
+			for (int c = 0; c < 3; ++c)
+				current[c][index] += lobe * flux[texel][c];
+		}
+
+		for (int step = 0; step < iterations; ++step) {
+			pool.parallelFor(G, [&](int z) {
+				for (int y = 0; y < G; ++y)
+					for (int x = 0; x < G; ++x) {
+						glm::vec4 gathered[3];
+						propagate(current, glm::ivec3(x, y, z), gathered);
+						size_t i = index(glm::ivec3(x, y, z));
+						for (int c = 0; c < 3; ++c) {
+							next[c][i] = gathered[c];
+							accumulated[c][i] += gathered[c];
+						}
+					}
+			});
+			for (int c = 0; c < 3; ++c)
+				current[c].swap(next[c]);
+		}
+	}
+
+	//irradiance arriving at a surface, trilinear like the GL lookup
+	glm::vec3 irradiance(const glm::vec3& position, const glm::vec3& normal) const {
+		const int G = LpvLayout::GRID;
+		glm::vec3 n = glm::normalize(normal);
+		glm::vec3 p = (position + n * (0.5f * layout.cellSize) - layout.origin) / layout.cellSize - 0.5f;
+		glm::vec3 base = glm::floor(p);
+		glm::vec3 f = p - base;
+		glm::vec4 coefficients[3] = { glm::vec4(0.0f), glm::vec4(0.0f), glm::vec4(0.0f) };
+		for (int corner = 0; corner < 8; ++corner) {
+			glm::ivec3 offset(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1);
+			glm::ivec3 cell = glm::clamp(glm::ivec3(base) + offset, glm::ivec3(0), glm::ivec3(G - 1));
+			float w = (offset.x ? f.x : 1.0f - f.x) * (offset.y ? f.y : 1.0f - f.y) * (offset.z ? f.z : 1.0f - f.z);
+			for (int c = 0; c < 3; ++c)
+				coefficients[c] += accumulated[c][index(cell)] * w;
+		}
+		glm::vec4 lobe = sh::cosineLobe(-n);
+		return glm::max(glm::vec3(glm::dot(coefficients[0], lobe), glm::dot(coefficients[1], lobe), glm::dot(coefficients[2], lobe)),
+			glm::vec3(0.0f)) / 3.14159265f;
+	}
+
+	//flux scale of one VPL, keeps the result independent of INJECT_SIZE
+	static float injectWeight() {
+		return 4096.0f / (LpvLayout::INJECT_SIZE * LpvLayout::INJECT_SIZE);
+	}
+
+private:
+	std::vector<glm::vec4> accumulated[3];
+
+	static size_t index(const glm::ivec3& cell) {
+		return ((size_t)cell.z * LpvLayout::GRID + cell.y) * LpvLayout::GRID + cell.x;
+	}
+	bool cellOf(const glm::vec3& p, glm::ivec3& cell) const {
+		glm::vec3 f = glm::floor((p - layout.origin) / layout.cellSize);
+		cell = glm::ivec3(f);
+		return glm::all(glm::greaterThanEqual(cell, glm::ivec3(0))) && glm::all(glm::lessThan(cell, glm::ivec3(LpvLayout::GRID)));
+	}
+
+	//intensity flowing into a cell from its six neighbours
+	static void propagate(const std::vector<glm::vec4>* source, const glm::ivec3& cell, glm::vec4* gathered) {
+		static const glm::ivec3 AXES[6] = { glm::ivec3(1, 0, 0), glm::ivec3(-1, 0, 0), glm::ivec3(0, 1, 0),
+			glm::ivec3(0, -1, 0), glm::ivec3(0, 0, 1), glm::ivec3(0, 0, -1) };
+		for (int c = 0; c < 3; ++c)
+			gathered[c] = glm::vec4(0.0f);
+		for (int m = 0; m < 6; ++m) {
+			glm::ivec3 neighbour = cell - AXES[m];
+			if (glm::any(glm::lessThan(neighbour, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(neighbour, glm::ivec3(LpvLayout::GRID))))
+				continue;
+			size_t i = index(neighbour);
+			glm::vec3 main = glm::vec3(AXES[m]);
+			//the face opposite the neighbour
+			glm::vec4 evaluate = sh::basis(main);
+			glm::vec4 reproject = sh::cosineLobe(main);
+			for (int c = 0; c < 3; ++c)
+				gathered[c] += LpvLayout::DIRECT_FACE * std::max(glm::dot(source[c][i], evaluate), 0.0f) * reproject;
+			//the four side faces, light passes them towards the side
+			for (int s = 0; s < 6; ++s) {
+				if (s / 2 == m / 2)
+					continue;
+				glm::vec3 side = glm::vec3(AXES[s]);
+				evaluate = sh::basis(main * 0.894427191f + side * 0.447213595f);
+				reproject = sh::cosineLobe(side);
+				for (int c = 0; c < 3; ++c)
+					gathered[c] += LpvLayout::SIDE_FACE * std::max(glm::dot(source[c][i], evaluate), 0.0f) * reproject;
+			}
+		}
+	}
+};
+
+/*
+The GL light propagation volume, one RGBA16F 3D texture per color channel holding the
+four SH coefficients. Layers are rendered one at a time through
+glFramebufferTextureLayer, so GL 3.3 suffices: injection draws every VPL as a point
+per layer and the vertex shader drops the points of other layers, propagation draws
+a full-screen triangle per layer that gathers from the six neighbours.
+*/
+class LightPropagationVolume {
+public:
+	//texture units of the propagation source, the accumulated volume is bound by the caller
+	static const int SOURCE_UNIT = 12;
+
+	LpvLayout layout;
+	GLuint accumulated[3];	//read by result_shader
+
+	LightPropagationVolume() : injectShader(NULL), propagateShader(NULL), fbo(0), vao(0) {}
+
+	void init(Shader* inject, Shader* propagate, const LpvLayout& volumeLayout) {
+		injectShader = inject;
+		propagateShader = propagate;
+		layout = volumeLayout;
+		for (int c = 0; c < 3; ++c) {
+			volumes[0][c] = createTexture();
+			volumes[1][c] = createTexture();
+			accumulated[c] = createTexture();
+		}
+		glGenFramebuffers(1, &fbo);
+		//attribute-less draws still need a vertex array in the core profile
+		glGenVertexArrays(1, &vao);
+
+		injectShader->use();
+		injectShader->setInt("normalMap", 1);
+		injectShader->setInt("worldPosMap", 2);
+		injectShader->setInt("fluxMap", 3);
+		injectShader->setInt("inject_size", LpvLayout::INJECT_SIZE);
+		injectShader->setInt("lpv_grid", LpvLayout::GRID);
+		injectShader->setVec3("lpv_min", layout.origin);
+		injectShader->setFloat("lpv_cell_size", layout.cellSize);
+		injectShader->setFloat("inject_weight", LpvVolume::injectWeight());
+		propagateShader->use();
+		propagateShader->setInt("lpvRed", SOURCE_UNIT);
+		propagateShader->setInt("lpvGreen", SOURCE_UNIT + 1);
+		propagateShader->setInt("lpvBlue", SOURCE_UNIT + 2);
+		propagateShader->setInt("lpv_grid", LpvLayout::GRID);
+		propagateShader->setFloat("direct_face", LpvLayout::DIRECT_FACE);
+		propagateShader->setFloat("side_face", LpvLayout::SIDE_FACE);
+	}
+
+	//rebuild from the RSM, which must be bound to units 1-3; leaves the viewport to the caller
+	void update(int iterations) {
+		const int G = LpvLayout::GRID;
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glBindVertexArray(vao);
+		glViewport(0, 0, G, G);
+		glDisable(GL_DEPTH_TEST);
+		glDepthMask(GL_FALSE);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE);
+
+		//a layered attachment clears every layer at once
+		GLfloat empty[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		attach(volumes[0], accumulated, -1);
+		for (int i = 0; i < 6; ++i)
+			glClearBufferfv(GL_COLOR, i, empty);
+
+		injectShader->use();
+		for (int z = 0; z < G; ++z) {
+			attach(volumes[0], NULL, z);
+			injectShader->setInt("layer", z);
+			glDrawArrays(GL_POINTS, 0, LpvLayout::INJECT_SIZE * LpvLayout::INJECT_SIZE);
+		}
+
+		//the next volume is overwritten, the accumulated one summed
+		propagateShader->use();
+		for (int i = 0; i < 3; ++i)
+			glDisablei(GL_BLEND, i);
+		for (int step = 0; step < iterations; ++step) {
+			GLuint* source = volumes[step % 2];
+			GLuint* target = volumes[(step + 1) % 2];
+			for (int c = 0; c < 3; ++c) {
+				glActiveTexture(GL_TEXTURE0 + SOURCE_UNIT + c);
+				glBindTexture(GL_TEXTURE_3D, source[c]);
+			}
+			for (int z = 0; z < G; ++z) {
+				attach(target, accumulated, z);
+				propagateShader->setInt("layer", z);
+				glDrawArrays(GL_TRIANGLES, 0, 3);
+			}
+		}
+
+		glDisable(GL_BLEND);
+		glDepthMask(GL_TRUE);
+		glEnable(GL_DEPTH_TEST);
+		glBindVertexArray(0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+private:
+	Shader* injectShader;
+	Shader* propagateShader;
+	GLuint volumes[2][3];	//propagation ping-pong
+	GLuint fbo, vao;
+
+	//one layer of up to two volumes as color attachments 0-2 and 3-5, layer -1 attaches all layers
+	void attach(const GLuint* first, const GLuint* second, int layer) const {
+		GLenum drawBuffers[6];
+		int count = second == NULL ? 3 : 6;
+		for (int i = 0; i < count; ++i) {
+			GLuint texture = i < 3 ? first[i] : second[i - 3];
+			if (layer < 0)
+				glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, texture, 0);
+			else
+				glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, texture, 0, layer);
+			drawBuffers[i] = GL_COLOR_ATTACHMENT0 + i;
+		}
+		for (int i = count; i < 6; ++i)
+			glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, 0, 0);
+		glDrawBuffers(count, drawBuffers);
+	}
+
+	static GLuint createTexture() {
+		const int G = LpvLayout::GRID;
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_3D, texture);
+		gpuTexImage3D(MEMORY_INDIRECT, GL_RGBA16F, G, G, G, GL_RGBA, GL_FLOAT, NULL);
+		//trilinear lookup, cells outside the volume repeat the border ones
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		return texture;
+	}
+};
+#endif
@@ -0,0 +1,250 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <glad/glad.h>
+#include<glm/glm.hpp>
+
+#include<vector>
+#include<algorithm>
+#include<cmath>
+
+#include "scene.h"
+#include "shader.h"
+#include "gpu_memory.h"
+
+//Per object record read by the cull shader and the GPU-driven vertex shaders (std430)
+struct GpuObject {
+	glm::mat4 model;
+	glm::vec4 diffuse;
+	glm::vec4 boundsMin;
+	glm::vec4 boundsMax;
+	GLuint indexCount;
+	GLuint firstIndex;
+	GLuint baseVertex;
+	GLuint pad;
+	glm::vec4 lightmap;
+};
+
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+/*
+Two phase occlusion culling for one view.
+Phase 0 draws the candidates that were visible last frame, then a Hi-Z pyramid is
+built from the resulting depth. Phase 1 tests every candidate against the pyramid and
+draws the ones that became visible. Both phases compact surviving objects into an
+indirect command buffer with an atomic counter, so the CPU never reads results back.
+Requires OpenGL 4.3.
+*/
+class OcclusionCuller {
+public:
+	static bool supported() {
+		return GLAD_GL_VERSION_4_3 != 0;
+	}
+
+	OcclusionCuller() : capacity(0), lastCount(0), depthTexture(0), hizTexture(0), hizLevels(0) {}
+
+	//depth is the texture the culled view renders its depth into
+	void init(const Scene& scene, Shader* cull, Shader* hiz, GLuint depth, int width, int height) {
+		cullShader = cull;
+		hizShader = hiz;
+		capacity = (GLsizei)scene.objects.size();
+
+		glGenBuffers(1, &objectBuffer);
+		glGenBuffers(1, &candidateBuffer);
+		glGenBuffers(1, &visibilityBuffer);
+		glGenBuffers(1, &commandBuffer);
+		glGenBuffers(1, &countBuffer);
+		glGenBuffers(1, &idBuffer);
+
+		updateObjects(scene);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, candidateBuffer);
+		gpuBufferData(MEMORY_CULLING, GL_SHADER_STORAGE_BUFFER, std::max<GLsizei>(capacity, 1) * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibilityBuffer);
+		gpuBufferData(MEMORY_CULLING, GL_SHADER_STORAGE_BUFFER, std::max<GLsizei>(capacity, 1) * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+		//one command range per phase
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+		gpuBufferData(MEMORY_CULLING, GL_SHADER_STORAGE_BUFFER, 2 * std::max<GLsizei>(capacity, 1) * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+		gpuBufferData(MEMORY_CULLING, GL_SHADER_STORAGE_BUFFER, 2 * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		//per instance object id, baseInstance selects the object of each command
+		std::vector<GLuint> ids(capacity);
+		for (GLsizei i = 0; i < capacity; ++i)
+			ids[i] = i;
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+		scene.geometry.setupAttributes();
+		glBindBuffer(GL_ARRAY_BUFFER, idBuffer);
+		gpuBufferData(MEMORY_CULLING, GL_ARRAY_BUFFER, ids.size() * sizeof(GLuint), ids.data(), GL_STATIC_DRAW);
+		glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+		glVertexAttribDivisor(2, 1);
+		glEnableVertexAttribArray(2);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, scene.geometry.ebo);
+		//same draws over the position-only stream for depth passes
+		glGenVertexArrays(1, &depthVao);
+		glBindVertexArray(depthVao);
+		scene.geometry.setupPositionAttribute();
+		glBindBuffer(GL_ARRAY_BUFFER, idBuffer);
+		glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+		glVertexAttribDivisor(2, 1);
+		glEnableVertexAttribArray(2);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, scene.geometry.ebo);
+		glBindVertexArray(0);
+
+		setDepthTarget(depth, width, height);
+	}
+
+	//the view's depth texture was recreated, the Hi-Z pyramid follows its size
+	void setDepthTarget(GLuint depth, int width, int height) {
+		depthTexture = depth;
+		hizWidth = width;
+		hizHeight = height;
+		if (hizTexture != 0)
+			gpuDeleteTextures(1, &hizTexture);
+		hizLevels = 1 + (int)std::floor(std::log2((float)std::max(width, height)));
+		glGenTextures(1, &hizTexture);
+		glBindTexture(GL_TEXTURE_2D, hizTexture);
+		gpuTexStorage2D(MEMORY_CULLING, hizLevels, GL_R32F, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+
+	//re-upload transforms and bounds after objects moved
+	void updateObjects(const Scene& scene) {
+		std::vector<GpuObject> data(scene.objects.size());
+		for (size_t i = 0; i < scene.objects.size(); ++i) {
+			const SceneObject& object = scene.objects[i];
+			const Mesh& mesh = scene.geometry.meshes[object.mesh];
+			data[i].model = object.model;
+			data[i].diffuse = glm::vec4(object.diffuse, 1.0f);
+			data[i].boundsMin = glm::vec4(object.bounds.min, 1.0f);
+			data[i].boundsMax = glm::vec4(object.bounds.max, 1.0f);
+			data[i].indexCount = mesh.indexCount;
+			data[i].firstIndex = mesh.firstIndex;
+			data[i].baseVertex = mesh.baseVertex;
+			data[i].pad = 0;
+			data[i].lightmap = object.lightmap;
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+		gpuBufferData(MEMORY_CULLING, GL_SHADER_STORAGE_BUFFER, std::max<size_t>(data.size(), 1) * sizeof(GpuObject), data.data(), GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	//draw the frustum candidates that survive occlusion culling, the view's framebuffer must be bound
+	void render(Shader& shader, const std::vector<int>& candidates, const glm::mat4& viewProj, bool depthOnly = false) {
+		GLsizei count = (GLsizei)candidates.size();
+		lastCount = count;
+		if (count == 0)
+			return;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, candidateBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(GLuint), candidates.data());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+		if (!GLAD_GL_VERSION_4_6) {
+			//without draw count buffers the unused commands must be empty draws
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+			glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, objectBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, candidateBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, visibilityBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, commandBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, countBuffer);
+
+		cull(0, count, viewProj);
+		draw(shader, 0, count, depthOnly);
+		buildHiZ();
+		cull(1, count, viewProj);
+		draw(shader, 1, count, depthOnly);
+	}
+
+	//replay the commands of the last render, e.g. the shading pass after a depth pre-pass
+	void redraw(Shader& shader) {
+		if (lastCount == 0)
+			return;
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, objectBuffer);
+		draw(shader, 0, lastCount);
+		draw(shader, 1, lastCount);
+	}
+
+private:
+	Shader* cullShader;
+	Shader* hizShader;
+	GLsizei capacity;
+	GLsizei lastCount;
+	GLuint objectBuffer, candidateBuffer, visibilityBuffer, commandBuffer, countBuffer, idBuffer;
+	GLuint vao, depthVao;
+	GLuint depthTexture, hizTexture;
+	int hizWidth, hizHeight, hizLevels;
+
+	void cull(int phase, GLsizei count, const glm::mat4& viewProj) {
+		cullShader->use();
+		cullShader->setMat4("viewProj", viewProj);
+		cullShader->setInt("candidate_count", count);
+		cullShader->setInt("phase", phase);
+		glUniform1ui(glGetUniformLocation(cullShader->ID, "command_offset"), phase * capacity);
+		glUniform2i(glGetUniformLocation(cullShader->ID, "hiz_size"), hizWidth, hizHeight);
+		cullShader->setInt("hiz_levels", hizLevels);
+		cullShader->setInt("hiZ", 0);
+		glActiveTexture(GL_TEXTURE0);
+		GLint previous;
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+		glBindTexture(GL_TEXTURE_2D, hizTexture);
+		glDispatchCompute((count + 63) / 64, 1, 1);
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+		glBindTexture(GL_TEXTURE_2D, previous);
+	}
+
+	void draw(Shader& shader, int phase, GLsizei count, bool depthOnly = false) {
+		shader.use();
+		glBindVertexArray(depthOnly ? depthVao : vao);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+		const void* offset = (const void*)(phase * capacity * sizeof(DrawElementsIndirectCommand));
+		if (GLAD_GL_VERSION_4_6) {
+			glBindBuffer(GL_PARAMETER_BUFFER, countBuffer);
+			glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, offset, phase * sizeof(GLuint), count, 0);
+			glBindBuffer(GL_PARAMETER_BUFFER, 0);
+		}
+		else
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, offset, count, 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		glBindVertexArray(0);
+	}
+
+	void buildHiZ() {
+		hizShader->use();
+		hizShader->setInt("depthMap", 0);
+		glActiveTexture(GL_TEXTURE0);
+		GLint previous;
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+		glBindTexture(GL_TEXTURE_2D, depthTexture);
+		int srcWidth = hizWidth, srcHeight = hizHeight;
+		for (int level = 0; level < hizLevels; ++level) {
+			int dstWidth = std::max(1, hizWidth >> level);
+			int dstHeight = std::max(1, hizHeight >> level);
+			hizShader->setInt("copy_depth", level == 0 ? 1 : 0);
+			glUniform2i(glGetUniformLocation(hizShader->ID, "src_size"), srcWidth, srcHeight);
+			glUniform2i(glGetUniformLocation(hizShader->ID, "dst_size"), dstWidth, dstHeight);
+			glBindImageTexture(0, hizTexture, std::max(0, level - 1), GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+			glBindImageTexture(1, hizTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+			glDispatchCompute((dstWidth + 7) / 8, (dstHeight + 7) / 8, 1);
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+			srcWidth = dstWidth;
+			srcHeight = dstHeight;
+		}
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		glBindTexture(GL_TEXTURE_2D, previous);
+	}
+};
+#endif
@@ -0,0 +1,257 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include<cstdlib>
+#include<cstring>
+#include<string>
+#include<iostream>
+
+//Command line settings
+struct Options {
+	std::string captureDir;				//empty: capture disabled; the segment name for shm
+	std::string captureFormat;			//png, ppm, raw or shm
+	int captureFrames;					//0: until the window is closed
+	std::string cpuOutput;				//non-empty: render one frame on the CPU to this file, no GL
+	int threads;						//CPU renderer threads, 0: all hardware threads
+	int workers;						//processes the CPU frame is split across by tiles, 0: render in this one
+	int tileSize;						//tile width and height of the worker processes
+	std::string regressDir;				//non-empty: render the regression views and compare with the goldens in it
+	bool regressUpdate;					//write the goldens instead
+	bool regressCpu;					//use the CPU renderer for the regression views
+	int sampleNum;						//RSM gather samples per pixel
+	float sampleRadius;					//gather radius in RSM texture space
+	int rsmSize;						//RSM width and height
+	bool rsmHalfFormat;					//16-bit float normal and position targets
+	std::string sampleSet;				//sobol, poisson or random
+	bool blueNoise;						//rotate the samples per pixel
+	bool adaptive;						//stop the gather early where it has converged
+	float adaptiveThreshold;			//standard error of the indirect light to stop at
+	bool irradianceCache;				//interpolate the indirect term between cached gathers
+	float cacheAccuracy;				//Ward's a of the irradiance cache
+	bool lpv;							//indirect term from a light propagation volume
+	int lpvIterations;					//propagation steps of the volume
+	float lpvIntensity;					//scale of the volume's irradiance
+	bool probes;						//indirect term from irradiance probes baked once per light
+	int probeGrid;						//probes per axis
+	float probeIntensity;				//scale of the probes' irradiance
+	std::string bakeLightmap;			//non-empty: bake the indirect term into this PFM on the CPU, no GL
+	std::string lightmap;				//non-empty: indirect term from this baked PFM
+	bool ism;							//imperfect shadow maps for the visibility of the gather samples
+	float ismBias;						//fraction of its distance a receiver may lie behind a shadow map
+	std::string sweepPath;				//non-empty: run the parameter sweep and write the CSV here
+	float targetMs;						//GPU frame time the render scale holds, 0: fixed resolution
+	float minScale;						//lowest render scale of the dynamic resolution
+	bool dynamicQuality;				//below the lowest scale, also lower the samples and the RSM size
+	std::string viewsPath;				//non-empty: render every camera pose of this file headless into the capture dir
+	int swapInterval;					//glfwSwapInterval, -1: the driver's default
+	float fpsLimit;						//frames per second the window loop starts at most, 0: no limit
+	int framesInFlight;					//frames the CPU may submit before the GPU finished them, 0: the driver's queue
+	bool pacingReport;					//print frame times and input to present latency
+
+	Options() : captureFormat("png"), captureFrames(0), threads(0), workers(0), tileSize(128), regressUpdate(false), regressCpu(false),
+		sampleNum(512), sampleRadius(0.3f), rsmSize(1024), rsmHalfFormat(false), sampleSet("sobol"), blueNoise(true),
+		adaptive(false), adaptiveThreshold(0.005f), irradianceCache(false), cacheAccuracy(0.3f),
+		lpv(false), lpvIterations(8), lpvIntensity(0.02f),
+		probes(false), probeGrid(8), probeIntensity(1e-4f), ism(false), ismBias(0.2f),
+		targetMs(0.0f), minScale(0.5f), dynamicQuality(false), swapInterval(-1), fpsLimit(0.0f), framesInFlight(0),
+		pacingReport(false) {}
+};
+
+inline void printUsage(const char* program) {
+	std::cout << "usage: " << program << " [options]\n"
+		<< "  --capture <dir>           write every rendered frame to dir (a /name for shm)\n"
+		<< "  --capture-format <fmt>    png (default), ppm, raw or shm (POSIX shared memory ring)\n"
+		<< "  --capture-frames <n>      stop after n captured frames\n"
+		<< "  --cpu <file>              render with the CPU reference renderer (png or ppm)\n"
+		<< "  --threads <n>             CPU renderer threads, default all (split across the workers)\n"
+		<< "  --workers <n>             split the --cpu frame into tiles rendered by n processes,\n"
+		<< "                            not with --bake-lightmap or --regress-cpu\n"
+		<< "  --tile-size <px>          tile size of the workers, a multiple of 64, default 128\n"
+		<< "  --regress <dir>           render the regression views headless and compare with dir/<view>.ppm\n"
+		<< "  --regress-update          write the rendered views as new goldens\n"
+		<< "  --regress-cpu             render the regression views with the CPU renderer\n"
+		<< "  --samples <n>             RSM samples per pixel, default 512\n"
+		<< "  --sample-radius <r>       RSM gather radius, default 0.3\n"
+		<< "  --rsm-size <n>            RSM resolution, default 1024\n"
+		<< "  --rsm-format <fmt>        full (32-bit float, default) or half\n"
+		<< "  --sample-set <set>        sobol (default), poisson or random\n"
+		<< "  --no-blue-noise           use the same sample pattern for every pixel\n"
+		<< "  --adaptive                take samples in batches until the estimate converges\n"
+		<< "  --adaptive-threshold <t>  error to stop at, default 0.005\n"
+		<< "  --irradiance-cache        gather at sparse cache points and interpolate (OpenGL 4.3)\n"
+		<< "  --cache-accuracy <a>      cache interpolation error, default 0.3\n"
+		<< "  --lpv                     indirect light from a light propagation volume, fixed cost\n"
+		<< "  --lpv-iterations <n>      propagation steps of the volume, default 8\n"
+		<< "  --lpv-intensity <s>       scale of the volume's indirect light, default 0.02\n"
+		<< "  --probes                  indirect light from SH irradiance probes, baked once per light\n"
+		<< "  --probe-grid <n>          probes per axis, default 8\n"
+		<< "  --probe-intensity <s>     scale of the probes' indirect light, default 1e-4\n"
+		<< "  --bake-lightmap <file>    bake the indirect light of the static scene into a PFM lightmap and exit\n"
+		<< "  --lightmap <file>         indirect light from a lightmap baked for the same light\n"
+		<< "  --ism                     indirect shadows in the gather from imperfect shadow maps\n"
+		<< "  --ism-bias <b>            fraction of the distance a receiver may lie behind a shadow map, default 0.2\n"
+		<< "  --sweep <file.csv>        sweep the RSM settings headless, write cost, error and Pareto front\n"
+		<< "  --target-ms <ms>          scale the render resolution to hold this GPU frame time\n"
+		<< "  --min-scale <s>           lowest render scale, default 0.5\n"
+		<< "  --dynamic-quality         at the lowest scale also lower the samples, then the RSM size\n"
+		<< "  --views <file>            render the poses of file (x y z yaw pitch per line) with one RSM into --capture\n"
+		<< "  --swap-interval <n>       vertical blanks per swap, 0 turns vsync off, default the driver's\n"
+		<< "  --fps-limit <fps>         start frames at most this often\n"
+		<< "  --frames-in-flight <n>    frames queued ahead of the GPU, 1 to 7, default the driver's\n"
+		<< "  --pacing-report           print frame times and input to present latency every 2 s\n";
+}
+
+//returns false if the program should exit
+inline bool parseOptions(int argc, char** argv, Options& options) {
+	for (int i = 1; i < argc; ++i) {
+		const char* arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (std::strcmp(arg, "--capture") == 0 && hasValue)
+			options.captureDir = argv[++i];
+		else if (std::strcmp(arg, "--capture-format") == 0 && hasValue)
+			options.captureFormat = argv[++i];
+		else if (std::strcmp(arg, "--capture-frames") == 0 && hasValue)
+			options.captureFrames = std::atoi(argv[++i]);
+		else if (std::strcmp(arg, "--cpu") == 0 && hasValue)
+			options.cpuOutput = argv[++i];
+		else if (std::strcmp(arg, "--threads") == 0 && hasValue)
+			options.threads = std::atoi(argv[++i]);
+		else if (std::strcmp(arg, "--workers") == 0 && hasValue)
+			options.workers = std::atoi(argv[++i]);
+		else if (std::strcmp(arg, "--tile-size") == 0 && hasValue)
+			options.tileSize = std::atoi(argv[++i]);
+		else if (std::strcmp(arg, "--regress") == 0 && hasValue)
+			options.regressDir = argv[++i];
+		else if (std::strcmp(arg, "--regress-update") == 0)
+			options.regressUpdate = true;
+		else if (std::strcmp(arg, "--regress-cpu") == 0)
+			options.regressCpu = true;
+		else if (std::strcmp(arg, "--samples") == 0 && hasValue)
+			options.sampleNum = std::atoi(argv[++i]);
+		else if (std::strcmp(arg, "--sample-radius") == 0 && hasValue)
+			options.sampleRadius = (float)std::atof(argv[++i]);
+		else if (std::strcmp(arg, "--rsm-size") == 0 && hasValue)
+			options.rsmSize = std::atoi(argv[++i]);
+		else if (std::strcmp(arg, "--rsm-format") == 0 && hasValue) {
+			std::string format = argv[++i];
+			if (format != "full" && format != "half") {
+				std::cout << "ERROR::OPTIONS::UNKNOWN_RSM_FORMAT " << format << "\n";
+				return false;
+			}
+			options.rsmHalfFormat = format == "half";
+		}
+		else if (std::strcmp(arg, "--sample-set") == 0 && hasValue)
+			options.sampleSet = argv[++i];
+		else if (std::strcmp(arg, "--no-blue-noise") == 0)
+			options.blueNoise = false;
+		else if (std::strcmp(arg, "--adaptive") == 0)
+			options.adaptive = true;
+		else if (std::strcmp(arg, "--adaptive-threshold") == 0 && hasValue)
+			options.adaptiveThreshold = (float)std::atof(argv[++i]);
+		else if (std::strcmp(arg, "--irradiance-cache") == 0)
+			options.irradianceCache = true;
+		else if (std::strcmp(arg, "--cache-accuracy") == 0 && hasValue)
+			options.cacheAccuracy = (float)std::atof(argv[++i]);
+		else if (std::strcmp(arg, "--lpv") == 0)
+			options.lpv = true;
+		else if (std::strcmp(arg, "--lpv-iterations") == 0 && hasValue)
+			options.lpvIterations = std::atoi(argv[++i]);
+		else if (std::strcmp(arg, "--lpv-intensity") == 0 && hasValue)
+			options.lpvIntensity = (float)std::atof(argv[++i]);
+		else if (std::strcmp(arg, "--probes") == 0)
+			options.probes = true;
+		else if (std::strcmp(arg, "--probe-grid") == 0 && hasValue)
+			options.probeGrid = std::atoi(argv[++i]);
+		else if (std::strcmp(arg, "--probe-intensity") == 0 && hasValue)
+			options.probeIntensity = (float)std::atof(argv[++i]);
+		else if (std::strcmp(arg, "--bake-lightmap") == 0 && hasValue)
+			options.bakeLightmap = argv[++i];
+		else if (std::strcmp(arg, "--lightmap") == 0 && hasValue)
+			options.lightmap = argv[++i];
+		else if (std::strcmp(arg, "--ism") == 0)
+			options.ism = true;
+		else if (std::strcmp(arg, "--ism-bias") == 0 && hasValue)
+			options.ismBias = (float)std::atof(argv[++i]);
+		else if (std::strcmp(arg, "--sweep") == 0 && hasValue)
+			options.sweepPath = argv[++i];
+		else if (std::strcmp(arg, "--target-ms") == 0 && hasValue)
+			options.targetMs = (float)std::atof(argv[++i]);
+		else if (std::strcmp(arg, "--min-scale") == 0 && hasValue)
+			options.minScale = (float)std::atof(argv[++i]);
+		else if (std::strcmp(arg, "--dynamic-quality") == 0)
+			options.dynamicQuality = true;
+		else if (std::strcmp(arg, "--views") == 0 && hasValue)
+			options.viewsPath = argv[++i];
+		else if (std::strcmp(arg, "--swap-interval") == 0 && hasValue)
+			options.swapInterval = std::atoi(argv[++i]);
+		else if (std::strcmp(arg, "--fps-limit") == 0 && hasValue)
+			options.fpsLimit = (float)std::atof(argv[++i]);
+		else if (std::strcmp(arg, "--frames-in-flight") == 0 && hasValue)
+			options.framesInFlight = std::atoi(argv[++i]);
+		else if (std::strcmp(arg, "--pacing-report") == 0)
+			options.pacingReport = true;
+		else {
+			printUsage(argv[0]);
+			return false;
+		}
+	}
+	if (options.captureFormat != "png" && options.captureFormat != "ppm" && options.captureFormat != "raw" && options.captureFormat != "shm") {
+		std::cout << "ERROR::OPTIONS::UNKNOWN_CAPTURE_FORMAT " << options.captureFormat << "\n";
+		return false;
+	}
+	if (options.captureFormat == "shm" && !options.captureDir.empty()
+		&& (options.captureDir[0] != '/' || options.captureDir.find('/', 1) != std::string::npos)) {
+		std::cout << "ERROR::OPTIONS::BAD_SHM_NAME " << options.captureDir << "\n";
+		return false;
+	}
+	if (options.sampleSet != "sobol" && options.sampleSet != "poisson" && options.sampleSet != "random") {
+		std::cout << "ERROR::OPTIONS::UNKNOWN_SAMPLE_SET " << options.sampleSet << "\n";
+		return false;
+	}
+	if (options.sampleNum < 1 || options.sampleNum > 2048 || options.rsmSize < 16) {
+		std::cout << "ERROR::OPTIONS::RSM_SETTINGS_OUT_OF_RANGE\n";
+		return false;
+	}
+	if ((int)options.lpv + (int)options.irradianceCache + (int)options.probes + (int)!options.lightmap.empty() > 1) {
+		std::cout << "ERROR::OPTIONS::INDIRECT_MODES_EXCLUSIVE\n";
+		return false;
+	}
+	if (options.lpvIterations < 0) {
+		std::cout << "ERROR::OPTIONS::LPV_SETTINGS_OUT_OF_RANGE\n";
+		return false;
+	}
+	if (options.probeGrid < 2) {
+		std::cout << "ERROR::OPTIONS::PROBE_SETTINGS_OUT_OF_RANGE\n";
+		return false;
+	}
+	if (options.targetMs < 0.0f || options.minScale <= 0.0f || options.minScale > 1.0f) {
+		std::cout << "ERROR::OPTIONS::DYNAMIC_RESOLUTION_OUT_OF_RANGE\n";
+		return false;
+	}
+	if (options.workers < 0 || options.tileSize < 1) {
+		std::cout << "ERROR::OPTIONS::TILE_SETTINGS_OUT_OF_RANGE\n";
+		return false;
+	}
+	if (options.workers > 0 && options.cpuOutput.empty()) {
+		std::cout << "ERROR::OPTIONS::WORKERS_NEED_CPU_OUTPUT\n";
+		return false;
+	}
+	if (options.workers > 0 && (!options.bakeLightmap.empty() || options.regressCpu)) {
+		std::cout << "ERROR::OPTIONS::WORKERS_ONLY_RENDER_CPU_OUTPUT\n";
+		return false;
+	}
+	if (options.swapInterval < -1 || options.fpsLimit < 0.0f || options.framesInFlight < 0 || options.framesInFlight > 7) {
+		std::cout << "ERROR::OPTIONS::PACING_OUT_OF_RANGE\n";
+		return false;
+	}
+	if (!options.viewsPath.empty() && options.captureDir.empty()) {
+		std::cout << "ERROR::OPTIONS::VIEWS_NEED_CAPTURE_DIR\n";
+		return false;
+	}
+	if ((options.regressUpdate || options.regressCpu) && options.regressDir.empty()) {
+		std::cout << "ERROR::OPTIONS::REGRESS_DIR_MISSING\n";
+		return false;
+	}
+	return true;
+}
+#endif
@@ -0,0 +1,156 @@
+#ifndef PROBE_GRID_H
+#define PROBE_GRID_H
+
+#include <glad/glad.h>
+#include<glm/glm.hpp>
+
+#include<cmath>
+#include<vector>
+#include<algorithm>
+
+#include "scene.h"
+#include "thread_pool.h"
+#include "gpu_memory.h"
+
+/*
+Irradiance probes for static lighting. A regular grid of probes over the scene bounds
+integrates the VPLs of one RSM into three band spherical harmonics, already convolved
+with the clamped cosine (Ramamoorthi and Hanrahan 2001), so a pixel only interpolates
+the coefficients of its surrounding probes and evaluates them for its normal. Every VPL
+contributes flux * cos / d^2 like in the gather, so the bake costs probes * VPLs once
+and nothing per frame until the light changes.
+The GL texture stacks the nine coefficients along z: slab i holds coefficient i of
+every probe in rgb.
+*/
+class ProbeGrid {
+public:
+	static const int COEFFICIENTS = 9;
+	static const int VPL_SIZE = 128;	//VPLs per RSM side
+
+	int size;				//probes per axis
+	AABB bounds;			//probe i sits at the center of cell i of the bounds
+	GLuint texture;
+
+	ProbeGrid() : size(0), texture(0), baked(false) {}
+
+	void init(const Scene& scene, int probesPerAxis) {
+		size = probesPerAxis;
+		bounds = AABB();
+		for (size_t i = 0; i < scene.objects.size(); ++i)
+			bounds.grow(scene.objects[i].bounds);
+		coefficients.assign((size_t)size * size * size * COEFFICIENTS, glm::vec3(0.0f));
+		baked = false;
+	}
+
+	//true if the probes hold the light of this light space matrix and color
+	bool bakedFor(const glm::mat4& lightSpaceMatrix, const glm::vec3& lightColor) const {
+		return baked && lightSpaceMatrix == bakedMatrix && lightColor == bakedColor;
+	}
+	void invalidate() {
+		baked = false;
+	}
+
+	//project the VPLs of an RSM, rows bottom to top, onto every probe
+	void bake(ThreadPool& pool, const std::vector<glm::vec3>& normals, const std::vector<glm::vec3>& positions,
+		const std::vector<glm::vec3>& flux, int rsmWidth, int rsmHeight, const glm::mat4& lightSpaceMatrix, const glm::vec3& lightColor) {
+		std::vector<int> vpls;
+		for (int i = 0; i < VPL_SIZE * VPL_SIZE; ++i) {
+			int texel = (i / VPL_SIZE) * rsmHeight / VPL_SIZE * rsmWidth + (i % VPL_SIZE) * rsmWidth / VPL_SIZE;
+			if (flux[texel] != glm::vec3(0.0f))
+				vpls.push_back(texel);
+		}
+		//the VPLs sample the lit surface, each stands for an equal share of it
+		float weight = 4096.0f / (VPL_SIZE * VPL_SIZE);
+		pool.parallelFor(size * size * size, [&](int probe) {
+			glm::vec3 p = position(probe);
+			glm::vec3 sum[COEFFICIENTS];
+			for (int c = 0; c < COEFFICIENTS; ++c)
+				sum[c] = glm::vec3(0.0f);
+			for (size_t v = 0; v < vpls.size(); ++v) {
+				int texel = vpls[v];
+				glm::vec3 d = positions[texel] - p;
+				float distance2 = glm::dot(d, d);
+				float emit = glm::dot(normals[texel], -d);
+				if (emit <= 0.0f || distance2 <= 0.0f)
+					continue;
+				//flux * cos / d^2, the vectors are unnormalized
+				float distance = std::sqrt(distance2);
+				glm::vec3 radiance = flux[texel] * (weight * emit / (glm::length(normals[texel]) * distance2 * distance));
+				float basis[COEFFICIENTS];
+				evaluateBasis(d / distance, basis);
+				for (int c = 0; c < COEFFICIENTS; ++c)
+					sum[c] += radiance * basis[c];
+			}
+			//cosine convolution of bands 0, 1 and 2
+			const float BAND[3] = { 3.14159265f, 2.09439510f, 0.785398163f };
+			for (int c = 0; c < COEFFICIENTS; ++c)
+				coefficients[(size_t)probe * COEFFICIENTS + c] = sum[c] * BAND[c == 0 ? 0 : c < 4 ? 1 : 2];
+		});
+		baked = true;
+		bakedMatrix = lightSpaceMatrix;
+		bakedColor = lightColor;
+	}
+
+	//irradiance at a surface, trilinear between the probes like the GL lookup
+	glm::vec3 irradiance(const glm::vec3& p, const glm::vec3& normal) const {
+		glm::vec3 n = glm::normalize(normal);
+		glm::vec3 cell = glm::clamp((p - bounds.min) / (bounds.max - bounds.min) * (float)size - 0.5f,
+			glm::vec3(0.0f), glm::vec3((float)(size - 1)));
+		glm::ivec3 base = glm::min(glm::ivec3(cell), glm::ivec3(size - 2));
+		glm::vec3 f = cell - glm::vec3(base);
+		float basis[COEFFICIENTS];
+		evaluateBasis(n, basis);
+		glm::vec3 e(0.0f);
+		for (int corner = 0; corner < 8; ++corner) {
+			glm::ivec3 offset(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1);
+			float w = (offset.x ? f.x : 1.0f - f.x) * (offset.y ? f.y : 1.0f - f.y) * (offset.z ? f.z : 1.0f - f.z);
+			glm::ivec3 q = glm::min(base + offset, glm::ivec3(size - 1));
+			const glm::vec3* c = &coefficients[((size_t)(q.z * size + q.y) * size + q.x) * COEFFICIENTS];
+			for (int i = 0; i < COEFFICIENTS; ++i)
+				e += w * c[i] * basis[i];
+		}
+		return glm::max(e, glm::vec3(0.0f));
+	}
+
+	//(re)create the texture from the baked coefficients
+	void upload() {
+		if (texture == 0)
+			glGenTextures(1, &texture);
+		std::vector<glm::vec4> texels((size_t)size * size * size * COEFFICIENTS);
+		for (int c = 0; c < COEFFICIENTS; ++c)
+			for (int probe = 0; probe < size * size * size; ++probe)
+				texels[(size_t)c * size * size * size + probe] = glm::vec4(coefficients[(size_t)probe * COEFFICIENTS + c], 0.0f);
+		glBindTexture(GL_TEXTURE_3D, texture);
+		gpuTexImage3D(MEMORY_INDIRECT, GL_RGBA32F, size, size, size * COEFFICIENTS, GL_RGBA, GL_FLOAT, texels.data());
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	}
+
+	//real SH basis of bands 0-2 in the order of the stored coefficients
+	static void evaluateBasis(const glm::vec3& d, float* basis) {
+		basis[0] = 0.282094792f;
+		basis[1] = 0.488602512f * d.y;
+		basis[2] = 0.488602512f * d.z;
+		basis[3] = 0.488602512f * d.x;
+		basis[4] = 1.092548431f * d.x * d.y;
+		basis[5] = 1.092548431f * d.y * d.z;
+		basis[6] = 0.315391565f * (3.0f * d.z * d.z - 1.0f);
+		basis[7] = 1.092548431f * d.x * d.z;
+		basis[8] = 0.546274215f * (d.x * d.x - d.y * d.y);
+	}
+
+private:
+	std::vector<glm::vec3> coefficients;	//COEFFICIENTS per probe, x fastest
+	bool baked;
+	glm::mat4 bakedMatrix;
+	glm::vec3 bakedColor;
+
+	glm::vec3 position(int probe) const {
+		glm::vec3 index((float)(probe % size), (float)(probe / size % size), (float)(probe / (size * size)));
+		return bounds.min + (index + 0.5f) / (float)size * (bounds.max - bounds.min);
+	}
+};
+#endif
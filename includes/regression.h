@@ -0,0 +1,108 @@
+#ifndef REGRESSION_H
+#define REGRESSION_H
+
+#include<cstdio>
+#include<string>
+#include<vector>
+#include<iostream>
+
+#include "image_io.h"
+#include "image_metrics.h"
+
+/*
+Golden image checks for fixed viewpoints.
+Each rendered view is compared with dir/<name>.ppm and reported together with its
+frame time, so a performance change shows up as a quality/speed trade-off. In update
+mode the rendered views become the new goldens. A failing view also leaves
+<name>_out.ppm and a <name>_flip.ppm error map next to its golden.
+*/
+class Regression {
+public:
+	double minPSNR;
+	double minSSIM;
+	double maxFLIP;
+
+	Regression(const std::string& dir, bool update) : minPSNR(30.0), minSSIM(0.95), maxFLIP(0.05), dir(dir), update(update) {}
+
+	//pixels are RGBA8, rows top to bottom
+	void check(const std::string& name, const unsigned char* pixels, int width, int height, double frameMs) {
+		Result result;
+		result.name = name;
+		result.frameMs = frameMs;
+		result.compared = false;
+		result.passed = true;
+
+		std::vector<unsigned char> rgb((size_t)width * height * 3);
+		for (size_t i = 0; i < (size_t)width * height; ++i)
+			for (int c = 0; c < 3; ++c)
+				rgb[i * 3 + c] = pixels[i * 4 + c];
+
+		std::string golden = dir + "/" + name + ".ppm";
+		if (update) {
+			result.passed = writePPM(golden, rgb.data(), width, height, 3);
+			if (!result.passed)
+				std::cout << "ERROR::REGRESSION::WRITE_FAILED " << golden << "\n";
+			results.push_back(result);
+			return;
+		}
+
+		std::vector<unsigned char> reference;
+		int referenceWidth, referenceHeight;
+		if (!readPPM(golden, reference, referenceWidth, referenceHeight) || referenceWidth != width || referenceHeight != height) {
+			std::cout << "ERROR::REGRESSION::MISSING_GOLDEN " << golden << "\n";
+			result.passed = false;
+			results.push_back(result);
+			return;
+		}
+		std::vector<float> errorMap;
+		result.diff = compareImages(rgb.data(), reference.data(), width, height, &errorMap);
+		result.compared = true;
+		result.passed = result.diff.psnr >= minPSNR && result.diff.ssim >= minSSIM && result.diff.flip <= maxFLIP;
+		if (!result.passed) {
+			writePPM(dir + "/" + name + "_out.ppm", rgb.data(), width, height, 3);
+			std::vector<unsigned char> heat(errorMap.size());
+			for (size_t i = 0; i < errorMap.size(); ++i)
+				heat[i] = (unsigned char)(errorMap[i] * 255.0f + 0.5f);
+			writeGray(dir + "/" + name + "_flip.ppm", heat, width, height);
+		}
+		results.push_back(result);
+	}
+
+	//print the table, true if every view passed
+	bool report() const {
+		bool passed = true;
+		std::printf("%-12s %10s %9s %8s %8s %8s  %s\n", "view", "frame ms", "PSNR dB", "SSIM", "FLIP", "maxFLIP", "result");
+		for (size_t i = 0; i < results.size(); ++i) {
+			const Result& r = results[i];
+			if (r.compared)
+				std::printf("%-12s %10.3f %9.2f %8.4f %8.4f %8.4f  %s\n", r.name.c_str(), r.frameMs,
+					r.diff.psnr, r.diff.ssim, r.diff.flip, r.diff.maxFlip, r.passed ? "ok" : "FAIL");
+			else
+				std::printf("%-12s %10.3f %9s %8s %8s %8s  %s\n", r.name.c_str(), r.frameMs, "-", "-", "-", "-",
+					update ? (r.passed ? "updated" : "FAIL") : "FAIL");
+			passed = passed && r.passed;
+		}
+		return passed;
+	}
+
+private:
+	struct Result {
+		std::string name;
+		double frameMs;
+		ImageDiff diff;
+		bool compared;
+		bool passed;
+	};
+
+	std::string dir;
+	bool update;
+	std::vector<Result> results;
+
+	static void writeGray(const std::string& path, const std::vector<unsigned char>& gray, int width, int height) {
+		std::vector<unsigned char> rgb(gray.size() * 3);
+		for (size_t i = 0; i < gray.size(); ++i)
+			rgb[i * 3] = rgb[i * 3 + 1] = rgb[i * 3 + 2] = gray[i];
+		writePPM(path, rgb.data(), width, height, 3);
+	}
+};
+#endif
@@ -0,0 +1,428 @@
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+
+#include <glad/glad.h>
+
+#include<map>
+#include<utility>
+#include<string>
+#include<vector>
+#include<iostream>
+#include<functional>
+#include<algorithm>
+
+#include "render_target_pool.h"
+
+/*
+Frame scheduler over named textures.
+Passes declare the textures they read and write; compile() then drops every pass
+that does not contribute to an output, orders the rest so each reader runs after the
+writer it depends on (declaration order breaks ties), and works out the memory
+barriers: only image stores are incoherent in GL, so a barrier is issued before the
+first pass that touches a texture's storage after an image store, with the bits of how
+that pass accesses it; transients sharing a slot share that storage.
+Textures are either imported, owned by the caller and alive for the whole frame, or
+transient: transients of the same description share a texture from the pool when
+their first-to-last use in the schedule does not overlap, and hold it until the next
+compile().
+Passes bind their own framebuffers and viewport; compile() again after changing
+the passes or a transient's description.
+With timing on, a timestamp query brackets every pass. The queries of a frame are
+read TIMER_FRAMES frames later, when the GPU has long passed them, so passTimes()
+lags that far behind but never stalls the frame.
+*/
+class RenderGraph {
+public:
+	enum Access {
+		ATTACHMENT,	//framebuffer attachment
+		SAMPLED,	//texture fetch in a shader
+		IMAGE,		//image load/store, incoherent
+		TRANSFER	//read back or upload by the CPU
+	};
+	typedef RenderTargetDesc TextureDesc;
+	static const int TIMER_FRAMES = 3;
+
+	RenderGraph(RenderTargetPool& targetPool) : pool(targetPool), compiled(false), timing(false), timerFrame(0) {
+		for (int f = 0; f < TIMER_FRAMES; ++f)
+			timerIssued[f] = false;
+	}
+	~RenderGraph() {
+		for (size_t s = 0; s < slots.size(); ++s)
+			pool.release(slots[s].texture);
+		deleteTimers();
+	}
+
+	//a texture owned by the caller, may be imported again when the caller recreates it
+	void importTexture(const std::string& name, GLuint texture) {
+		Resource& resource = resources[name];
+		resource.imported = true;
+		resource.texture = texture;
+	}
+	void createTexture(const std::string& name, const TextureDesc& desc) {
+		Resource& resource = resources[name];
+		resource.imported = false;
+		resource.desc = desc;
+		compiled = false;
+	}
+	//kept after the frame, e.g. presented or captured
+	void output(const std::string& name) {
+		outputs.push_back(name);
+		compiled = false;
+	}
+
+	int addPass(const std::string& name, const std::function<void()>& execute) {
+		Pass pass;
+		pass.name = name;
+		pass.execute = execute;
+		passes.push_back(pass);
+		compiled = false;
+		return (int)passes.size() - 1;
+	}
+	void read(int pass, const std::string& name, Access access = SAMPLED) {
+		passes[pass].uses.push_back(Use(name, access, false));
+		compiled = false;
+	}
+	void write(int pass, const std::string& name, Access access = ATTACHMENT) {
+		passes[pass].uses.push_back(Use(name, access, true));
+		compiled = false;
+	}
+
+	//false if a texture is undeclared or the dependencies form a cycle
+	bool compile() {
+		compiled = false;
+		for (size_t p = 0; p < passes.size(); ++p)
+			for (size_t u = 0; u < passes[p].uses.size(); ++u)
+				if (resources.find(passes[p].uses[u].name) == resources.end()) {
+					std::cout << "ERROR::RENDER_GRAPH::UNKNOWN_TEXTURE " << passes[p].uses[u].name << " in " << passes[p].name << "\n";
+					return false;
+				}
+		std::vector<std::vector<int> > after = dependencies();
+		std::vector<bool> live = cull(after);
+		if (!order(after, live))
+			return false;
+		allocate();
+		barriers();
+		//queries issued under the old schedule do not match the passes any more
+		for (int f = 0; f < TIMER_FRAMES; ++f)
+			timerIssued[f] = false;
+		compiled = true;
+		return true;
+	}
+
+	void execute() {
+		if (!compiled && !compile())
+			return;
+		int slot = timerFrame % TIMER_FRAMES;
+		if (timing)
+			collectTimes(slot);
+		for (size_t i = 0; i < schedule.size(); ++i) {
+			const Pass& pass = passes[schedule[i]];
+			if (timing)
+				glQueryCounter(timers[slot][i], GL_TIMESTAMP);
+			if (pass.barriers != 0)
+				glMemoryBarrier(pass.barriers);
+			pass.execute();
+		}
+		if (timing) {
+			glQueryCounter(timers[slot][schedule.size()], GL_TIMESTAMP);
+			timerIssued[slot] = true;
+			++timerFrame;
+		}
+	}
+
+	void setTiming(bool enabled) {
+		timing = enabled;
+		if (!timing)
+			deleteTimers();
+	}
+	//GPU milliseconds of every pass, indexed like addPass(), 0 for culled passes and before the first results
+	const std::vector<double>& passTimes() const {
+		return times;
+	}
+
+	//valid after compile() for transients
+	GLuint texture(const std::string& name) const {
+		std::map<std::string, Resource>::const_iterator it = resources.find(name);
+		return it == resources.end() ? 0 : it->second.texture;
+	}
+	//pass names in execution order, culled passes left out
+	std::vector<std::string> scheduledPasses() const {
+		std::vector<std::string> names;
+		for (size_t i = 0; i < schedule.size(); ++i)
+			names.push_back(passes[schedule[i]].name);
+		return names;
+	}
+
+private:
+	struct Use {
+		std::string name;
+		Access access;
+		bool write;
+
+		Use(const std::string& n, Access a, bool w) : name(n), access(a), write(w) {}
+	};
+	struct Pass {
+		std::string name;
+		std::function<void()> execute;
+		std::vector<Use> uses;
+		GLbitfield barriers;
+	};
+	struct Resource {
+		bool imported;
+		TextureDesc desc;
+		GLuint texture;
+		int first, last;	//schedule positions of the first and last use
+		int slot;			//shared by transients, -1 if imported or unused
+
+		Resource() : imported(false), texture(0), first(-1), last(-1), slot(-1) {}
+	};
+	//one pool texture, shared by transients whose lifetimes are disjoint
+	struct Slot {
+		TextureDesc desc;
+		GLuint texture;
+		int busyUntil;	//last schedule position of the current user
+	};
+
+	std::map<std::string, Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<std::string> outputs;
+	std::vector<int> schedule;
+	std::vector<Slot> slots;
+	RenderTargetPool& pool;
+	bool compiled;
+	bool timing;
+	std::vector<GLuint> timers[TIMER_FRAMES];	//one timestamp before every scheduled pass and one after the last
+	bool timerIssued[TIMER_FRAMES];
+	unsigned int timerFrame;
+	std::vector<double> times;
+
+	//read the slot's queries of TIMER_FRAMES frames ago, (re)creating them when the schedule changed
+	void collectTimes(int slot) {
+		times.resize(passes.size(), 0.0);
+		if (timers[slot].size() != schedule.size() + 1) {
+			deleteTimers();
+			for (int f = 0; f < TIMER_FRAMES; ++f) {
+				timers[f].resize(schedule.size() + 1);
+				glGenQueries((GLsizei)timers[f].size(), timers[f].data());
+			}
+		}
+		if (!timerIssued[slot])
+			return;
+		std::vector<GLuint64> stamps(timers[slot].size());
+		for (size_t i = 0; i < stamps.size(); ++i)
+			glGetQueryObjectui64v(timers[slot][i], GL_QUERY_RESULT, &stamps[i]);
+		std::fill(times.begin(), times.end(), 0.0);
+		for (size_t i = 0; i < schedule.size(); ++i)
+			times[schedule[i]] = (stamps[i + 1] - stamps[i]) / 1.0e6;
+	}
+	void deleteTimers() {
+		for (int f = 0; f < TIMER_FRAMES; ++f) {
+			if (!timers[f].empty())
+				glDeleteQueries((GLsizei)timers[f].size(), timers[f].data());
+			timers[f].clear();
+			timerIssued[f] = false;
+		}
+	}
+
+	//after[p] lists the passes that must run after p: a reader after the writer it reads
+	//from, a writer after the previous writer and the readers of the previous contents
+	std::vector<std::vector<int> > dependencies() const {
+		std::vector<std::vector<int> > after(passes.size());
+		std::map<std::string, int> lastWriter;
+		std::map<std::string, std::vector<int> > readers;
+		for (size_t p = 0; p < passes.size(); ++p) {
+			for (size_t u = 0; u < passes[p].uses.size(); ++u) {
+				const Use& use = passes[p].uses[u];
+				if (use.write)
+					continue;
+				std::map<std::string, int>::const_iterator writer = lastWriter.find(use.name);
+				if (writer != lastWriter.end()) {
+					if (writer->second != (int)p)
+						after[writer->second].push_back((int)p);
+					readers[use.name].push_back((int)p);
+					continue;
+				}
+				//the producer is declared later, the reader still waits for it
+				int producer = firstWriter(use.name);
+				if (producer < 0)
+					readers[use.name].push_back((int)p);
+				else if (producer != (int)p)
+					after[producer].push_back((int)p);
+			}
+			for (size_t u = 0; u < passes[p].uses.size(); ++u) {
+				const Use& use = passes[p].uses[u];
+				if (!use.write)
+					continue;
+				std::map<std::string, int>::const_iterator writer = lastWriter.find(use.name);
+				if (writer != lastWriter.end() && writer->second != (int)p)
+					after[writer->second].push_back((int)p);
+				std::vector<int>& previous = readers[use.name];
+				for (size_t r = 0; r < previous.size(); ++r)
+					if (previous[r] != (int)p)
+						after[previous[r]].push_back((int)p);
+				previous.clear();
+				lastWriter[use.name] = (int)p;
+			}
+		}
+		return after;
+	}
+	int firstWriter(const std::string& name) const {
+		for (size_t p = 0; p < passes.size(); ++p)
+			for (size_t u = 0; u < passes[p].uses.size(); ++u)
+				if (passes[p].uses[u].write && passes[p].uses[u].name == name)
+					return (int)p;
+		return -1;
+	}
+
+	//a pass is live if it writes an output or something a live pass reads after it
+	std::vector<bool> cull(const std::vector<std::vector<int> >& after) const {
+		std::vector<bool> live(passes.size(), false);
+		std::vector<int> stack;
+		for (size_t p = 0; p < passes.size(); ++p)
+			for (size_t u = 0; u < passes[p].uses.size(); ++u)
+				if (passes[p].uses[u].write && std::find(outputs.begin(), outputs.end(), passes[p].uses[u].name) != outputs.end()) {
+					live[p] = true;
+					stack.push_back((int)p);
+					break;
+				}
+		while (!stack.empty()) {
+			int p = stack.back();
+			stack.pop_back();
+			for (size_t q = 0; q < passes.size(); ++q)
+				if (!live[q] && std::find(after[q].begin(), after[q].end(), p) != after[q].end() && feeds((int)q, p)) {
+					live[q] = true;
+					stack.push_back((int)q);
+				}
+		}
+		return live;
+	}
+	//q writes something p uses; a later write counts, attachments are depth tested and blended onto
+	bool feeds(int q, int p) const {
+		for (size_t a = 0; a < passes[q].uses.size(); ++a) {
+			if (!passes[q].uses[a].write)
+				continue;
+			for (size_t b = 0; b < passes[p].uses.size(); ++b)
+				if (passes[p].uses[b].name == passes[q].uses[a].name)
+					return true;
+		}
+		return false;
+	}
+
+	//topological order of the live passes, the earliest declared ready pass first
+	bool order(const std::vector<std::vector<int> >& after, const std::vector<bool>& live) {
+		std::vector<int> pending(passes.size(), 0);
+		for (size_t p = 0; p < passes.size(); ++p)
+			if (live[p])
+				for (size_t i = 0; i < after[p].size(); ++i)
+					if (live[after[p][i]])
+						++pending[after[p][i]];
+		schedule.clear();
+		std::vector<bool> done(passes.size(), false);
+		int liveCount = (int)std::count(live.begin(), live.end(), true);
+		while ((int)schedule.size() < liveCount) {
+			int next = -1;
+			for (size_t p = 0; p < passes.size() && next < 0; ++p)
+				if (live[p] && !done[p] && pending[p] == 0)
+					next = (int)p;
+			if (next < 0) {
+				std::cout << "ERROR::RENDER_GRAPH::CYCLE\n";
+				schedule.clear();
+				return false;
+			}
+			done[next] = true;
+			schedule.push_back(next);
+			for (size_t i = 0; i < after[next].size(); ++i)
+				if (live[after[next][i]])
+					--pending[after[next][i]];
+		}
+		return true;
+	}
+
+	//the slot of a transient, the name of an imported texture
+	typedef std::pair<int, std::string> Storage;
+	Storage storage(const std::string& name) const {
+		const Resource& resource = resources.find(name)->second;
+		return resource.imported ? Storage(-1, name) : Storage(resource.slot, std::string());
+	}
+	//barrier bits of the first pass touching a texture's storage after an image store, after
+	//allocate(): a transient that takes over a slot waits for the image stores of the one before
+	void barriers() {
+		//per storage, the access bits still to be issued since its last image store
+		std::map<Storage, GLbitfield> pending;
+		for (size_t i = 0; i < schedule.size(); ++i) {
+			Pass& pass = passes[schedule[i]];
+			pass.barriers = 0;
+			for (size_t u = 0; u < pass.uses.size(); ++u)
+				pass.barriers |= pending[storage(pass.uses[u].name)] & barrierBit(pass.uses[u].access);
+			//a barrier covers every image store before it, whatever it wrote to
+			for (std::map<Storage, GLbitfield>::iterator it = pending.begin(); it != pending.end(); ++it)
+				it->second &= ~pass.barriers;
+			for (size_t u = 0; u < pass.uses.size(); ++u)
+				if (pass.uses[u].write && pass.uses[u].access == IMAGE)
+					pending[storage(pass.uses[u].name)] = barrierBit(ATTACHMENT) | barrierBit(SAMPLED) | barrierBit(IMAGE) | barrierBit(TRANSFER);
+		}
+	}
+	static GLbitfield barrierBit(Access access) {
+		switch (access) {
+		case ATTACHMENT: return GL_FRAMEBUFFER_BARRIER_BIT;
+		case SAMPLED: return GL_TEXTURE_FETCH_BARRIER_BIT;
+		case IMAGE: return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+		default: return GL_TEXTURE_UPDATE_BARRIER_BIT;
+		}
+	}
+
+	//lifetimes over the schedule, then first fit into slots of the same description
+	void allocate() {
+		for (std::map<std::string, Resource>::iterator it = resources.begin(); it != resources.end(); ++it)
+			it->second.first = it->second.last = it->second.slot = -1;
+		for (size_t i = 0; i < schedule.size(); ++i) {
+			const Pass& pass = passes[schedule[i]];
+			for (size_t u = 0; u < pass.uses.size(); ++u) {
+				Resource& resource = resources[pass.uses[u].name];
+				if (resource.first < 0)
+					resource.first = (int)i;
+				resource.last = (int)i;
+			}
+		}
+		for (size_t o = 0; o < outputs.size(); ++o)
+			if (resources.count(outputs[o]))
+				resources[outputs[o]].last = (int)schedule.size();
+
+		std::vector<Resource*> transients;
+		for (std::map<std::string, Resource>::iterator it = resources.begin(); it != resources.end(); ++it)
+			if (!it->second.imported) {
+				it->second.texture = 0;
+				if (it->second.first >= 0)
+					transients.push_back(&it->second);
+			}
+		std::sort(transients.begin(), transients.end(), [](const Resource* a, const Resource* b) { return a->first < b->first; });
+		std::vector<Slot> previous;
+		previous.swap(slots);
+		std::vector<int> slotOf(transients.size());
+		for (size_t t = 0; t < transients.size(); ++t) {
+			Resource& resource = *transients[t];
+			int match = -1;
+			for (size_t s = 0; s < slots.size() && match < 0; ++s)
+				if (slots[s].desc == resource.desc && slots[s].busyUntil < resource.first)
+					match = (int)s;
+			if (match < 0) {
+				Slot slot;
+				slot.desc = resource.desc;
+				slots.push_back(slot);
+				match = (int)slots.size() - 1;
+			}
+			slots[match].busyUntil = resource.last;
+			slotOf[t] = match;
+		}
+		//the previous textures go back first, so an unchanged graph gets them again
+		for (size_t s = 0; s < previous.size(); ++s)
+			pool.release(previous[s].texture);
+		for (size_t s = 0; s < slots.size(); ++s)
+			slots[s].texture = pool.acquire(slots[s].desc);
+		for (size_t t = 0; t < transients.size(); ++t) {
+			transients[t]->slot = slotOf[t];
+			transients[t]->texture = slots[slotOf[t]].texture;
+		}
+	}
+};
+#endif
@@ -0,0 +1,103 @@
+#ifndef RENDER_TARGET_POOL_H
+#define RENDER_TARGET_POOL_H
+
+#include <glad/glad.h>
+
+#include<vector>
+
+#include "gpu_memory.h"
+
+//format and size of a 2D render target
+struct RenderTargetDesc {
+	GLenum internalFormat;
+	int width, height;
+
+	RenderTargetDesc(GLenum format = GL_RGBA8, int w = 0, int h = 0) : internalFormat(format), width(w), height(h) {}
+	bool operator==(const RenderTargetDesc& other) const {
+		return internalFormat == other.internalFormat && width == other.width && height == other.height;
+	}
+	bool depth() const {
+		return internalFormat == GL_DEPTH_COMPONENT || internalFormat == GL_DEPTH_COMPONENT16
+			|| internalFormat == GL_DEPTH_COMPONENT24 || internalFormat == GL_DEPTH_COMPONENT32F;
+	}
+};
+
+/*
+Render targets handed out by description and recycled.
+A released texture goes back to the pool and the next acquire of the same
+description gets it instead of a new one, so switching between settings reuses
+storage. Textures nobody acquired for KEEP_FRAMES frames are deleted by endFrame(),
+which keeps the memory of a process that runs many configurations bounded by the
+largest one. Acquire resets the sampler state to nearest and clamp to edge, users set
+their own afterwards.
+*/
+class RenderTargetPool {
+public:
+	static const unsigned int KEEP_FRAMES = 60;
+
+	RenderTargetPool() : frame(0) {}
+	~RenderTargetPool() {
+		for (size_t i = 0; i < entries.size(); ++i)
+			gpuDeleteTextures(1, &entries[i].texture);
+	}
+
+	//leaves the texture bound to the active unit
+	GLuint acquire(const RenderTargetDesc& desc) {
+		Entry* entry = NULL;
+		for (size_t i = 0; i < entries.size() && entry == NULL; ++i)
+			if (!entries[i].used && entries[i].desc == desc)
+				entry = &entries[i];
+		if (entry == NULL) {
+			Entry created;
+			created.desc = desc;
+			glGenTextures(1, &created.texture);
+			glBindTexture(GL_TEXTURE_2D, created.texture);
+			gpuTexImage2D(MEMORY_RENDER_TARGETS, desc.internalFormat, desc.width, desc.height,
+				desc.depth() ? GL_DEPTH_COMPONENT : GL_RGBA, GL_FLOAT, NULL);
+			entries.push_back(created);
+			entry = &entries.back();
+		}
+		entry->used = true;
+		glBindTexture(GL_TEXTURE_2D, entry->texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		return entry->texture;
+	}
+
+	//0 is ignored
+	void release(GLuint texture) {
+		for (size_t i = 0; i < entries.size(); ++i)
+			if (entries[i].texture == texture) {
+				entries[i].used = false;
+				entries[i].released = frame;
+			}
+	}
+
+	//delete what stayed unused for KEEP_FRAMES frames
+	void endFrame() {
+		++frame;
+		std::vector<Entry> kept;
+		for (size_t i = 0; i < entries.size(); ++i) {
+			if (!entries[i].used && frame - entries[i].released > KEEP_FRAMES)
+				gpuDeleteTextures(1, &entries[i].texture);
+			else
+				kept.push_back(entries[i]);
+		}
+		entries.swap(kept);
+	}
+
+private:
+	struct Entry {
+		RenderTargetDesc desc;
+		GLuint texture;
+		bool used;
+		unsigned int released;	//frame of the last release
+
+		Entry() : texture(0), used(false), released(0) {}
+	};
+	std::vector<Entry> entries;
+	unsigned int frame;
+};
+#endif
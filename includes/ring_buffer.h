@@ -0,0 +1,113 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <glad/glad.h>
+
+#include<cstring>
+#include<iostream>
+
+#include "gpu_memory.h"
+
+/*
+Triple buffered uniform ring for data written once per frame.
+The buffer holds FRAME_COUNT regions; the CPU fills the current region in one linear
+sweep while the GPU may still read the previous two, and a fence per region keeps the
+CPU from overwriting data still in flight. With GL 4.4 the buffer is persistently and
+coherently mapped once; older contexts map the region unsynchronized each frame and
+unmap it in flush(), before any draw reads it.
+*/
+class FrameRingBuffer {
+public:
+	static const int FRAME_COUNT = 3;
+
+	GLuint buffer;
+
+	FrameRingBuffer() : buffer(0), mapped(NULL), regionSize(0), alignment(256), frame(0), offset(0), persistent(false) {
+		for (int i = 0; i < FRAME_COUNT; ++i)
+			fences[i] = 0;
+	}
+
+	void init(GLsizeiptr bytesPerFrame) {
+		GLint align;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+		alignment = align;
+		regionSize = alignUp(bytesPerFrame);
+		persistent = GLAD_GL_VERSION_4_4 != 0;
+
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		if (persistent) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			gpuBufferStorage(MEMORY_STREAMING, GL_UNIFORM_BUFFER, regionSize * FRAME_COUNT, NULL, flags);
+			mapped = (char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, regionSize * FRAME_COUNT, flags);
+		}
+		else
+			gpuBufferData(MEMORY_STREAMING, GL_UNIFORM_BUFFER, regionSize * FRAME_COUNT, NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	//wait until the GPU is done with this frame's region and start writing at its beginning
+	void beginFrame() {
+		if (fences[frame] != 0) {
+			while (glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+				;
+			glDeleteSync(fences[frame]);
+			fences[frame] = 0;
+		}
+		offset = 0;
+		if (!persistent) {
+			glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+			mapped = (char*)glMapBufferRange(GL_UNIFORM_BUFFER, frame * regionSize, regionSize,
+				GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		}
+	}
+
+	//copy data into the current region, returns its offset in buffer for glBindBufferRange
+	GLintptr push(const void* data, GLsizeiptr size) {
+		GLsizeiptr aligned = alignUp(size);
+		if (offset + aligned > regionSize) {
+			std::cout << "ERROR::RING_BUFFER::OVERFLOW\n";
+			return -1;
+		}
+		char* base = persistent ? mapped + frame * regionSize : mapped;
+		std::memcpy(base + offset, data, size);
+		GLintptr result = frame * regionSize + offset;
+		offset += aligned;
+		return result;
+	}
+	template <typename T>
+	GLintptr push(const T& data) {
+		return push(&data, sizeof(T));
+	}
+
+	//all writes of the frame are done, make them visible to draws
+	void flush() {
+		if (!persistent) {
+			glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+			glUnmapBuffer(GL_UNIFORM_BUFFER);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+			mapped = NULL;
+		}
+	}
+
+	//fence the region after the last draw that reads it
+	void endFrame() {
+		fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		frame = (frame + 1) % FRAME_COUNT;
+	}
+
+	GLsizeiptr alignUp(GLsizeiptr size) const {
+		return (size + alignment - 1) / alignment * alignment;
+	}
+
+private:
+	char* mapped;
+	GLsizeiptr regionSize;
+	GLsizeiptr alignment;
+	int frame;
+	GLsizeiptr offset;
+	bool persistent;
+	GLsync fences[FRAME_COUNT];
+};
+#endif
@@ -0,0 +1,95 @@
+#ifndef RSM_TARGETS_H
+#define RSM_TARGETS_H
+
+#include <glad/glad.h>
+
+#include "render_target_pool.h"
+
+/*
+Render targets of the reflective shadow map: depth, normal, world position and flux.
+The full format keeps normal and position in 32-bit floats; the half format stores
+them as 16-bit floats with a 16-bit depth buffer, halving the bandwidth of the gather
+at the cost of position precision. The textures come from a pool, so switching
+back to earlier settings reuses their storage.
+*/
+class RSMTargets {
+public:
+	GLuint fbo;
+	GLuint depthMap, normalMap, worldPosMap, fluxMap;
+	int width, height;
+	bool halfFormat;
+
+	RSMTargets(RenderTargetPool& targetPool) : fbo(0), depthMap(0), normalMap(0), worldPosMap(0), fluxMap(0),
+		width(0), height(0), halfFormat(false), pool(targetPool) {}
+	~RSMTargets() {
+		destroy();
+	}
+
+	//(re)create the targets, existing ones are released
+	void create(int targetWidth, int targetHeight, bool half) {
+		destroy();
+		width = targetWidth;
+		height = targetHeight;
+		halfFormat = half;
+		GLenum vectorFormat = half ? GL_RGB16F : GL_RGB32F;
+
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		//深度缓存
+		depthMap = acquire(half ? GL_DEPTH_COMPONENT16 : GL_DEPTH_COMPONENT);
+		//法线缓存
+		normalMap = acquire(vectorFormat);
+		//世界坐标缓存
+		worldPosMap = acquire(vectorFormat);
+		//光通量缓存
+		fluxMap = acquire(GL_RGB);
+
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, normalMap, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, worldPosMap, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, fluxMap, 0);
+
+		GLenum rsm_draw_buffers[] = {
+		GL_COLOR_ATTACHMENT0,
+		GL_COLOR_ATTACHMENT1,
+		GL_COLOR_ATTACHMENT2
+		};
+		glDrawBuffers(3, rsm_draw_buffers);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	void destroy() {
+		if (fbo == 0)
+			return;
+		GLuint textures[] = { depthMap, normalMap, worldPosMap, fluxMap };
+		for (GLuint texture : textures)
+			pool.release(texture);
+		glDeleteFramebuffers(1, &fbo);
+		fbo = depthMap = normalMap = worldPosMap = fluxMap = 0;
+	}
+
+	//bind to the sampler units the shading shaders expect: depth 0, normal 1, position 2, flux 3
+	void bindTextures() const {
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, depthMap);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, normalMap);
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, worldPosMap);
+		glActiveTexture(GL_TEXTURE3);
+		glBindTexture(GL_TEXTURE_2D, fluxMap);
+	}
+
+private:
+	RenderTargetPool& pool;
+
+	GLuint acquire(GLenum internalFormat) const {
+		GLuint texture = pool.acquire(RenderTargetDesc(internalFormat, width, height));
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		GLfloat borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
+		glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+		return texture;
+	}
+};
+#endif
@@ -0,0 +1,130 @@
+#ifndef SAMPLE_SETS_H
+#define SAMPLE_SETS_H
+
+#include<glm/glm.hpp>
+
+#include<array>
+#include<cmath>
+#include<random>
+#include<vector>
+#include<algorithm>
+
+/*
+Deterministic sample sets for the RSM gather.
+Every set stores (r1 * sin(2 PI r2), r1 * cos(2 PI r2), r1 * r1) like the random
+samples, so the shaders are unchanged. The shaders take the first sample_num
+entries, so the sets are progressive: any prefix is well distributed.
+*/
+const unsigned int SAMPLE_TABLE_SIZE = 2048;
+
+struct GatherSample {
+	float x, y, z;
+};
+typedef std::array<GatherSample, SAMPLE_TABLE_SIZE> SampleTable;
+
+namespace sample_detail {
+	constexpr double TWO_PI = 6.283185307179586;
+
+	//index pack 0..N-1 with logarithmic instantiation depth
+	template<unsigned int... I> struct Indices {};
+	template<class A, class B> struct Concat;
+	template<unsigned int... A, unsigned int... B> struct Concat<Indices<A...>, Indices<B...> > {
+		typedef Indices<A..., (sizeof...(A) + B)...> type;
+	};
+	template<unsigned int N> struct MakeIndices {
+		typedef typename Concat<typename MakeIndices<N / 2>::type, typename MakeIndices<N - N / 2>::type>::type type;
+	};
+	template<> struct MakeIndices<0> { typedef Indices<> type; };
+	template<> struct MakeIndices<1> { typedef Indices<0> type; };
+
+	//Taylor series, accurate to double precision on [-PI, PI]
+	constexpr double sinSeries(double x2, double term, int n, double sum) {
+		return n > 25 ? sum : sinSeries(x2, -term * x2 / ((n + 1) * (n + 2)), n + 2, sum + term);
+	}
+	constexpr double sinTurn(double turn) {
+		//sin(2 PI t) = -sin(2 PI t - PI), keeps the series argument in [-PI, PI)
+		return -sinSeries((turn - 0.5) * TWO_PI * (turn - 0.5) * TWO_PI, (turn - 0.5) * TWO_PI, 1, 0.0);
+	}
+	constexpr double cosTurn(double turn) {
+		return sinTurn(turn + 0.25 < 1.0 ? turn + 0.25 : turn - 0.75);
+	}
+
+	//direction numbers of the first two Sobol dimensions: van der Corput and the polynomial x + 1
+	constexpr unsigned int nextDirection(unsigned int v) {
+		return v ^ (v >> 1);
+	}
+	constexpr unsigned int sobolDirection(int dimension, int bit) {
+		return dimension == 0 ? 0x80000000u >> bit
+			: bit == 0 ? 0x80000000u : nextDirection(sobolDirection(1, bit - 1));
+	}
+	constexpr unsigned int sobol(unsigned int index, int dimension, int bit) {
+		return index == 0 ? 0u : ((index & 1u) ? sobolDirection(dimension, bit) : 0u) ^ sobol(index >> 1, dimension, bit + 1);
+	}
+	//a constant digital shift keeps the net structure and moves point 0 off the center,
+	//where its r1 * r1 weight would be zero
+	constexpr unsigned int SOBOL_SHIFT_0 = 0x9e3779b9u, SOBOL_SHIFT_1 = 0x7f4a7c15u;
+	constexpr double sobolValue(unsigned int index, int dimension) {
+		return (sobol(index, dimension, 0) ^ (dimension == 0 ? SOBOL_SHIFT_0 : SOBOL_SHIFT_1)) * (1.0 / 4294967296.0);
+	}
+
+	constexpr GatherSample polarSample(double r1, double r2) {
+		return GatherSample{ (float)(r1 * sinTurn(r2)), (float)(r1 * cosTurn(r2)), (float)(r1 * r1) };
+	}
+	template<unsigned int... I>
+	constexpr SampleTable makeSobolTable(Indices<I...>) {
+		return SampleTable{ { polarSample(sobolValue(I, 0), sobolValue(I, 1))... } };
+	}
+
+	inline std::vector<glm::vec3> toVectors(const SampleTable& table, int size) {
+		std::vector<glm::vec3> samples(size);
+		for (int i = 0; i < size; ++i)
+			samples[i] = glm::vec3(table[i].x, table[i].y, table[i].z);
+		return samples;
+	}
+}
+
+//first two dimensions of the Sobol sequence, every power of two prefix is a stratified (0, m, 2)-net
+constexpr SampleTable SOBOL_SAMPLES = sample_detail::makeSobolTable(sample_detail::MakeIndices<SAMPLE_TABLE_SIZE>::type());
+
+inline std::vector<glm::vec3> sobolSamples(int size) {
+	return sample_detail::toVectors(SOBOL_SAMPLES, size);
+}
+
+/*
+Progressive Poisson-disk set by best-candidate sampling (Mitchell): each point is the
+candidate farthest from all earlier ones in (r1, r2), with the angle r2 wrapping
+around. Dart throwing does not fit C++11 constexpr, so the table is built once at
+startup from a fixed seed.
+*/
+inline std::vector<glm::vec3> poissonSamples(int size) {
+	const int CANDIDATES = 16;
+	std::mt19937 eng(1);
+	std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+	std::vector<glm::vec2> points;
+	points.reserve(size);
+	for (int i = 0; i < size; ++i) {
+		glm::vec2 best(dist(eng), dist(eng));
+		float bestDistance = -1.0f;
+		for (int c = 0; c < CANDIDATES && !points.empty(); ++c) {
+			glm::vec2 candidate(dist(eng), dist(eng));
+			float nearest = 2.0f;
+			for (size_t p = 0; p < points.size(); ++p) {
+				glm::vec2 d = glm::abs(candidate - points[p]);
+				d.y = std::min(d.y, 1.0f - d.y);
+				nearest = std::min(nearest, glm::dot(d, d));
+			}
+			if (nearest > bestDistance) {
+				bestDistance = nearest;
+				best = candidate;
+			}
+		}
+		points.push_back(best);
+	}
+	std::vector<glm::vec3> samples(size);
+	for (int i = 0; i < size; ++i) {
+		GatherSample s = sample_detail::polarSample(points[i].x, points[i].y);
+		samples[i] = glm::vec3(s.x, s.y, s.z);
+	}
+	return samples;
+}
+#endif
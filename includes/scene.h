@@ -0,0 +1,219 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glad/glad.h>
+#include<glm/glm.hpp>
+
+#include<vector>
+#include<algorithm>
+
+#include "bvh.h"
+#include "shader.h"
+#include "ring_buffer.h"
+#include "gpu_memory.h"
+
+//Uniform block bindings shared by all scene shaders
+const GLuint PER_FRAME_BINDING = 0;
+const GLuint PER_DRAW_BINDING = 1;
+
+//std140 layout of the PerFrame block
+struct PerFrameData {
+	glm::mat4 projection;
+	glm::mat4 view;
+	glm::mat4 lightSpaceMatrix;
+	glm::vec4 viewPos;
+	glm::vec4 noise;			//x: offset added to the blue noise this frame
+};
+
+//std140 layout of the PerDraw block
+struct PerDrawData {
+	glm::mat4 model;
+	glm::vec4 diffuse;
+	glm::vec4 lightmap;		//scale and offset of the lightmap UVs into the atlas
+};
+
+//A range of the shared index buffer
+struct Mesh {
+	GLsizei indexCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	AABB bounds;
+};
+
+/*
+All scene meshes packed into one vertex and one index buffer, so any subset of
+objects can be drawn from a single VAO (and by a single multi-draw-indirect call).
+Vertices are interleaved position + normal, six floats each. Lightmap UVs, if
+generated, are a separate stream so the depth and RSM passes do not fetch them.
+*/
+class SceneGeometry {
+public:
+	static const int VERTEX_STRIDE = 6;
+
+	std::vector<float> vertices;
+	std::vector<unsigned int> indices;
+	std::vector<Mesh> meshes;
+	std::vector<float> lightmapUVs;	//two floats per vertex, empty without lightmaps
+	GLuint vao, vbo, ebo, uvVbo;
+	//position-only stream for depth passes, same vertex order as vbo
+	GLuint depthVao, positionVbo;
+
+	SceneGeometry() : vao(0), vbo(0), ebo(0), uvVbo(0), depthVao(0), positionVbo(0) {}
+
+	//indices may be NULL for unindexed triangle lists
+	int addMesh(const float* meshVertices, int vertexCount, const unsigned int* meshIndices, int indexCount) {
+		Mesh mesh;
+		mesh.baseVertex = (GLint)(vertices.size() / VERTEX_STRIDE);
+		mesh.firstIndex = (GLuint)indices.size();
+		vertices.insert(vertices.end(), meshVertices, meshVertices + vertexCount * VERTEX_STRIDE);
+		if (meshIndices == NULL) {
+			indexCount = vertexCount;
+			for (int i = 0; i < vertexCount; ++i)
+				indices.push_back(i);
+		}
+		else
+			indices.insert(indices.end(), meshIndices, meshIndices + indexCount);
+		mesh.indexCount = indexCount;
+		for (int i = 0; i < vertexCount; ++i)
+			mesh.bounds.grow(glm::vec3(meshVertices[i * VERTEX_STRIDE], meshVertices[i * VERTEX_STRIDE + 1], meshVertices[i * VERTEX_STRIDE + 2]));
+		meshes.push_back(mesh);
+		return (int)meshes.size() - 1;
+	}
+
+	void upload() {
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &vbo);
+		glGenBuffers(1, &ebo);
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		gpuBufferData(MEMORY_GEOMETRY, GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+		if (!lightmapUVs.empty()) {
+			glGenBuffers(1, &uvVbo);
+			glBindBuffer(GL_ARRAY_BUFFER, uvVbo);
+			gpuBufferData(MEMORY_GEOMETRY, GL_ARRAY_BUFFER, lightmapUVs.size() * sizeof(float), lightmapUVs.data(), GL_STATIC_DRAW);
+		}
+		setupAttributes();
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+		gpuBufferData(MEMORY_GEOMETRY, GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+		std::vector<float> positions;
+		positions.reserve(vertices.size() / 2);
+		for (size_t i = 0; i < vertices.size(); i += VERTEX_STRIDE)
+			positions.insert(positions.end(), vertices.begin() + i, vertices.begin() + i + 3);
+		glGenVertexArrays(1, &depthVao);
+		glGenBuffers(1, &positionVbo);
+		glBindVertexArray(depthVao);
+		glBindBuffer(GL_ARRAY_BUFFER, positionVbo);
+		gpuBufferData(MEMORY_GEOMETRY, GL_ARRAY_BUFFER, positions.size() * sizeof(float), positions.data(), GL_STATIC_DRAW);
+		setupPositionAttribute();
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+		glBindVertexArray(0);
+	}
+
+	//attribute layout of the shared vertex buffer, for VAOs built on top of it
+	void setupAttributes() const {
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VERTEX_STRIDE * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, VERTEX_STRIDE * sizeof(float), (void*)(3 * sizeof(float)));
+		glEnableVertexAttribArray(1);
+		//location 2 is the object id of the GPU-driven draws
+		if (uvVbo != 0) {
+			glBindBuffer(GL_ARRAY_BUFFER, uvVbo);
+			glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+			glEnableVertexAttribArray(3);
+		}
+	}
+	void setupPositionAttribute() const {
+		glBindBuffer(GL_ARRAY_BUFFER, positionVbo);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(0);
+	}
+};
+
+//One draw call of the scene: mesh, transform and material
+struct SceneObject {
+	int mesh;
+	glm::mat4 model;
+	glm::vec3 diffuse;
+	AABB bounds;	//world space
+	glm::vec4 lightmap;	//xy scale, zw offset of the mesh's lightmap UVs, zero without a lightmap
+};
+
+class Scene {
+public:
+	SceneGeometry geometry;
+	std::vector<SceneObject> objects;
+	BVH bvh;
+
+	int add(int mesh, const glm::mat4& model, const glm::vec3& diffuse) {
+		SceneObject object;
+		object.mesh = mesh;
+		object.model = model;
+		object.diffuse = diffuse;
+		object.bounds = geometry.meshes[mesh].bounds.transform(model);
+		object.lightmap = glm::vec4(0.0f);
+		objects.push_back(object);
+		return (int)objects.size() - 1;
+	}
+	//build the hierarchy once all objects are added
+	void build() {
+		std::vector<AABB> bounds(objects.size());
+		for (size_t i = 0; i < objects.size(); ++i)
+			bounds[i] = objects[i].bounds;
+		bvh.build(bounds);
+	}
+	//move an object, the hierarchy is refitted instead of rebuilt
+	void setModel(int object, const glm::mat4& model) {
+		objects[object].model = model;
+		objects[object].bounds = geometry.meshes[objects[object].mesh].bounds.transform(model);
+		bvh.refit(object, objects[object].bounds);
+	}
+	//objects inside the frustum, in submission order
+	void cull(const Frustum& frustum, std::vector<int>& visible) const {
+		bvh.queryFrustum(frustum, visible);
+		std::sort(visible.begin(), visible.end());
+	}
+	//objects a light of the given radius can reach
+	void queryLight(const glm::vec3& position, float radius, std::vector<int>& lit) const {
+		bvh.querySphere(position, radius, lit);
+		std::sort(lit.begin(), lit.end());
+	}
+	//closest object under the ray, -1 if nothing is hit
+	int pick(const Ray& ray, float& distance) const {
+		return bvh.raycast(ray, distance);
+	}
+	//write the per-draw block of every visible object, offsets[i] belongs to visible[i]
+	void writeDraws(FrameRingBuffer& ring, const std::vector<int>& visible, std::vector<GLintptr>& offsets) const {
+		offsets.resize(visible.size());
+		for (size_t i = 0; i < visible.size(); ++i) {
+			const SceneObject& object = objects[visible[i]];
+			PerDrawData data;
+			data.model = object.model;
+			data.diffuse = glm::vec4(object.diffuse, 1.0f);
+			data.lightmap = object.lightmap;
+			offsets[i] = ring.push(data);
+		}
+	}
+	void draw(Shader& shader, const std::vector<int>& visible, const FrameRingBuffer& ring, const std::vector<GLintptr>& offsets) const {
+		shader.use();
+		glBindVertexArray(geometry.vao);
+		drawRanges(visible, ring, offsets);
+	}
+	//depth-only pass over the position stream
+	void drawDepth(Shader& shader, const std::vector<int>& visible, const FrameRingBuffer& ring, const std::vector<GLintptr>& offsets) const {
+		shader.use();
+		glBindVertexArray(geometry.depthVao);
+		drawRanges(visible, ring, offsets);
+	}
+
+private:
+	void drawRanges(const std::vector<int>& visible, const FrameRingBuffer& ring, const std::vector<GLintptr>& offsets) const {
+		for (size_t i = 0; i < visible.size(); ++i) {
+			const Mesh& mesh = geometry.meshes[objects[visible[i]].mesh];
+			glBindBufferRange(GL_UNIFORM_BUFFER, PER_DRAW_BINDING, ring.buffer, offsets[i], sizeof(PerDrawData));
+			glDrawElementsBaseVertex(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT, (void*)(mesh.firstIndex * sizeof(unsigned int)), mesh.baseVertex);
+		}
+	}
+};
+#endif
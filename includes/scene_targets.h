@@ -0,0 +1,51 @@
+#ifndef SCENE_TARGETS_H
+#define SCENE_TARGETS_H
+
+#include <glad/glad.h>
+
+#include "render_target_pool.h"
+
+/*
+Render targets of the camera view: color and a 32-bit float depth that also feeds the
+camera Hi-Z and the G-buffer pass. Their size is the internal render resolution,
+which may be below the window's; the textures come from a pool, so returning to an
+earlier resolution reuses their storage.
+*/
+class SceneTargets {
+public:
+	GLuint fbo;
+	GLuint colorMap, depthMap;
+	int width, height;
+
+	SceneTargets(RenderTargetPool& targetPool) : fbo(0), colorMap(0), depthMap(0), width(0), height(0), pool(targetPool) {}
+	~SceneTargets() {
+		destroy();
+	}
+
+	//(re)create the targets, existing ones are released
+	void create(int targetWidth, int targetHeight) {
+		destroy();
+		width = targetWidth;
+		height = targetHeight;
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		colorMap = pool.acquire(RenderTargetDesc(GL_RGBA8, width, height));
+		depthMap = pool.acquire(RenderTargetDesc(GL_DEPTH_COMPONENT32F, width, height));
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorMap, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	void destroy() {
+		if (fbo == 0)
+			return;
+		pool.release(colorMap);
+		pool.release(depthMap);
+		glDeleteFramebuffers(1, &fbo);
+		fbo = colorMap = depthMap = 0;
+	}
+
+private:
+	RenderTargetPool& pool;
+};
+#endif
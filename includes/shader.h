@@ -14,13 +14,16 @@ public:
 	unsigned int ID;    //ID
 
 	Shader(const GLchar* vertexPath, const GLchar* fragmentPath);
+	explicit Shader(const GLchar* computePath);
 	void use();
 	void setBool(const std::string& name, bool value) const;
 	void setInt(const std::string& name, int value) const;
 	void setFloat(const std::string& name, float value) const;
+	void setVec2(const std::string& name, const glm::vec2& vec) const;
 	void setVec3(const std::string& name, const glm::vec3& vec) const;
 	void setVec3(const std::string& name, float x, float y, float z) const;
 	void setMat4(const std::string& name, const glm::mat4& mat) const;
+	void setBlockBinding(const std::string& name, GLuint binding) const;
 };
 Shader::Shader(const GLchar* vertexPath, const GLchar* fragmentPath) {
 	//1.ɫ
@@ -32,14 +35,17 @@ Shader::Shader(const GLchar* vertexPath, const GLchar* fragmentPath) {
 	fShaderFile.exceptions(ifstream::failbit | ifstream::badbit);
 	try {
 		vShaderFile.open(vertexPath);
-		fShaderFile.open(fragmentPath);
 		stringstream vShaderStream, fShaderStream;
 		vShaderStream << vShaderFile.rdbuf();
-		fShaderStream << fShaderFile.rdbuf();
 		vShaderFile.close();
-		fShaderFile.close();
 		vertexCode = vShaderStream.str();
-		fragmentCode = fShaderStream.str();
+		//depth-only programs have no fragment stage
+		if (fragmentPath != NULL) {
+			fShaderFile.open(fragmentPath);
+			fShaderStream << fShaderFile.rdbuf();
+			fShaderFile.close();
+			fragmentCode = fShaderStream.str();
+		}
 	}
 	catch (ifstream::failure e) {
 		cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << endl;
@@ -61,19 +67,66 @@ Shader::Shader(const GLchar* vertexPath, const GLchar* fragmentPath) {
 		std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
 	};
 
-	fragment = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment, 1, &fShaderCode, NULL);
-	glCompileShader(fragment);
-	glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
+	fragment = 0;
+	if (fragmentPath != NULL) {
+		fragment = glCreateShader(GL_FRAGMENT_SHADER);
+		glShaderSource(fragment, 1, &fShaderCode, NULL);
+		glCompileShader(fragment);
+		glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			glGetShaderInfoLog(fragment, 512, NULL, infoLog);
+			std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+		};
+	}
+
+	ID = glCreateProgram();
+	glAttachShader(ID, vertex);
+	if (fragment != 0)
+		glAttachShader(ID, fragment);
+	glLinkProgram(ID);
+	glGetProgramiv(ID, GL_LINK_STATUS, &success);
 	if (!success)
 	{
-		glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+		glGetProgramInfoLog(ID, 512, NULL, infoLog);
+		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+	}
+
+	glDeleteShader(vertex);
+	if (fragment != 0)
+		glDeleteShader(fragment);
+}
+Shader::Shader(const GLchar* computePath) {
+	string computeCode;
+	ifstream cShaderFile;
+	cShaderFile.exceptions(ifstream::failbit | ifstream::badbit);
+	try {
+		cShaderFile.open(computePath);
+		stringstream cShaderStream;
+		cShaderStream << cShaderFile.rdbuf();
+		cShaderFile.close();
+		computeCode = cShaderStream.str();
+	}
+	catch (const ifstream::failure&) {
+		cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << endl;
+	}
+	const char* cShaderCode = computeCode.c_str();
+	unsigned int compute;
+	int success;
+	char infoLog[512];
+
+	compute = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(compute, 1, &cShaderCode, NULL);
+	glCompileShader(compute);
+	glGetShaderiv(compute, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		glGetShaderInfoLog(compute, 512, NULL, infoLog);
+		std::cout << "ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n" << infoLog << std::endl;
 	};
 
 	ID = glCreateProgram();
-	glAttachShader(ID, vertex);
-	glAttachShader(ID, fragment);
+	glAttachShader(ID, compute);
 	glLinkProgram(ID);
 	glGetProgramiv(ID, GL_LINK_STATUS, &success);
 	if (!success)
@@ -82,8 +135,7 @@ Shader::Shader(const GLchar* vertexPath, const GLchar* fragmentPath) {
 		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
 	}
 
-	glDeleteShader(vertex);
-	glDeleteShader(fragment);
+	glDeleteShader(compute);
 }
 void Shader::use() {
 	glUseProgram(ID);
@@ -97,6 +149,9 @@ void Shader::setInt(const string& name, int value) const {
 void Shader::setFloat(const string& name, float value) const {
 	glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
 }
+void Shader::setVec2(const string& name, const glm::vec2& value) const {
+	glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+}
 void Shader::setVec3(const string& name, const glm::vec3& value) const {
 	glUniform3fv(glGetUniformLocation(ID, name.c_str()),1,&value[0]);
 }
@@ -106,4 +161,9 @@ void Shader::setVec3(const std::string& name, float x, float y, float z) const {
 void Shader::setMat4(const std::string& name, const glm::mat4& mat) const {
 	glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
 }
+void Shader::setBlockBinding(const std::string& name, GLuint binding) const {
+	GLuint index = glGetUniformBlockIndex(ID, name.c_str());
+	if (index != GL_INVALID_INDEX)
+		glUniformBlockBinding(ID, index, binding);
+}
 #endif
\ No newline at end of file
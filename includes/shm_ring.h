@@ -0,0 +1,259 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<time.h>
+#include<cerrno>
+#include<cstring>
+#include<cstdint>
+#include<string>
+#include<atomic>
+#include<iostream>
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the ring's counters must be lock free to be shared between processes");
+
+//start of the segment, written once by the producer except for the counters
+struct ShmRingHeader {
+	static const uint32_t MAGIC = 0x464d5352;	//"RSMF"
+	static const uint32_t VERSION = 2;
+
+	uint32_t magic;					//set last, the segment is ready once it reads MAGIC
+	uint32_t version;
+	uint32_t slotCount;
+	uint32_t slotOffset;			//bytes from the start of the segment to slot 0
+	uint64_t slotBytes;				//stride of the slots: ShmFrameHeader, then the pixels
+	uint32_t generation;			//segments created under this name by the producer so far, minus one
+	std::atomic<uint32_t> replaced;	//set once a larger segment took over the name
+	std::atomic<uint64_t> written;	//frames published, frame n is in slot n % slotCount
+	std::atomic<uint64_t> read;		//frames the consumer is done with, advanced by the consumer only
+	std::atomic<uint64_t> dropped;	//frames skipped because the ring was full, over all generations
+};
+
+//start of every slot
+struct ShmFrameHeader {
+	uint64_t frame;			//capture index, has gaps where frames were dropped
+	uint32_t width, height;	//RGBA8, rows top to bottom
+	uint64_t bytes;
+	uint64_t captureNs;		//CLOCK_MONOTONIC when the readback was queued
+	uint64_t publishNs;		//CLOCK_MONOTONIC when the pixels were in the slot
+};
+
+/*
+Frames in a POSIX shared memory ring for another process on the same machine.
+The producer writes a frame into the slot after the last published one and then
+advances written; the consumer uses the pixels in place and advances read when it is
+done with them, so neither copies a frame out of the ring. The producer never waits:
+when all slots hold frames the consumer has not released, the new frame is dropped
+and counted. Slots are sized at create(); for larger frames resize() publishes a new
+segment under the same name with the next generation and marks the old one replaced.
+A consumer opens the segment by name, waits for magic, then loops:
+	while (read < written) { use slot read % slotCount; read = read + 1; }
+	if (read == written && replaced) { unmap, open the name again }
+The producer unlinks the name in close(); mappings stay valid until unmapped. A producer
+starting over a segment that a crashed one left marks it replaced the same way.
+*/
+class ShmRing {
+public:
+	ShmRing() : header(NULL), mapped(0), owner(false) {}
+	~ShmRing() {
+		close();
+	}
+
+	//the producer's side, replaces a segment left by an earlier run; name starts with '/'
+	bool create(const std::string& segmentName, uint32_t slotCount, uint64_t frameBytes) {
+		return create(segmentName, slotCount, frameBytes, 0, 0);
+	}
+
+	//producer: make room for frames of frameBytes; the frames still in the old segment stay
+	//readable there, consumers switch once they drained it
+	bool resize(uint64_t frameBytes) {
+		if (frameBytes <= capacity())
+			return true;
+		std::string segmentName = name;
+		uint32_t slotCount = header->slotCount, generation = header->generation + 1;
+		uint64_t lost = dropped();
+		header->replaced.store(1, std::memory_order_release);
+		close();
+		return create(segmentName, slotCount, frameBytes, generation, lost);
+	}
+
+	//consumer: the producer moved on to a larger segment, open the name again once
+	//acquire() returns NULL
+	bool replaced() const {
+		return header->replaced.load(std::memory_order_acquire) != 0;
+	}
+
+	uint32_t generation() const {
+		return header->generation;
+	}
+
+	//largest frame a slot holds
+	uint64_t capacity() const {
+		return header->slotBytes - sizeof(ShmFrameHeader);
+	}
+
+	//producer: copies height rows of rowBytes from rows, starting at the last one when flip is set;
+	//false if the frame was dropped
+	bool publish(uint64_t frame, int width, int height, const unsigned char* rows, bool flip, uint64_t captureNs) {
+		uint64_t rowBytes = (uint64_t)width * 4, bytes = rowBytes * height;
+		uint64_t index = header->written.load(std::memory_order_relaxed);
+		if (bytes > capacity() || index - header->read.load(std::memory_order_acquire) >= header->slotCount) {
+			header->dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		ShmFrameHeader* slot = frameHeader(index);
+		unsigned char* pixels = (unsigned char*)(slot + 1);
+		for (int y = 0; y < height; ++y)
+			std::memcpy(pixels + y * rowBytes, rows + (flip ? height - 1 - y : y) * rowBytes, (size_t)rowBytes);
+		slot->frame = frame;
+		slot->width = (uint32_t)width;
+		slot->height = (uint32_t)height;
+		slot->bytes = bytes;
+		slot->captureNs = captureNs;
+		slot->publishNs = now();
+		header->written.store(index + 1, std::memory_order_release);
+		return true;
+	}
+
+	//the consumer's side, false until the producer finished create()
+	bool open(const std::string& segmentName) {
+		close();
+		int fd = shm_open(segmentName.c_str(), O_RDWR, 0);
+		if (fd < 0)
+			return false;
+		struct stat info;
+		bool ok = fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(ShmRingHeader) && map(fd, (size_t)info.st_size);
+		::close(fd);
+		if (!ok)
+			return false;
+		if (header->magic != ShmRingHeader::MAGIC || header->version != ShmRingHeader::VERSION) {
+			close();
+			return false;
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		name = segmentName;
+		return true;
+	}
+
+	//consumer: the oldest frame not released yet, NULL if there is none; its pixels follow the header
+	const ShmFrameHeader* acquire() const {
+		uint64_t index = header->read.load(std::memory_order_relaxed);
+		if (index == header->written.load(std::memory_order_acquire))
+			return NULL;
+		return frameHeader(index);
+	}
+
+	//consumer: hands the slot of acquire() back to the producer
+	void release() {
+		header->read.fetch_add(1, std::memory_order_release);
+	}
+
+	uint64_t dropped() const {
+		return header->dropped.load(std::memory_order_relaxed);
+	}
+
+	bool valid() const {
+		return header != NULL;
+	}
+
+	//unmaps; the producer also removes the name
+	void close() {
+		if (header != NULL)
+			munmap(header, mapped);
+		if (owner)
+			shm_unlink(name.c_str());
+		header = NULL;
+		mapped = 0;
+		owner = false;
+	}
+
+	//CLOCK_MONOTONIC in nanoseconds, the clock of the frame timestamps
+	static uint64_t now() {
+		timespec time;
+		clock_gettime(CLOCK_MONOTONIC, &time);
+		return (uint64_t)time.tv_sec * 1000000000ull + (uint64_t)time.tv_nsec;
+	}
+
+private:
+	std::string name;
+	ShmRingHeader* header;
+	size_t mapped;
+	bool owner;
+
+	//slots on cache lines
+	static uint64_t align(uint64_t bytes) {
+		return (bytes + 63) & ~(uint64_t)63;
+	}
+
+	//a new segment under segmentName; one an earlier producer left is marked replaced and
+	//unlinked, never truncated, since a consumer may still have it mapped
+	bool create(const std::string& segmentName, uint32_t slotCount, uint64_t frameBytes, uint32_t generation, uint64_t droppedBefore) {
+		close();
+		retire(segmentName);
+		shm_unlink(segmentName.c_str());
+		int fd = shm_open(segmentName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (fd < 0) {
+			std::cout << "ERROR::SHM_RING::OPEN_FAILED " << segmentName << " " << std::strerror(errno) << "\n";
+			return false;
+		}
+		uint64_t offset = align(sizeof(ShmRingHeader));
+		uint64_t stride = align(sizeof(ShmFrameHeader) + frameBytes);
+		size_t size = (size_t)(offset + stride * slotCount);
+		if (ftruncate(fd, (off_t)size) != 0 || !map(fd, size)) {
+			std::cout << "ERROR::SHM_RING::MAP_FAILED " << segmentName << " " << std::strerror(errno) << "\n";
+			::close(fd);
+			shm_unlink(segmentName.c_str());
+			return false;
+		}
+		::close(fd);
+		name = segmentName;
+		owner = true;
+		header->version = ShmRingHeader::VERSION;
+		header->slotCount = slotCount;
+		header->slotOffset = (uint32_t)offset;
+		header->slotBytes = stride;
+		header->generation = generation;
+		header->replaced.store(0);
+		header->written.store(0);
+		header->read.store(0);
+		header->dropped.store(droppedBefore);
+		std::atomic_thread_fence(std::memory_order_release);
+		header->magic = ShmRingHeader::MAGIC;
+		return true;
+	}
+
+	//consumers of a segment left under segmentName open the name again once they drained it
+	static void retire(const std::string& segmentName) {
+		int fd = shm_open(segmentName.c_str(), O_RDWR, 0);
+		if (fd < 0)
+			return;
+		struct stat info;
+		if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(ShmRingHeader)) {
+			void* memory = mmap(NULL, sizeof(ShmRingHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (memory != MAP_FAILED) {
+				ShmRingHeader* stale = (ShmRingHeader*)memory;
+				if (stale->magic == ShmRingHeader::MAGIC && stale->version == ShmRingHeader::VERSION)
+					stale->replaced.store(1, std::memory_order_release);
+				munmap(memory, sizeof(ShmRingHeader));
+			}
+		}
+		::close(fd);
+	}
+
+	bool map(int fd, size_t size) {
+		void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (memory == MAP_FAILED)
+			return false;
+		header = (ShmRingHeader*)memory;
+		mapped = size;
+		return true;
+	}
+
+	ShmFrameHeader* frameHeader(uint64_t index) const {
+		return (ShmFrameHeader*)((unsigned char*)header + header->slotOffset + (index % header->slotCount) * header->slotBytes);
+	}
+};
+#endif
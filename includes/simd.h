@@ -0,0 +1,131 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include<cmath>
+
+#if defined(__AVX__)
+#include<immintrin.h>
+#endif
+
+/*
+Eight float lanes, one per pixel of a batch.
+With AVX every operation is a single instruction; otherwise the lanes are a plain array
+and the loops are simple enough for the compiler to vectorize with whatever it targets.
+Comparisons return lanes of all ones or all zeros for select().
+*/
+struct Float8 {
+	static const int WIDTH = 8;
+
+#if defined(__AVX__)
+	__m256 v;
+
+	Float8() {}
+	Float8(float s) : v(_mm256_set1_ps(s)) {}
+	Float8(__m256 m) : v(m) {}
+
+	static Float8 load(const float* p) { return Float8(_mm256_loadu_ps(p)); }
+	void store(float* p) const { _mm256_storeu_ps(p, v); }
+
+	friend Float8 operator+(Float8 a, Float8 b) { return Float8(_mm256_add_ps(a.v, b.v)); }
+	friend Float8 operator-(Float8 a, Float8 b) { return Float8(_mm256_sub_ps(a.v, b.v)); }
+	friend Float8 operator*(Float8 a, Float8 b) { return Float8(_mm256_mul_ps(a.v, b.v)); }
+	friend Float8 operator/(Float8 a, Float8 b) { return Float8(_mm256_div_ps(a.v, b.v)); }
+	friend Float8 operator>(Float8 a, Float8 b) { return Float8(_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)); }
+	friend Float8 min(Float8 a, Float8 b) { return Float8(_mm256_min_ps(a.v, b.v)); }
+	friend Float8 max(Float8 a, Float8 b) { return Float8(_mm256_max_ps(a.v, b.v)); }
+	friend Float8 sqrt(Float8 a) { return Float8(_mm256_sqrt_ps(a.v)); }
+	friend Float8 floor(Float8 a) { return Float8(_mm256_floor_ps(a.v)); }
+	//mask ? a : b
+	friend Float8 select(Float8 mask, Float8 a, Float8 b) { return Float8(_mm256_blendv_ps(b.v, a.v, mask.v)); }
+#else
+	float v[WIDTH];
+
+	Float8() {}
+	Float8(float s) {
+		for (int i = 0; i < WIDTH; ++i)
+			v[i] = s;
+	}
+
+	static Float8 load(const float* p) {
+		Float8 r;
+		for (int i = 0; i < WIDTH; ++i)
+			r.v[i] = p[i];
+		return r;
+	}
+	void store(float* p) const {
+		for (int i = 0; i < WIDTH; ++i)
+			p[i] = v[i];
+	}
+
+#define FLOAT8_BINARY(name, expr) \
+	friend Float8 name(Float8 a, Float8 b) { \
+		Float8 r; \
+		for (int i = 0; i < WIDTH; ++i) \
+			r.v[i] = expr; \
+		return r; \
+	}
+	FLOAT8_BINARY(operator+, a.v[i] + b.v[i])
+	FLOAT8_BINARY(operator-, a.v[i] - b.v[i])
+	FLOAT8_BINARY(operator*, a.v[i] * b.v[i])
+	FLOAT8_BINARY(operator/, a.v[i] / b.v[i])
+	FLOAT8_BINARY(min, a.v[i] < b.v[i] ? a.v[i] : b.v[i])
+	FLOAT8_BINARY(max, a.v[i] > b.v[i] ? a.v[i] : b.v[i])
+#undef FLOAT8_BINARY
+	friend Float8 operator>(Float8 a, Float8 b) {
+		Float8 r;
+		for (int i = 0; i < WIDTH; ++i)
+			r.v[i] = a.v[i] > b.v[i] ? 1.0f : 0.0f;
+		return r;
+	}
+	friend Float8 sqrt(Float8 a) {
+		Float8 r;
+		for (int i = 0; i < WIDTH; ++i)
+			r.v[i] = std::sqrt(a.v[i]);
+		return r;
+	}
+	friend Float8 floor(Float8 a) {
+		Float8 r;
+		for (int i = 0; i < WIDTH; ++i)
+			r.v[i] = std::floor(a.v[i]);
+		return r;
+	}
+	friend Float8 select(Float8 mask, Float8 a, Float8 b) {
+		Float8 r;
+		for (int i = 0; i < WIDTH; ++i)
+			r.v[i] = mask.v[i] != 0.0f ? a.v[i] : b.v[i];
+		return r;
+	}
+#endif
+
+	float operator[](int i) const {
+		float lanes[WIDTH];
+		store(lanes);
+		return lanes[i];
+	}
+
+	Float8& operator+=(Float8 b) { return *this = *this + b; }
+	Float8& operator*=(Float8 b) { return *this = *this * b; }
+};
+
+//three Float8, structure of arrays for 8 vectors
+struct Vec8 {
+	Float8 x, y, z;
+
+	Vec8() {}
+	Vec8(Float8 x, Float8 y, Float8 z) : x(x), y(y), z(z) {}
+
+	friend Vec8 operator+(const Vec8& a, const Vec8& b) { return Vec8(a.x + b.x, a.y + b.y, a.z + b.z); }
+	friend Vec8 operator-(const Vec8& a, const Vec8& b) { return Vec8(a.x - b.x, a.y - b.y, a.z - b.z); }
+	friend Vec8 operator*(const Vec8& a, const Vec8& b) { return Vec8(a.x * b.x, a.y * b.y, a.z * b.z); }
+	friend Vec8 operator*(const Vec8& a, Float8 s) { return Vec8(a.x * s, a.y * s, a.z * s); }
+	Vec8& operator+=(const Vec8& b) { return *this = *this + b; }
+};
+
+inline Float8 dot(const Vec8& a, const Vec8& b) {
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+inline Vec8 normalize(const Vec8& a) {
+	Float8 inv = Float8(1.0f) / sqrt(dot(a, a));
+	return a * inv;
+}
+#endif
@@ -0,0 +1,86 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include<cstdio>
+#include<cmath>
+#include<string>
+#include<vector>
+#include<algorithm>
+#include<iostream>
+
+#include "image_metrics.h"
+
+/*
+One setting of the RSM quality/cost sweep, averaged over the measured views.
+Error is measured against a high-sample reference render of the same view.
+*/
+struct SweepPoint {
+	int sampleNum;
+	float sampleRadius;
+	int rsmSize;
+	bool halfFormat;
+	double frameMs;
+	double psnr;
+	double flip;
+	int views;
+	bool pareto;
+
+	SweepPoint(int sampleNum, float sampleRadius, int rsmSize, bool halfFormat) : sampleNum(sampleNum), sampleRadius(sampleRadius),
+		rsmSize(rsmSize), halfFormat(halfFormat), frameMs(0.0), psnr(0.0), flip(0.0), views(0), pareto(false) {}
+
+	//pixels are RGBA8, rows top to bottom
+	void addView(double ms, const unsigned char* pixels, const unsigned char* reference, int width, int height) {
+		std::vector<unsigned char> rgb((size_t)width * height * 3), referenceRgb(rgb.size());
+		for (size_t i = 0; i < (size_t)width * height; ++i)
+			for (int c = 0; c < 3; ++c) {
+				rgb[i * 3 + c] = pixels[i * 4 + c];
+				referenceRgb[i * 3 + c] = reference[i * 4 + c];
+			}
+		ImageDiff diff = compareImages(rgb.data(), referenceRgb.data(), width, height);
+		//identical images would make the mean infinite
+		double viewPsnr = std::min(diff.psnr, 99.0);
+		++views;
+		frameMs += (ms - frameMs) / views;
+		psnr += (viewPsnr - psnr) / views;
+		flip += (diff.flip - flip) / views;
+	}
+};
+
+//a point is on the frontier when no other point is both as fast and as accurate and better in one of them
+inline void markPareto(std::vector<SweepPoint>& points) {
+	for (size_t i = 0; i < points.size(); ++i) {
+		points[i].pareto = true;
+		for (size_t j = 0; j < points.size() && points[i].pareto; ++j) {
+			const SweepPoint& a = points[i];
+			const SweepPoint& b = points[j];
+			if (b.frameMs <= a.frameMs && b.flip <= a.flip && (b.frameMs < a.frameMs || b.flip < a.flip))
+				points[i].pareto = false;
+		}
+	}
+}
+
+//writes every point sorted by frame time and prints the frontier, false if the file can't be written
+inline bool writeSweepCSV(const std::string& path, std::vector<SweepPoint>& points) {
+	markPareto(points);
+	std::sort(points.begin(), points.end(), [](const SweepPoint& a, const SweepPoint& b) { return a.frameMs < b.frameMs; });
+	FILE* file = std::fopen(path.c_str(), "w");
+	if (file == NULL) {
+		std::cout << "ERROR::SWEEP::WRITE_FAILED " << path << "\n";
+		return false;
+	}
+	std::fprintf(file, "samples,radius,rsm_size,format,frame_ms,psnr,flip,pareto\n");
+	std::printf("Pareto frontier:\n%8s %7s %9s %7s %10s %9s %8s\n", "samples", "radius", "rsm size", "format", "frame ms", "PSNR dB", "FLIP");
+	for (size_t i = 0; i < points.size(); ++i) {
+		const SweepPoint& p = points[i];
+		const char* format = p.halfFormat ? "half" : "full";
+		std::fprintf(file, "%d,%.3f,%d,%s,%.4f,%.3f,%.5f,%d\n", p.sampleNum, p.sampleRadius, p.rsmSize, format,
+			p.frameMs, p.psnr, p.flip, p.pareto ? 1 : 0);
+		if (p.pareto)
+			std::printf("%8d %7.3f %9d %7s %10.3f %9.2f %8.4f\n", p.sampleNum, p.sampleRadius, p.rsmSize, format, p.frameMs, p.psnr, p.flip);
+	}
+	bool written = std::fclose(file) == 0;
+	if (!written)
+		std::cout << "ERROR::SWEEP::WRITE_FAILED " << path << "\n";
+	return written;
+}
+#endif
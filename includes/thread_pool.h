@@ -0,0 +1,132 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include<vector>
+#include<deque>
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<atomic>
+#include<functional>
+
+/*
+Work-stealing pool for data-parallel loops.
+parallelFor splits the index range into one contiguous block per queue, so neighbouring
+items (image tiles, probes) stay on one thread. Every thread pops from the front of its
+own queue and, once that is empty, steals from the back of the others, which balances
+tiles of very different cost without a shared queue every item has to pass through.
+The calling thread works on a queue of its own while it waits.
+*/
+class ThreadPool {
+public:
+	//threadCount 0 uses one thread per hardware thread, the caller included
+	explicit ThreadPool(int threadCount = 0) : queued(0), remaining(0), body(NULL), stopping(false) {
+		if (threadCount <= 0)
+			threadCount = (int)std::thread::hardware_concurrency();
+		if (threadCount <= 0)
+			threadCount = 1;
+		queues = std::vector<WorkQueue>(threadCount);
+		for (int i = 1; i < threadCount; ++i)
+			workers.push_back(std::thread(&ThreadPool::workLoop, this, i));
+	}
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		workAvailable.notify_all();
+		for (size_t i = 0; i < workers.size(); ++i)
+			workers[i].join();
+	}
+
+	int size() const {
+		return (int)queues.size();
+	}
+
+	//run work(i) for every i in [0, count) and return once all calls finished
+	void parallelFor(int count, const std::function<void(int)>& work) {
+		if (count <= 0)
+			return;
+		body = &work;
+		remaining = count;
+		//counted before any item is visible: a worker still leaving drain() may take one at once
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queued = count;
+		}
+		int queueCount = (int)queues.size();
+		for (int q = 0; q < queueCount; ++q) {
+			std::lock_guard<std::mutex> lock(queues[q].mutex);
+			for (int i = (int)((long long)count * q / queueCount); i < (int)((long long)count * (q + 1) / queueCount); ++i)
+				queues[q].items.push_back(i);
+		}
+		workAvailable.notify_all();
+
+		drain(0);
+		std::unique_lock<std::mutex> lock(mutex);
+		workDone.wait(lock, [this] { return remaining == 0; });
+		body = NULL;
+	}
+
+private:
+	struct WorkQueue {
+		std::mutex mutex;
+		std::deque<int> items;
+	};
+
+	std::vector<WorkQueue> queues;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable workAvailable, workDone;
+	std::atomic<int> queued;		//items not yet taken from a queue
+	std::atomic<int> remaining;		//items not yet finished
+	const std::function<void(int)>* body;
+	bool stopping;
+
+	void workLoop(int self) {
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				workAvailable.wait(lock, [this] { return stopping || queued > 0; });
+				if (stopping)
+					return;
+			}
+			drain(self);
+		}
+	}
+
+	//run items of the own queue, then steal until every queue is empty
+	void drain(int self) {
+		int item;
+		while (pop(self, item) || steal(self, item)) {
+			--queued;
+			(*body)(item);
+			if (--remaining == 0) {
+				std::lock_guard<std::mutex> lock(mutex);
+				workDone.notify_all();
+			}
+		}
+	}
+	bool pop(int q, int& item) {
+		std::lock_guard<std::mutex> lock(queues[q].mutex);
+		if (queues[q].items.empty())
+			return false;
+		item = queues[q].items.front();
+		queues[q].items.pop_front();
+		return true;
+	}
+	bool steal(int self, int& item) {
+		int queueCount = (int)queues.size();
+		for (int i = 1; i < queueCount; ++i) {
+			WorkQueue& victim = queues[(self + i) % queueCount];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.items.empty()) {
+				item = victim.items.back();
+				victim.items.pop_back();
+				return true;
+			}
+		}
+		return false;
+	}
+};
+#endif
@@ -0,0 +1,265 @@
+#ifndef TILE_FARM_H
+#define TILE_FARM_H
+
+#include<glm/glm.hpp>
+
+#include<sys/types.h>
+#include<sys/socket.h>
+#include<sys/wait.h>
+#include<poll.h>
+#include<signal.h>
+#include<unistd.h>
+#include<cerrno>
+#include<cstring>
+#include<vector>
+#include<iostream>
+#include<algorithm>
+#include<functional>
+
+/*
+Offline frame split into tiles rendered by forked worker processes.
+The coordinator forks the workers after the scene is built, so they share it copy on
+write, and talks to each over its own Unix socket pair: it sends a tile index, the
+worker answers with the index and the tile's pixels. Tiles are handed out on demand,
+so a worker that drew cheap tiles just takes more of them. Once every tile is out,
+an idle worker steals the oldest tile still in flight and renders a second copy; the
+first copy to arrive is kept, so one slow tile does not hold up the end of the frame.
+Tiles must render deterministically for the copies to agree.
+A worker exits when its socket closes; one still busy when the frame is complete is
+killed. Only the calling thread survives a fork, so
+the coordinator must not hold other threads' locks and workers start their own pools.
+*/
+class TileFarm {
+public:
+	//pixels x0..x1-1 and y0..y1-1 in window coordinates, rows from the bottom like GL's
+	struct Tile {
+		int x0, y0, x1, y1;
+
+		int width() const { return x1 - x0; }
+		int height() const { return y1 - y0; }
+	};
+	//renders one tile into RGBA8 pixels, rows top to bottom
+	typedef std::function<void(const Tile&, std::vector<unsigned char>&)> TileRenderer;
+
+	int width, height;
+	std::vector<Tile> tiles;
+	std::vector<int> workerTiles;	//tiles each worker delivered first
+	int stolen;						//tiles rendered twice
+
+	//tile origins are multiples of tileSize from the bottom left corner
+	TileFarm(int imageWidth, int imageHeight, int tileSize) : width(imageWidth), height(imageHeight), stolen(0) {
+		for (int y = 0; y < height; y += tileSize)
+			for (int x = 0; x < width; x += tileSize) {
+				Tile tile = { x, y, std::min(x + tileSize, width), std::min(y + tileSize, height) };
+				tiles.push_back(tile);
+			}
+	}
+
+	//maps the tile to the whole viewport, applied after the frame's projection, so a
+	//tile-sized render hits the same pixel centers as the full frame
+	glm::mat4 tileProjection(const Tile& tile) const {
+		glm::mat4 m(1.0f);
+		m[0][0] = (float)width / tile.width();
+		m[1][1] = (float)height / tile.height();
+		m[3][0] = (float)(width - 2 * tile.x0) / tile.width() - 1.0f;
+		m[3][1] = (float)(height - 2 * tile.y0) / tile.height() - 1.0f;
+		return m;
+	}
+
+	//startWorker runs once in every worker and returns its tile renderer; image gets
+	//RGBA8 rows top to bottom, false if the workers could not be started or all died
+	bool render(int workerCount, const std::function<TileRenderer()>& startWorker, std::vector<unsigned char>& image) {
+		image.assign((size_t)width * height * 4, 0);
+		workerTiles.assign(workerCount, 0);
+		stolen = 0;
+		std::vector<Worker> workers;
+		for (int w = 0; w < workerCount; ++w) {
+			int sockets[2];
+			if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0) {
+				std::cout << "ERROR::TILE_FARM::SOCKET_FAILED " << std::strerror(errno) << "\n";
+				stop(workers);
+				return false;
+			}
+			std::cout.flush();
+			pid_t pid = fork();
+			if (pid == 0) {
+				close(sockets[0]);
+				for (size_t i = 0; i < workers.size(); ++i)
+					close(workers[i].socket);
+				serve(sockets[1], startWorker);
+				_exit(0);
+			}
+			close(sockets[1]);
+			if (pid < 0) {
+				std::cout << "ERROR::TILE_FARM::FORK_FAILED " << std::strerror(errno) << "\n";
+				close(sockets[0]);
+				stop(workers);
+				return false;
+			}
+			Worker worker = { pid, sockets[0], -1 };
+			workers.push_back(worker);
+		}
+
+		std::vector<int> copies(tiles.size(), 0), issued(tiles.size(), 0);
+		std::vector<bool> done(tiles.size(), false);
+		std::vector<int> retry;
+		size_t next = 0;
+		int remaining = (int)tiles.size(), alive = workerCount, issue = 0;
+		std::vector<unsigned char> pixels;
+		while (remaining > 0 && alive > 0) {
+			for (size_t w = 0; w < workers.size(); ++w) {
+				Worker& worker = workers[w];
+				if (worker.socket < 0 || worker.tile >= 0)
+					continue;
+				int tile = -1;
+				if (!retry.empty()) {
+					tile = retry.back();
+					retry.pop_back();
+				}
+				else if (next < tiles.size())
+					tile = (int)next++;
+				else
+					tile = oldestSingleCopy(copies, issued, done);
+				if (tile < 0)
+					break;
+				int message = tile;
+				if (!writeAll(worker.socket, &message, sizeof(message))) {
+					lose(worker, copies, done, retry, alive);
+					continue;
+				}
+				if (++copies[tile] == 2)
+					++stolen;
+				issued[tile] = issue++;
+				worker.tile = tile;
+			}
+
+			std::vector<pollfd> polls;
+			std::vector<int> polled;
+			for (size_t w = 0; w < workers.size(); ++w)
+				if (workers[w].socket >= 0 && workers[w].tile >= 0) {
+					pollfd entry = { workers[w].socket, POLLIN, 0 };
+					polls.push_back(entry);
+					polled.push_back((int)w);
+				}
+			if (polls.empty())
+				break;
+			if (poll(polls.data(), polls.size(), -1) < 0) {
+				if (errno == EINTR)
+					continue;
+				std::cout << "ERROR::TILE_FARM::POLL_FAILED " << std::strerror(errno) << "\n";
+				break;
+			}
+			for (size_t p = 0; p < polls.size(); ++p) {
+				if (polls[p].revents == 0)
+					continue;
+				Worker& worker = workers[polled[p]];
+				int tile;
+				const Tile& expected = tiles[worker.tile];
+				pixels.resize((size_t)expected.width() * expected.height() * 4);
+				if (!readAll(worker.socket, &tile, sizeof(tile)) || tile != worker.tile || !readAll(worker.socket, pixels.data(), pixels.size())) {
+					lose(worker, copies, done, retry, alive);
+					continue;
+				}
+				--copies[tile];
+				worker.tile = -1;
+				if (done[tile])
+					continue;
+				done[tile] = true;
+				--remaining;
+				++workerTiles[polled[p]];
+				stitch(tiles[tile], pixels, image);
+			}
+		}
+		stop(workers);
+		if (remaining > 0)
+			std::cout << "ERROR::TILE_FARM::WORKERS_FAILED " << remaining << " tiles left\n";
+		return remaining == 0;
+	}
+
+private:
+	struct Worker {
+		pid_t pid;
+		int socket;		//-1 once lost
+		int tile;		//in flight, -1 when idle or lost
+	};
+
+	//the tile nobody else copied that went out first, -1 if there is none
+	int oldestSingleCopy(const std::vector<int>& copies, const std::vector<int>& issued, const std::vector<bool>& done) const {
+		int oldest = -1;
+		for (size_t t = 0; t < tiles.size(); ++t)
+			if (!done[t] && copies[t] == 1 && (oldest < 0 || issued[t] < issued[oldest]))
+				oldest = (int)t;
+		return oldest;
+	}
+
+	//a worker died or hung up, its tile goes back to the others unless a copy is still out
+	void lose(Worker& worker, std::vector<int>& copies, const std::vector<bool>& done, std::vector<int>& retry, int& alive) const {
+		std::cout << "ERROR::TILE_FARM::WORKER_LOST " << worker.pid << "\n";
+		if (worker.tile >= 0 && --copies[worker.tile] == 0 && !done[worker.tile])
+			retry.push_back(worker.tile);
+		close(worker.socket);
+		worker.socket = -1;
+		worker.tile = -1;
+		--alive;
+	}
+
+	void stitch(const Tile& tile, const std::vector<unsigned char>& pixels, std::vector<unsigned char>& image) const {
+		size_t rowBytes = (size_t)tile.width() * 4;
+		for (int row = 0; row < tile.height(); ++row)
+			std::memcpy(&image[((size_t)(height - tile.y1 + row) * width + tile.x0) * 4], &pixels[row * rowBytes], rowBytes);
+	}
+
+	//an idle worker exits when its socket closes; one still rendering the losing copy of a stolen
+	//tile, or already lost, is killed so the frame does not wait for it
+	static void stop(std::vector<Worker>& workers) {
+		for (size_t w = 0; w < workers.size(); ++w) {
+			if (workers[w].socket < 0 || workers[w].tile >= 0)
+				kill(workers[w].pid, SIGKILL);
+			if (workers[w].socket >= 0)
+				close(workers[w].socket);
+		}
+		for (size_t w = 0; w < workers.size(); ++w)
+			waitpid(workers[w].pid, NULL, 0);
+	}
+
+	void serve(int socket, const std::function<TileRenderer()>& startWorker) const {
+		TileRenderer renderTile = startWorker();
+		std::vector<unsigned char> pixels;
+		int tile;
+		while (readAll(socket, &tile, sizeof(tile)) && tile >= 0 && tile < (int)tiles.size()) {
+			renderTile(tiles[tile], pixels);
+			if (!writeAll(socket, &tile, sizeof(tile)) || !writeAll(socket, pixels.data(), pixels.size()))
+				break;
+		}
+		close(socket);
+	}
+
+	static bool readAll(int socket, void* data, size_t size) {
+		char* bytes = (char*)data;
+		while (size > 0) {
+			ssize_t n = recv(socket, bytes, size, 0);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return false;
+			bytes += n;
+			size -= n;
+		}
+		return true;
+	}
+	//no SIGPIPE when the other side is gone
+	static bool writeAll(int socket, const void* data, size_t size) {
+		const char* bytes = (const char*)data;
+		while (size > 0) {
+			ssize_t n = send(socket, bytes, size, MSG_NOSIGNAL);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return false;
+			bytes += n;
+			size -= n;
+		}
+		return true;
+	}
+};
+#endif
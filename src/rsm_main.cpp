@@ -1,6 +1,9 @@
 #include <random>
 #include <ctime>
 #include <cmath>
+#include <chrono>
+#include <memory>
+#include <thread>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -10,17 +13,121 @@
 
 #include "camera.h"
 #include "shader.h"
+#include "scene.h"
+#include "occlusion_culler.h"
+#include "ring_buffer.h"
+#include "frame_capture.h"
+#include "options.h"
+#include "cpu_renderer.h"
+#include "regression.h"
+#include "rsm_targets.h"
+#include "sweep.h"
+#include "sample_sets.h"
+#include "blue_noise.h"
+#include "irradiance_cache.h"
+#include "lpv.h"
+#include "probe_grid.h"
+#include "lightmap.h"
+#include "ism.h"
+#include "render_target_pool.h"
+#include "render_graph.h"
+#include "gpu_memory.h"
+#include "scene_targets.h"
+#include "dynamic_resolution.h"
+#include "camera_poses.h"
+#include "tile_farm.h"
+#include "frame_pacer.h"
 
 const float PI = 3.14159265358979;
 
 const int enable_debug = 0;
+const int enable_occlusion_culling = 1;
+//depth-only pass first so the RSM gather runs once per pixel
+const int enable_depth_prepass = 1;
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+//framebuffer size of the window, presented to and used for the aspect at once; the targets follow
+//once it stayed the same for RESIZE_DEBOUNCE seconds, not on every step of a drag
+const float RESIZE_DEBOUNCE = 0.2f;
+int framebuffer_width = SCR_WIDTH;
+int framebuffer_height = SCR_HEIGHT;
+float resize_time = 0.0f;
+//size the targets were made for, the headless views keep SCR_WIDTH x SCR_HEIGHT
+int output_width = SCR_WIDTH;
+int output_height = SCR_HEIGHT;
+//size of the camera passes, below the output's when the dynamic resolution scales it down
+int render_width = SCR_WIDTH;
+int render_height = SCR_HEIGHT;
 
-const unsigned int MAX_SAMPLE_NUM = 512;
-const float MAX_SAMPLE_RADIUS = 0.3;
+//size of the sample texture, the upper bound of sample_num
+const unsigned int MAX_SAMPLE_NUM = SAMPLE_TABLE_SIZE;
+
+//RSM quality settings, set from the command line
+int sample_num;
+float sample_radius;
+int rsm_size;
+bool rsm_half_format;
+
+//per-pixel rotation of the samples, the tile is animated by a golden ratio sequence
+const int BLUE_NOISE_SIZE = 64;
+const float GOLDEN_RATIO_CONJUGATE = 0.618034f;
+bool blue_noise;
+bool animate_noise = false;
+unsigned int frame_index = 0;
+
+//adaptive gather: after every batch a pixel stops once its error estimate is below the threshold
+const int ADAPTIVE_BATCH = 32;
+bool adaptive_sampling;
+float adaptive_threshold;
+
+//indirect term source of result_shader
+const int INDIRECT_GATHER = 0;
+const int INDIRECT_CACHE = 1;
+const int INDIRECT_LPV = 2;
+const int INDIRECT_PROBES = 3;
+const int INDIRECT_LIGHTMAP = 4;
+bool irradiance_cache;
+bool light_propagation;
+int lpv_iterations;
+float lpv_intensity;
+bool irradiance_probes;
+int probe_grid;
+float probe_intensity;
+//baked offline for the startup light, bound to unit 12 which only the LPV update uses otherwise
+bool use_lightmap;
+const int LIGHTMAP_UNIT = 12;
+//indirect shadows of the per-pixel gather, the map is bound to the second LPV source unit
+bool imperfect_shadows;
+float ism_bias;
+const int ISM_UNIT = 13;
+//batch views after the first keep the RSM and what is derived from it, the light does not move between them
+bool reuse_light = false;
+
+//fixed cameras of the image regression, rendered with a fixed sample seed
+struct Viewpoint {
+	const char* name;
+	glm::vec3 position;
+	float yaw, pitch;
+};
+const Viewpoint REGRESSION_VIEWS[] = {
+	{ "default", glm::vec3(-4.0f, 3.0f, 4.0f), -90.0f, 0.0f },
+	{ "overview", glm::vec3(2.0f, 5.0f, 9.0f), -120.0f, -30.0f },
+	{ "corner", glm::vec3(-4.5f, 1.0f, 4.5f), -45.0f, 15.0f },
+	{ "floor", glm::vec3(-2.5f, 4.5f, 3.5f), -90.0f, -70.0f }
+};
+const int REGRESSION_VIEW_COUNT = sizeof(REGRESSION_VIEWS) / sizeof(REGRESSION_VIEWS[0]);
+const unsigned int REGRESSION_SEED = 1;
+//headless GPU views are timed over several frames after a warm-up
+const int HEADLESS_WARMUP_FRAMES = 3;
+const int HEADLESS_TIMED_FRAMES = 5;
+
+//parameter grid of the quality/cost sweep, measured on the regression views
+const int SWEEP_SAMPLE_NUMS[] = { 16, 32, 64, 128, 256, 512, 1024 };
+const float SWEEP_SAMPLE_RADII[] = { 0.1f, 0.2f, 0.3f };
+const int SWEEP_RSM_SIZES[] = { 256, 512, 1024 };
+const int SWEEP_REFERENCE_RSM_SIZE = 2048;
 
 //Camera
 Camera camera(glm::vec3(-4.0f, 3.0f, 4.0f));
@@ -34,21 +141,31 @@ glm::vec3 lightPos = glm::vec3(-8.0f, 6.0f, 6.0f);
 glm::vec3 light_diffuse = glm::vec3(0.6f, 0.6f, 0.6f);
 float light_near_plane = 0.5f;
 float light_far_plane = 20.0f;
+float light_radius = 20.0f;
+
+Scene scene;
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow* window);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
 
-GLuint createRandomTexture(int size);
+std::vector<glm::vec3> createRandomSamples(int size, unsigned int seed);
+std::vector<glm::vec3> createSamples(const std::string& set, unsigned int seed);
+GLuint createRandomTexture(const std::vector<glm::vec3>& samples);
+GLuint createBlueNoiseTexture(const std::vector<float>& noise);
+void readTexture(GLuint texture, int width, int height, std::vector<glm::vec3>& texels);
+RenderParams currentRenderParams();
+void setViewpoint(const Viewpoint& view);
+int renderCpu(const Options& options);
+int renderCpuTiled(const Options& options, const Lightmap& lightmap);
 
 class Planes {
-	unsigned int groundvao, backwallvao, rightwallvao;
-	unsigned int groundvbo, backwallvbo, rightwallvbo;
-	unsigned int groundebo, backwallebo, rightwallebo;
+	int ground, backwall, rightwall;
 
 public:
-	Planes() {
+	Planes(SceneGeometry& geometry) {
 		float ground_vertices[] = {
 			//position           //normal
 			 0.0f,  0.0f,  0.0f,  0.0f, 1.0f, 0.0f,
@@ -74,65 +191,21 @@ public:
 			0, 1, 3,
 			1, 2, 3
 		};
-		//ground
-		glGenVertexArrays(1, &groundvao);
-		glGenBuffers(1, &groundvbo);
-		glGenBuffers(1, &groundebo);
-		glBindVertexArray(groundvao);
-		glBindBuffer(GL_ARRAY_BUFFER, groundvbo);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(ground_vertices), ground_vertices, GL_STATIC_DRAW);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-		glEnableVertexAttribArray(1);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, groundebo);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(plane_ebo), plane_ebo, GL_STATIC_DRAW);
-		//backwall
-		glGenVertexArrays(1, &backwallvao);
-		glGenBuffers(1, &backwallvbo);
-		glGenBuffers(1, &backwallebo);
-		glBindVertexArray(backwallvao);
-		glBindBuffer(GL_ARRAY_BUFFER, backwallvbo);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(backwall_vertices), backwall_vertices, GL_STATIC_DRAW);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-		glEnableVertexAttribArray(1);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, backwallebo);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(plane_ebo), plane_ebo, GL_STATIC_DRAW);
-		//rightwall
-		glGenVertexArrays(1, &rightwallvao);
-		glGenBuffers(1, &rightwallvbo);
-		glGenBuffers(1, &rightwallebo);
-		glBindVertexArray(rightwallvao);
-		glBindBuffer(GL_ARRAY_BUFFER, rightwallvbo);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(rightwall_vertices), rightwall_vertices, GL_STATIC_DRAW);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-		glEnableVertexAttribArray(1);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, rightwallebo);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(plane_ebo), plane_ebo, GL_STATIC_DRAW);
+		ground = geometry.addMesh(ground_vertices, 4, plane_ebo, 6);
+		backwall = geometry.addMesh(backwall_vertices, 4, plane_ebo, 6);
+		rightwall = geometry.addMesh(rightwall_vertices, 4, plane_ebo, 6);
 	}
-	void draw(Shader& shader) {
-		shader.use();
+	void addTo(Scene& scene) {
 		glm::mat4 model = glm::mat4(1.0f);
-		shader.setMat4("model", model);
-		glBindVertexArray(groundvao);
-		shader.setVec3("material.diffuse", 0.0f, 0.0f, 0.8f);
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-		glBindVertexArray(backwallvao);
-		shader.setVec3("material.diffuse", 0.0f, 0.8f, 0.0f);
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-		glBindVertexArray(rightwallvao);
-		shader.setVec3("material.diffuse", 0.8f, 0.0f, 0.0f);
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+		scene.add(ground, model, glm::vec3(0.0f, 0.0f, 0.8f));
+		scene.add(backwall, model, glm::vec3(0.0f, 0.8f, 0.0f));
+		scene.add(rightwall, model, glm::vec3(0.8f, 0.0f, 0.0f));
 	}
 };
 class CubeFrame {
-	unsigned int vao, vbo;
+	int mesh;
 public:
-	CubeFrame() {
+	CubeFrame(SceneGeometry& geometry) {
 		float vertices[] = {
 			 0.0f,  0.0f,  0.0f,  0.0f, -1.0f,  0.0f,
 			 0.0f,  0.0f, 0.25f,  0.0f, -1.0f,  0.0f,
@@ -176,52 +249,34 @@ public:
 			0.25f,  2.0f,  0.0f,  0.0f,  1.0f,  0.0f,
 			 0.0f,  2.0f,  0.0f,  0.0f,  1.0f,  0.0f
 		};
-		glGenVertexArrays(1, &vao);
-		glGenBuffers(1, &vbo);
-		glBindVertexArray(vao);
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-		glEnableVertexAttribArray(1);
+		mesh = geometry.addMesh(vertices, 36, NULL, 0);
 	}
-	void draw(Shader& shader) {
-		shader.use();
-		shader.setVec3("material.diffuse", 0.8f, 0.8f, 0.8f);
-		glBindVertexArray(vao);
+	void addTo(Scene& scene) {
+		glm::vec3 diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
 		glm::mat4 model = glm::mat4(1.0f);
 		model = glm::translate(model, glm::vec3(-1.0f, 0.0f, 1.0f));
 		model = glm::translate(model, glm::vec3(-3.0f, 0.0f, 3.0f));
-		shader.setMat4("model", model);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
+		scene.add(mesh, model, diffuse);
 		model = glm::translate(model, glm::vec3(1.75f, 0.0f, 0.0f));
-		shader.setMat4("model", model);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
+		scene.add(mesh, model, diffuse);
 		model = glm::translate(model, glm::vec3(0.0f, 0.0f, -2.0f));
-		shader.setMat4("model", model);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
+		scene.add(mesh, model, diffuse);
 		model = glm::translate(model, glm::vec3(-1.75f, 0.0f, 0.0f));
-		shader.setMat4("model", model);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
+		scene.add(mesh, model, diffuse);
 		model = glm::mat4(1.0f);
 		model = glm::translate(model, glm::vec3(-1.0f, 0.0f, 1.0f));
 		model = glm::translate(model, glm::vec3(-1.0f, 2.0f, 1.0f));
 		glm::mat4 rotate = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-		shader.setMat4("model", rotate);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
+		scene.add(mesh, rotate, diffuse);
 		model = glm::translate(model, glm::vec3(0.0f, 0.0f, 2.0f));
 		rotate = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-		shader.setMat4("model", rotate);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
+		scene.add(mesh, rotate, diffuse);
 		model = glm::translate(model, glm::vec3(-0.25f, 0.0f, 0.0f));
 		rotate = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-		shader.setMat4("model", rotate);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
+		scene.add(mesh, rotate, diffuse);
 		model = glm::translate(model, glm::vec3(-1.75f, 0.0f, 0.0f));
 		rotate = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-		shader.setMat4("model", rotate);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
+		scene.add(mesh, rotate, diffuse);
 	}
 };
 class Debug {
@@ -239,7 +294,7 @@ public:
 		glGenBuffers(1, &vbo);
 		glBindVertexArray(vao);
 		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(debugVertices), debugVertices, GL_STATIC_DRAW);
+		gpuBufferData(MEMORY_GEOMETRY, GL_ARRAY_BUFFER, sizeof(debugVertices), debugVertices, GL_STATIC_DRAW);
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
@@ -253,19 +308,63 @@ public:
 	}
 };
 
-int main() {
+int main(int argc, char** argv) {
+	Options options;
+	if (!parseOptions(argc, argv, options))
+		return -1;
+	sample_num = options.sampleNum;
+	sample_radius = options.sampleRadius;
+	rsm_size = options.rsmSize;
+	rsm_half_format = options.rsmHalfFormat;
+	blue_noise = options.blueNoise;
+	adaptive_sampling = options.adaptive;
+	adaptive_threshold = options.adaptiveThreshold;
+	irradiance_cache = options.irradianceCache;
+	light_propagation = options.lpv;
+	lpv_iterations = options.lpvIterations;
+	lpv_intensity = options.lpvIntensity;
+	irradiance_probes = options.probes;
+	probe_grid = options.probeGrid;
+	probe_intensity = options.probeIntensity;
+	use_lightmap = !options.lightmap.empty();
+	imperfect_shadows = options.ism;
+	ism_bias = options.ismBias;
+	if (!options.cpuOutput.empty() || options.regressCpu || !options.bakeLightmap.empty())
+		return renderCpu(options);
+	bool regress = !options.regressDir.empty();
+	std::vector<CameraPose> poses;
+	if (!options.viewsPath.empty() && !readCameraPoses(options.viewsPath, poses))
+		return -1;
+	bool headless = regress || !options.sweepPath.empty() || !poses.empty();
+
 	//initialize glfw
 	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	//GPU-driven culling needs 4.3, fall back to 3.3 without it
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	if (headless)
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Shadow Map", NULL, NULL);
+	if (window == NULL) {
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Shadow Map", NULL, NULL);
+	}
 	if (window == NULL) {
 		std::cout << "Failed to Create glfw window\n";
 		return -1;
 	}
 	glfwMakeContextCurrent(window);
-	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+	//the framebuffer may be larger than the window on high-DPI displays
+	if (!headless) {
+		glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+		glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+		output_width = render_width = framebuffer_width;
+		output_height = render_height = framebuffer_height;
+		if (options.swapInterval >= 0)
+			glfwSwapInterval(options.swapInterval);
+	}
 
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
 		std::cout << "Failed to initialize GLAD\n";
@@ -277,125 +376,203 @@ int main() {
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 	glfwSetCursorPosCallback(window, mouse_callback);
 	glfwSetScrollCallback(window, scroll_callback);
+	glfwSetMouseButtonCallback(window, mouse_button_callback);
 	
 	Shader main_light_shader("./result_shader.vert", "./result_shader.frag");
 	Shader light_space_shader("./lightSpaceShader.vert", "./lightSpaceShader.frag");
 	Shader debug_shader("./debug.vert", "./debug.frag");
+	Shader depth_prepass_shader("./depth_prepass.vert", NULL);
+
+	bool gpu_culling = enable_occlusion_culling && OcclusionCuller::supported();
+	Shader* main_gpu_shader = NULL;
+	Shader* light_space_gpu_shader = NULL;
+	Shader* cull_shader = NULL;
+	Shader* hiz_shader = NULL;
+	Shader* depth_prepass_gpu_shader = NULL;
+	if (gpu_culling) {
+		depth_prepass_gpu_shader = new Shader("./depth_prepass_gpu.vert", NULL);
+		main_gpu_shader = new Shader("./result_shader_gpu.vert", "./result_shader.frag");
+		light_space_gpu_shader = new Shader("./lightSpaceShader_gpu.vert", "./lightSpaceShader.frag");
+		cull_shader = new Shader("./occlusion_cull.comp");
+		hiz_shader = new Shader("./hiz_build.comp");
+	}
+	bool use_cache = irradiance_cache && IrradianceCache::supported();
+	if (irradiance_cache && !use_cache)
+		std::cout << "The irradiance cache needs OpenGL 4.3, gathering per pixel\n";
+	Shader* gbuffer_shader = NULL;
+	Shader* gbuffer_gpu_shader = NULL;
+	Shader* cache_shader = NULL;
+	if (use_cache) {
+		gbuffer_shader = new Shader("./result_shader.vert", "./gbuffer.frag");
+		if (gpu_culling)
+			gbuffer_gpu_shader = new Shader("./result_shader_gpu.vert", "./gbuffer.frag");
+		cache_shader = new Shader("./irradiance_cache.comp");
+	}
+	Shader* lpv_inject_shader = NULL;
+	Shader* lpv_propagate_shader = NULL;
+	if (light_propagation) {
+		lpv_inject_shader = new Shader("./lpv_inject.vert", "./lpv_inject.frag");
+		lpv_propagate_shader = new Shader("./lpv_propagate.vert", "./lpv_propagate.frag");
+	}
+	Shader* ism_shader = NULL;
+	if (imperfect_shadows)
+		ism_shader = new Shader("./ism.vert", NULL);
 
-	Planes planes;
-	CubeFrame cubeFrame;
+	Planes planes(scene.geometry);
+	CubeFrame cubeFrame(scene.geometry);
 	Debug debug;
 
+	//the UVs must exist before the upload, the atlas needs the objects
+	Lightmap lightmap;
+	if (use_lightmap && !lightmap.unwrap(scene.geometry))
+		return -1;
+	scene.geometry.upload();
+	planes.addTo(scene);
+	cubeFrame.addTo(scene);
+	scene.build();
+	if (use_lightmap) {
+		lightmap.pack(scene);
+		if (!lightmap.load(options.lightmap))
+			return -1;
+		lightmap.upload();
+	}
+	std::vector<int> cameraVisible, lightVisible;
+
 
 
 	//创建帧缓冲
-	GLuint rsmFBO;
-	GLuint depthMap, normalMap, worldPosMap, fluxMap;
-	glGenFramebuffers(1, &rsmFBO);
-
-	glBindFramebuffer(GL_FRAMEBUFFER, rsmFBO);
-	const GLuint RSM_WIDTH = 1024, RSM_HEIGHT = 1024;
-	//深度缓存
-	glGenTextures(1, &depthMap); 
-	glBindTexture(GL_TEXTURE_2D, depthMap);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, RSM_WIDTH, RSM_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-	GLfloat depth_borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, depth_borderColor);
-	//法线缓存
-	glGenTextures(1, &normalMap);
-	glBindTexture(GL_TEXTURE_2D, normalMap);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, RSM_WIDTH, RSM_HEIGHT, 0, GL_RGB, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-	GLfloat border_Color[] = { 0.0, 0.0, 0.0, 0.0 };
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, depth_borderColor);
-	//世界坐标缓存
-	glGenTextures(1, &worldPosMap);
-	glBindTexture(GL_TEXTURE_2D, worldPosMap);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, RSM_WIDTH, RSM_HEIGHT, 0, GL_RGB, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, depth_borderColor);
-	//光通量缓存
-	glGenTextures(1, &fluxMap);
-	glBindTexture(GL_TEXTURE_2D, fluxMap);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, RSM_WIDTH, RSM_HEIGHT, 0, GL_RGB, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, depth_borderColor);
-
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, normalMap, 0);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, worldPosMap, 0);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, fluxMap, 0);
-
-	GLenum rsm_draw_buffers[] = {
-	GL_COLOR_ATTACHMENT0,
-	GL_COLOR_ATTACHMENT1,
-	GL_COLOR_ATTACHMENT2
-	};
-	glDrawBuffers(3, rsm_draw_buffers);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	//render targets that change with the settings are recycled through the pool
+	RenderTargetPool targetPool;
+	RSMTargets rsm(targetPool);
+	rsm.create(rsm_size, rsm_size, rsm_half_format);
+
+	//off-screen target of the main pass at the render resolution, its depth feeds the camera Hi-Z
+	SceneTargets sceneTargets(targetPool);
+	sceneTargets.create(render_width, render_height);
+
+	//its G-buffer pass shares the scene depth and replaces the depth pre-pass
+	IrradianceCache cache;
+	if (use_cache) {
+		cache.accuracy = options.cacheAccuracy;
+		cache.init(cache_shader, sceneTargets.depthMap, sceneTargets.width, sceneTargets.height);
+	}
+	LightPropagationVolume lpv;
+	if (light_propagation)
+		lpv.init(lpv_inject_shader, lpv_propagate_shader, LpvLayout::fit(scene));
+	//baked on the CPU from a read back of the RSM
+	ProbeGrid probes;
+	ThreadPool bakePool(irradiance_probes ? options.threads : 1);
+	std::vector<glm::vec3> bakeNormals, bakePositions, bakeFlux;
+	if (irradiance_probes)
+		probes.init(scene, probe_grid);
+	ImperfectShadowMaps shadowMaps;
+	if (imperfect_shadows) {
+		shadowMaps.init(scene);
+		shadowMaps.upload(ism_shader);
+	}
+
+	OcclusionCuller cameraCuller, lightCuller;
+	if (gpu_culling) {
+		cameraCuller.init(scene, cull_shader, hiz_shader, sceneTargets.depthMap, sceneTargets.width, sceneTargets.height);
+		lightCuller.init(scene, cull_shader, hiz_shader, rsm.depthMap, rsm.width, rsm.height);
+	}
 
 	//生成一个用于采样的随机纹理
-	GLuint randomMap = createRandomTexture(MAX_SAMPLE_NUM);
+	std::vector<glm::vec3> samples = createSamples(options.sampleSet, headless ? REGRESSION_SEED : (unsigned int)std::time(0));
+	GLuint randomMap = createRandomTexture(samples);
+	GLuint blueNoiseMap = createBlueNoiseTexture(BlueNoise::generate(BLUE_NOISE_SIZE, REGRESSION_SEED));
+	//headless frames must not depend on the frame count
+	animate_noise = !headless;
 
 	//绑定纹理
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, depthMap);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, normalMap);
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, worldPosMap);
-	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, fluxMap);
+	rsm.bindTextures();
 	glActiveTexture(GL_TEXTURE4);
 	glBindTexture(GL_TEXTURE_2D, randomMap);
+	glActiveTexture(GL_TEXTURE5);
+	glBindTexture(GL_TEXTURE_2D, blueNoiseMap);
+	if (light_propagation)
+		for (int c = 0; c < 3; ++c) {
+			glActiveTexture(GL_TEXTURE9 + c);
+			glBindTexture(GL_TEXTURE_3D, lpv.accumulated[c]);
+		}
+	if (use_lightmap) {
+		glActiveTexture(GL_TEXTURE0 + LIGHTMAP_UNIT);
+		glBindTexture(GL_TEXTURE_2D, lightmap.texture);
+	}
+	if (imperfect_shadows) {
+		glActiveTexture(GL_TEXTURE0 + ISM_UNIT);
+		glBindTexture(GL_TEXTURE_2D, shadowMaps.depthTexture);
+	}
 
 
 
 	//配置光源空间的着色器
-	glm::mat4 lightProjection = glm::perspective(glm::radians(60.0f), (float)RSM_WIDTH/(float)RSM_HEIGHT, light_near_plane, light_far_plane);
-	glm::mat4 lightView = glm::lookAt(lightPos, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-	glm::mat4 lightSpaceMatrix = lightProjection * lightView;
-	light_space_shader.use();
-	light_space_shader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-	light_space_shader.setVec3("light.position", lightPos);
-	light_space_shader.setVec3("light.diffuse", light_diffuse);
+	RenderParams params = currentRenderParams();
+	Shader* light_space_shaders[] = { &light_space_shader, light_space_gpu_shader };
+	for (Shader* shader : light_space_shaders) {
+		if (shader == NULL)
+			continue;
+		shader->use();
+		shader->setVec3("light.position", lightPos);
+		shader->setVec3("light.diffuse", light_diffuse);
+	}
 
 
 	//配置主绘制着色器
-	main_light_shader.use();
-	main_light_shader.setVec3("material.ambient", 0.1f, 0.1f, 0.1f);
-	main_light_shader.setVec3("material.specular", 0.1f, 0.1f, 0.1f);
-	main_light_shader.setFloat("material.shininess", 8.0f);
-	main_light_shader.setVec3("light.position", lightPos);
-	main_light_shader.setVec3("light.ambient", 0.2f, 0.2f, 0.2f);
-	main_light_shader.setVec3("light.diffuse", light_diffuse);
-	main_light_shader.setVec3("light.specular", 1.0f, 1.0f, 1.0f);
-	main_light_shader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-	main_light_shader.setInt("sample_num", MAX_SAMPLE_NUM);
-	main_light_shader.setFloat("sample_radius", MAX_SAMPLE_RADIUS);
-	main_light_shader.setFloat("shadow_bias", 0.05);
-
-	//指定采样器
-	main_light_shader.setInt("depthMap", 0);
-	main_light_shader.setInt("normalMap", 1);
-	main_light_shader.setInt("worldPosMap", 2);
-	main_light_shader.setInt("fluxMap", 3);
-	main_light_shader.setInt("randomMap", 4);
-	main_light_shader.setFloat("near_plane", light_near_plane);
-	main_light_shader.setFloat("far_plane", light_far_plane);
+	Shader* main_shaders[] = { &main_light_shader, main_gpu_shader };
+	for (Shader* shader : main_shaders) {
+		if (shader == NULL)
+			continue;
+		shader->use();
+		shader->setVec3("material.ambient", params.materialAmbient);
+		shader->setVec3("material.specular", params.materialSpecular);
+		shader->setFloat("material.shininess", params.shininess);
+		shader->setVec3("light.position", params.lightPos);
+		shader->setVec3("light.ambient", params.lightAmbient);
+		shader->setVec3("light.diffuse", params.lightDiffuse);
+		shader->setVec3("light.specular", params.lightSpecular);
+		shader->setInt("sample_num", params.sampleNum);
+		shader->setFloat("sample_radius", params.sampleRadius);
+		shader->setFloat("shadow_bias", params.shadowBias);
+
+		//指定采样器
+		shader->setInt("depthMap", 0);
+		shader->setInt("normalMap", 1);
+		shader->setInt("worldPosMap", 2);
+		shader->setInt("fluxMap", 3);
+		shader->setInt("randomMap", 4);
+		shader->setInt("blueNoiseMap", 5);
+		shader->setInt("indirectMap", 8);
+		shader->setInt("lpvRed", 9);
+		shader->setInt("lpvGreen", 10);
+		shader->setInt("lpvBlue", 11);
+		shader->setInt("probeMap", 15);
+		shader->setInt("lightMap", LIGHTMAP_UNIT);
+		shader->setInt("ismMap", ISM_UNIT);
+		shader->setBool("use_ism", imperfect_shadows);
+		shader->setInt("ism_grid", ImperfectShadowMaps::VPL_GRID);
+		shader->setInt("ism_tile", ImperfectShadowMaps::TILE);
+		shader->setFloat("ism_far", shadowMaps.far);
+		shader->setFloat("ism_bias", params.ismBias);
+		shader->setFloat("ism_same_surface", ImperfectShadowMaps::SAME_SURFACE);
+		shader->setFloat("ism_offset", ImperfectShadowMaps::RECEIVER_OFFSET);
+		shader->setInt("indirect_mode", use_cache ? INDIRECT_CACHE : light_propagation ? INDIRECT_LPV
+			: irradiance_probes ? INDIRECT_PROBES : use_lightmap ? INDIRECT_LIGHTMAP : INDIRECT_GATHER);
+		shader->setVec3("lpv_min", lpv.layout.origin);
+		shader->setFloat("lpv_cell_size", lpv.layout.cellSize);
+		shader->setInt("lpv_grid", LpvLayout::GRID);
+		shader->setFloat("lpv_intensity", params.lpvIntensity);
+		shader->setVec3("probe_min", probes.bounds.min);
+		shader->setVec3("probe_max", probes.bounds.max);
+		shader->setInt("probe_grid", probe_grid);
+		shader->setFloat("probe_intensity", params.probeIntensity);
+		shader->setBool("blue_noise", params.blueNoise);
+		shader->setBool("adaptive_sampling", params.adaptiveSampling);
+		shader->setInt("adaptive_batch", params.adaptiveBatch);
+		shader->setFloat("adaptive_threshold", params.adaptiveThreshold);
+		shader->setFloat("near_plane", params.nearPlane);
+		shader->setFloat("far_plane", params.farPlane);
+	}
 
 
 	//debug
@@ -407,49 +584,467 @@ int main() {
 	debug_shader.setInt("worldPosMap", 2);
 	debug_shader.setInt("fluxMap", 3);
 
-	while (!glfwWindowShouldClose(window)) {
-		//time
-		float currentFrame = glfwGetTime();
-		deltaTime = currentFrame - lastFrame;
-		lastFrame = currentFrame;
+	//配置辐照度缓存
+	if (use_cache) {
+		cache_shader->use();
+		cache_shader->setInt("normalMap", 1);
+		cache_shader->setInt("worldPosMap", 2);
+		cache_shader->setInt("fluxMap", 3);
+		cache_shader->setInt("randomMap", 4);
+		cache_shader->setInt("gPosition", 6);
+		cache_shader->setInt("gNormal", 7);
+	}
 
-		processInput(window);
+	//per-frame and per-draw uniforms are streamed through one ring buffer
+	Shader* block_shaders[] = { &main_light_shader, &light_space_shader, &depth_prepass_shader,
+		main_gpu_shader, light_space_gpu_shader, depth_prepass_gpu_shader, gbuffer_shader, gbuffer_gpu_shader, cache_shader };
+	for (Shader* shader : block_shaders) {
+		if (shader == NULL)
+			continue;
+		shader->setBlockBinding("PerFrame", PER_FRAME_BINDING);
+		shader->setBlockBinding("PerDraw", PER_DRAW_BINDING);
+	}
+	GLint uboAlignment;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uboAlignment);
+	GLsizeiptr frameBytes = (sizeof(PerFrameData) + uboAlignment - 1) / uboAlignment * uboAlignment;
+	GLsizeiptr drawBytes = (sizeof(PerDrawData) + uboAlignment - 1) / uboAlignment * uboAlignment;
+	//worst case every object is drawn by both the light and the camera pass
+	FrameRingBuffer uniformRing;
+	uniformRing.init(frameBytes + 2 * scene.objects.size() * drawBytes);
+	std::vector<GLintptr> cameraDraws, lightDraws;
 
-		//rsm render
-		glBindFramebuffer(GL_FRAMEBUFFER, rsmFBO);
+	//passes of a frame, the graph drops those whose results the main pass does not read
+	RenderGraph graph(targetPool);
+	auto importTargets = [&]() {
+		graph.importTexture("rsm.depth", rsm.depthMap);
+		graph.importTexture("rsm.normal", rsm.normalMap);
+		graph.importTexture("rsm.worldPos", rsm.worldPosMap);
+		graph.importTexture("rsm.flux", rsm.fluxMap);
+	};
+	importTargets();
+	//the cache's G-buffer and indirect term only live through the frame, at the render resolution;
+	//the cache pass reads the one while it writes the other, so they get a slot each
+	auto createCacheTargets = [&]() {
+		graph.createTexture("cache.position", RenderGraph::TextureDesc(GL_RGBA32F, sceneTargets.width, sceneTargets.height));
+		graph.createTexture("cache.normal", RenderGraph::TextureDesc(GL_RGBA16F, sceneTargets.width, sceneTargets.height));
+		graph.createTexture("cache.indirect", RenderGraph::TextureDesc(GL_RGBA16F, sceneTargets.width, sceneTargets.height));
+	};
+	graph.importTexture("scene.color", sceneTargets.colorMap);
+	graph.importTexture("scene.depth", sceneTargets.depthMap);
+	//the back buffer, presented
+	graph.importTexture("window", 0);
+	const char* rsmMaps[] = { "rsm.normal", "rsm.worldPos", "rsm.flux" };
+	bool prepass = use_cache || enable_depth_prepass;
+	//the passes whose cost follows the render resolution, the others are fixed for the dynamic resolution
+	std::vector<int> pixelPasses;
+
+	int rsmPass = graph.addPass("rsm", [&]() {
+		if (reuse_light)
+			return;
+		glBindFramebuffer(GL_FRAMEBUFFER, rsm.fbo);
 		glClear(GL_DEPTH_BUFFER_BIT);
 		light_space_shader.use();
-		glViewport(0, 0, RSM_WIDTH, RSM_HEIGHT);
-		planes.draw(light_space_shader);
-		cubeFrame.draw(light_space_shader);
+		glViewport(0, 0, rsm.width, rsm.height);
+		if (gpu_culling)
+			lightCuller.render(*light_space_gpu_shader, lightVisible, params.lightSpaceMatrix);
+		else
+			scene.draw(light_space_shader, lightVisible, uniformRing, lightDraws);
+	});
+	graph.write(rsmPass, "rsm.depth");
+	for (const char* map : rsmMaps)
+		graph.write(rsmPass, map);
+	if (light_propagation) {
+		graph.importTexture("lpv", lpv.accumulated[0]);
+		int pass = graph.addPass("lpv", [&]() {
+			if (!reuse_light)
+				lpv.update(lpv_iterations);
+		});
+		for (const char* map : rsmMaps)
+			graph.read(pass, map);
+		graph.write(pass, "lpv");
+	}
+	if (imperfect_shadows) {
+		graph.importTexture("ism", shadowMaps.depthTexture);
+		int pass = graph.addPass("ism", [&]() {
+			if (!reuse_light)
+				shadowMaps.render();
+		});
+		graph.read(pass, "rsm.normal");
+		graph.read(pass, "rsm.worldPos");
+		graph.write(pass, "ism");
+	}
+	if (irradiance_probes) {
+		graph.importTexture("probes", probes.texture);
+		int pass = graph.addPass("probes", [&]() {
+			if (probes.bakedFor(params.lightSpaceMatrix, light_diffuse))
+				return;
+			//unit 15 is the probe unit, rebound below
+			glActiveTexture(GL_TEXTURE15);
+			readTexture(rsm.normalMap, rsm.width, rsm.height, bakeNormals);
+			readTexture(rsm.worldPosMap, rsm.width, rsm.height, bakePositions);
+			readTexture(rsm.fluxMap, rsm.width, rsm.height, bakeFlux);
+			probes.bake(bakePool, bakeNormals, bakePositions, bakeFlux, rsm.width, rsm.height, params.lightSpaceMatrix, light_diffuse);
+			probes.upload();
+			glBindTexture(GL_TEXTURE_3D, probes.texture);
+		});
+		for (const char* map : rsmMaps)
+			graph.read(pass, map, RenderGraph::TRANSFER);
+		graph.write(pass, "probes", RenderGraph::TRANSFER);
+	}
+
+	int clearPass = graph.addPass("clear", [&]() {
+		glBindFramebuffer(GL_FRAMEBUFFER, sceneTargets.fbo);
+		glViewport(0, 0, sceneTargets.width, sceneTargets.height);
+		glClearColor(params.clearColor.r, params.clearColor.g, params.clearColor.b, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	});
+	graph.write(clearPass, "scene.color");
+	graph.write(clearPass, "scene.depth");
+	pixelPasses.push_back(clearPass);
+	if (enable_debug) {
+		int pass = graph.addPass("debug", [&]() { debug.draw(debug_shader); });
+		graph.read(pass, "rsm.depth");
+		graph.write(pass, "scene.color");
+	}
+	if (use_cache) {
+		//G-buffer pass, then the cache fills the indirect term of the visible pixels
+		createCacheTargets();
+		int gbufferPass = graph.addPass("gbuffer", [&]() {
+			cache.setTargets(graph.texture("cache.position"), graph.texture("cache.normal"), graph.texture("cache.indirect"));
+			glBindFramebuffer(GL_FRAMEBUFFER, cache.fbo);
+			glViewport(0, 0, sceneTargets.width, sceneTargets.height);
+			GLfloat empty[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			glClearBufferfv(GL_COLOR, 0, empty);
+			glClearBufferfv(GL_COLOR, 1, empty);
+			if (gpu_culling)
+				cameraCuller.render(*gbuffer_gpu_shader, cameraVisible, params.projection * params.view);
+			else
+				scene.draw(*gbuffer_shader, cameraVisible, uniformRing, cameraDraws);
+		});
+		graph.write(gbufferPass, "scene.depth");
+		graph.write(gbufferPass, "cache.position");
+		graph.write(gbufferPass, "cache.normal");
+		pixelPasses.push_back(gbufferPass);
+		int cachePass = graph.addPass("irradiance cache", [&]() {
+			cache.update(sample_num, sample_radius, frame_index);
+			glActiveTexture(GL_TEXTURE8);
+			glBindTexture(GL_TEXTURE_2D, cache.indirectTexture);
+		});
+		graph.read(cachePass, "cache.position");
+		graph.read(cachePass, "cache.normal");
+		for (const char* map : rsmMaps)
+			graph.read(cachePass, map);
+		graph.write(cachePass, "cache.indirect", RenderGraph::IMAGE);
+		pixelPasses.push_back(cachePass);
+	}
+	else if (enable_depth_prepass) {
+		int pass = graph.addPass("depth prepass", [&]() {
+			Shader& prepass_shader = gpu_culling ? *depth_prepass_gpu_shader : depth_prepass_shader;
+			glBindFramebuffer(GL_FRAMEBUFFER, sceneTargets.fbo);
+			glViewport(0, 0, sceneTargets.width, sceneTargets.height);
+			glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+			if (gpu_culling)
+				cameraCuller.render(prepass_shader, cameraVisible, params.projection * params.view, true);
+			else
+				scene.drawDepth(prepass_shader, cameraVisible, uniformRing, cameraDraws);
+			glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		});
+		graph.write(pass, "scene.depth");
+		pixelPasses.push_back(pass);
+	}
+
+	int mainPass = graph.addPass("main", [&]() {
+		glBindFramebuffer(GL_FRAMEBUFFER, sceneTargets.fbo);
+		glViewport(0, 0, sceneTargets.width, sceneTargets.height);
+		if (prepass) {
+			glDepthFunc(GL_EQUAL);
+			glDepthMask(GL_FALSE);
+		}
+		Shader& main_shader = gpu_culling ? *main_gpu_shader : main_light_shader;
+		if (gpu_culling && prepass)
+			cameraCuller.redraw(main_shader);
+		else if (gpu_culling)
+			cameraCuller.render(main_shader, cameraVisible, params.projection * params.view);
+		else
+			scene.draw(main_shader, cameraVisible, uniformRing, cameraDraws);
+		if (prepass) {
+			glDepthFunc(GL_LESS);
+			glDepthMask(GL_TRUE);
+		}
+	});
+	graph.read(mainPass, "rsm.depth");
+	for (const char* map : rsmMaps)
+		graph.read(mainPass, map);
+	if (prepass)
+		graph.read(mainPass, "scene.depth");
+	if (use_cache)
+		graph.read(mainPass, "cache.indirect");
+	else if (light_propagation)
+		graph.read(mainPass, "lpv");
+	else if (irradiance_probes)
+		graph.read(mainPass, "probes");
+	//the visibility only applies to the per-pixel gather
+	if (imperfect_shadows && !use_lightmap && !use_cache && !light_propagation && !irradiance_probes)
+		graph.read(mainPass, "ism");
+	graph.write(mainPass, "scene.color");
+	graph.write(mainPass, "scene.depth");
+	pixelPasses.push_back(mainPass);
+	//bilinear from the render resolution to the window's, also stretches the old targets during a resize
+	int upscalePass = graph.addPass("upscale", [&]() {
+		bool scaled = sceneTargets.width != framebuffer_width || sceneTargets.height != framebuffer_height;
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneTargets.fbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		glBlitFramebuffer(0, 0, sceneTargets.width, sceneTargets.height, 0, 0, framebuffer_width, framebuffer_height,
+			GL_COLOR_BUFFER_BIT, scaled ? GL_LINEAR : GL_NEAREST);
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		
+	});
+	graph.read(upscalePass, "scene.color", RenderGraph::ATTACHMENT);
+	graph.write(upscalePass, "window");
+	//headless views are read back from the scene targets and never presented
+	graph.output(headless ? "scene.color" : "window");
+	if (!graph.compile())
+		return -1;
 
+	//pick up changed RSM settings, the targets are only recreated when their size or format changed
+	auto applyRSMSettings = [&]() {
+		if (rsm.width != rsm_size || rsm.halfFormat != rsm_half_format) {
+			rsm.create(rsm_size, rsm_size, rsm_half_format);
+			rsm.bindTextures();
+			importTargets();
+			if (gpu_culling)
+				lightCuller.setDepthTarget(rsm.depthMap, rsm.width, rsm.height);
+		}
+		if (use_cache)
+			cache.invalidate();
+		probes.invalidate();
+		for (Shader* shader : main_shaders) {
+			if (shader == NULL)
+				continue;
+			shader->use();
+			shader->setInt("sample_num", sample_num);
+			shader->setFloat("sample_radius", sample_radius);
+		}
+	};
 
-		glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
-		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	//render at another resolution: the scene targets and what follows their size are recreated
+	auto resizeSceneTargets = [&](int width, int height) {
+		if (sceneTargets.width == width && sceneTargets.height == height)
+			return;
+		render_width = width;
+		render_height = height;
+		sceneTargets.create(width, height);
+		graph.importTexture("scene.color", sceneTargets.colorMap);
+		graph.importTexture("scene.depth", sceneTargets.depthMap);
+		if (use_cache) {
+			cache.resize(sceneTargets.depthMap, width, height);
+			createCacheTargets();
+		}
+		if (gpu_culling)
+			cameraCuller.setDepthTarget(sceneTargets.depthMap, width, height);
+	};
 
+	//render the current camera into the scene targets, and present them with the window as the output
+	auto renderFrame = [&]() {
+		params = currentRenderParams();
+		glm::mat4 projection = params.projection;
+		glm::mat4 view = params.view;
+		glm::mat4 lightSpaceMatrix = params.lightSpaceMatrix;
 
-		//debug_shader.use();
-		//debug.draw(debug_shader);
+		//culling
+		if (reuse_light)
+			lightVisible.clear();
+		else {
+			scene.queryLight(lightPos, light_radius, lightVisible);
+			Frustum lightFrustum(lightSpaceMatrix);
+			lightVisible.erase(std::remove_if(lightVisible.begin(), lightVisible.end(), [&](int i) {
+				return !lightFrustum.intersects(scene.objects[i].bounds);
+			}), lightVisible.end());
+		}
+		scene.cull(Frustum(projection * view), cameraVisible);
 
+		//write all uniform data of the frame in one sweep
+		uniformRing.beginFrame();
+		PerFrameData frameData;
+		frameData.projection = projection;
+		frameData.view = view;
+		frameData.lightSpaceMatrix = lightSpaceMatrix;
+		frameData.viewPos = glm::vec4(camera.Position, 1.0f);
+		frameData.noise = glm::vec4(params.noiseOffset, 0.0f, 0.0f, 0.0f);
+		GLintptr frameOffset = uniformRing.push(frameData);
+		if (!gpu_culling) {
+			scene.writeDraws(uniformRing, lightVisible, lightDraws);
+			scene.writeDraws(uniformRing, cameraVisible, cameraDraws);
+		}
+		uniformRing.flush();
+		glBindBufferRange(GL_UNIFORM_BUFFER, PER_FRAME_BINDING, uniformRing.buffer, frameOffset, sizeof(PerFrameData));
 
-		main_light_shader.use();
-		main_light_shader.setVec3("viewPos", camera.Position);
-		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-		glm::mat4 view = camera.GetViewMatrix();
-		main_light_shader.setMat4("projection", projection);
-		main_light_shader.setMat4("view", view);
-		glm::mat4 model = glm::mat4(1.0f);
-		main_light_shader.setMat4("model", model);
+		graph.execute();
 
-		planes.draw(main_light_shader);
-		cubeFrame.draw(main_light_shader);
+		uniformRing.endFrame();
+		targetPool.endFrame();
+		++frame_index;
+	};
 
-		glfwSwapBuffers(window);
+	//average GPU time of a few frames of the current view, after a warm-up
+	GLuint frameTimer;
+	glGenQueries(1, &frameTimer);
+	auto timeFrames = [&]() -> double {
+		double ms = 0.0;
+		for (int frame = 0; frame < HEADLESS_WARMUP_FRAMES + HEADLESS_TIMED_FRAMES; ++frame) {
+			glBeginQuery(GL_TIME_ELAPSED, frameTimer);
+			renderFrame();
+			glEndQuery(GL_TIME_ELAPSED);
+			GLuint64 elapsed;
+			glGetQueryObjectui64v(frameTimer, GL_QUERY_RESULT, &elapsed);
+			if (frame >= HEADLESS_WARMUP_FRAMES)
+				ms += elapsed / 1.0e6;
+		}
+		return ms / HEADLESS_TIMED_FRAMES;
+	};
+
+	if (regress) {
+		Regression regression(options.regressDir, options.regressUpdate);
+		std::vector<unsigned char> pixels;
+		for (int i = 0; i < REGRESSION_VIEW_COUNT; ++i) {
+			setViewpoint(REGRESSION_VIEWS[i]);
+			double ms = timeFrames();
+			FrameCapture::readPixels(sceneTargets.fbo, SCR_WIDTH, SCR_HEIGHT, pixels);
+			regression.check(REGRESSION_VIEWS[i].name, pixels.data(), SCR_WIDTH, SCR_HEIGHT, ms);
+		}
+		bool passed = regression.report();
+		GpuMemory::instance().report(std::cout);
+		return passed ? 0 : 1;
+	}
+
+	if (!options.sweepPath.empty()) {
+		//high-sample reference of every view
+		sample_num = MAX_SAMPLE_NUM;
+		rsm_size = SWEEP_REFERENCE_RSM_SIZE;
+		rsm_half_format = false;
+		applyRSMSettings();
+		std::vector<std::vector<unsigned char> > references(REGRESSION_VIEW_COUNT);
+		for (int i = 0; i < REGRESSION_VIEW_COUNT; ++i) {
+			setViewpoint(REGRESSION_VIEWS[i]);
+			renderFrame();
+			FrameCapture::readPixels(sceneTargets.fbo, SCR_WIDTH, SCR_HEIGHT, references[i]);
+		}
+
+		std::vector<SweepPoint> points;
+		std::vector<unsigned char> pixels;
+		for (int sampleNum : SWEEP_SAMPLE_NUMS)
+			for (float radius : SWEEP_SAMPLE_RADII)
+				for (int size : SWEEP_RSM_SIZES)
+					for (int half = 0; half < 2; ++half) {
+						sample_num = sampleNum;
+						sample_radius = radius;
+						rsm_size = size;
+						rsm_half_format = half != 0;
+						applyRSMSettings();
+						SweepPoint point(sample_num, sample_radius, rsm_size, rsm_half_format);
+						for (int i = 0; i < REGRESSION_VIEW_COUNT; ++i) {
+							setViewpoint(REGRESSION_VIEWS[i]);
+							double ms = timeFrames();
+							FrameCapture::readPixels(sceneTargets.fbo, SCR_WIDTH, SCR_HEIGHT, pixels);
+							point.addView(ms, pixels.data(), references[i].data(), SCR_WIDTH, SCR_HEIGHT);
+						}
+						points.push_back(point);
+						std::cout << "sweep " << points.size() << ": " << sampleNum << " samples, radius " << radius << ", rsm "
+							<< size << (half ? " half" : " full") << ": " << point.frameMs << " ms, FLIP " << point.flip << "\n";
+					}
+		GpuMemory::instance().report(std::cout);
+		return writeSweepCSV(options.sweepPath, points) ? 0 : 1;
+	}
+
+	FrameCapture frameCapture;
+	if (!poses.empty()) {
+		//the light's passes run for the first view only, the readbacks overlap the following views
+		if (!frameCapture.init(SCR_WIDTH, SCR_HEIGHT, options.captureDir, options.captureFormat))
+			return -1;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < poses.size(); ++i) {
+			camera = Camera(poses[i].position, glm::vec3(0.0f, 1.0f, 0.0f), poses[i].yaw, poses[i].pitch);
+			renderFrame();
+			frameCapture.capture(sceneTargets.fbo);
+			reuse_light = true;
+		}
+		reuse_light = false;
+		frameCapture.finish();
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "Rendered " << poses.size() << " views: " << ms << " ms, " << ms / poses.size() << " ms per view\n";
+		GpuMemory::instance().report(std::cout);
+		return 0;
+	}
+	if (!options.captureDir.empty() && !frameCapture.init(output_width, output_height, options.captureDir, options.captureFormat))
+		return -1;
+
+	//the render scale follows the GPU time of the graph's passes
+	DynamicResolution resolution;
+	resolution.init(options.targetMs, options.minScale, options.dynamicQuality, sample_num, rsm_size);
+	graph.setTiming(resolution.enabled());
+	FramePacer pacer;
+	pacer.init(options.framesInFlight, options.fpsLimit, options.pacingReport);
+
+	while (!glfwWindowShouldClose(window)) {
+		//input is read as late as the pacing allows
+		pacer.begin();
 		glfwPollEvents();
+
+		//time
+		float currentFrame = glfwGetTime();
+		deltaTime = currentFrame - lastFrame;
+		lastFrame = currentFrame;
+
+		processInput(window);
+		pacer.inputSampled();
+
+		//minimized, nothing to render into
+		if (framebuffer_width == 0 || framebuffer_height == 0) {
+			pacer.skip();
+			glfwWaitEvents();
+			continue;
+		}
+		bool resizing = framebuffer_width != output_width || framebuffer_height != output_height;
+		if (resizing && glfwGetTime() - resize_time > RESIZE_DEBOUNCE) {
+			output_width = framebuffer_width;
+			output_height = framebuffer_height;
+			resizeSceneTargets(resolution.scaled(output_width), resolution.scaled(output_height));
+			frameCapture.resize(output_width, output_height);
+			resizing = false;
+		}
+
+		renderFrame();
+
+		//frames stretched during a resize are not captured
+		if (!options.captureDir.empty() && !resizing) {
+			frameCapture.capture(0);
+			if (options.captureFrames > 0 && frameCapture.frames() >= options.captureFrames)
+				glfwSetWindowShouldClose(window, true);
+		}
+
+		if (resolution.enabled()) {
+			const std::vector<double>& times = graph.passTimes();
+			double pixelMs = 0.0, frameMs = 0.0;
+			for (size_t p = 0; p < times.size(); ++p)
+				frameMs += times[p];
+			for (int pass : pixelPasses)
+				pixelMs += pass < (int)times.size() ? times[pass] : 0.0;
+			if (resolution.update(frameMs - pixelMs, pixelMs)) {
+				resizeSceneTargets(resolution.scaled(output_width), resolution.scaled(output_height));
+				if (sample_num != resolution.sampleNum || rsm_size != resolution.rsmSize) {
+					sample_num = resolution.sampleNum;
+					rsm_size = resolution.rsmSize;
+					applyRSMSettings();
+				}
+				std::cout << "render scale " << resolution.scale << ": " << render_width << "x" << render_height << ", "
+					<< sample_num << " samples, rsm " << rsm_size << "\n";
+			}
+		}
+
+		glfwSwapBuffers(window);
+		pacer.end();
 	}
+	frameCapture.finish();
+	GpuMemory::instance().report(std::cout);
 
 	return 0;
 }
@@ -467,10 +1062,19 @@ void processInput(GLFWwindow* window) {
 		camera.ProcessKeyboard(LEFT, deltaTime);
 	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
 		camera.ProcessKeyboard(RIGHT, deltaTime);
+	//memory report when M is released
+	static bool reportKey = false;
+	bool pressed = glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS;
+	if (reportKey && !pressed)
+		GpuMemory::instance().report(std::cout);
+	reportKey = pressed;
 }
 
+//the passes set their own viewports, the targets are resized by the render loop
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
-	glViewport(0, 0, width, height);
+	framebuffer_width = width;
+	framebuffer_height = height;
+	resize_time = (float)glfwGetTime();
 }
 void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
 	if (firstMouse) {
@@ -493,13 +1097,24 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
 	camera.ProcessMouseScroll(yoffset);
 }
+//pick the object under the crosshair
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
+	if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS)
+		return;
+	float distance;
+	int picked = scene.pick(Ray(camera.Position, camera.Front), distance);
+	if (picked >= 0)
+		std::cout << "Picked object " << picked << " at distance " << distance << "\n";
+	else
+		std::cout << "Picked nothing\n";
+}
 
-//生成采样用的随机纹理
-GLuint createRandomTexture(int size) {
+//生成采样用的随机数
+std::vector<glm::vec3> createRandomSamples(int size, unsigned int seed) {
 	std::default_random_engine eng;
 	std::uniform_real_distribution<float> dist(0.0f, 1.0f);
-	eng.seed(std::time(0));
-	glm::vec3* randomData = new glm::vec3[size];
+	eng.seed(seed);
+	std::vector<glm::vec3> randomData(size);
 	for (int i = 0; i < size; ++i) {
 		float r1 = dist(eng);
 		float r2 = dist(eng);
@@ -507,14 +1122,219 @@ GLuint createRandomTexture(int size) {
 		randomData[i].y = r1 * std::cos(2 * PI * r2);
 		randomData[i].z = r1 * r1;
 	}
+	return randomData;
+}
+//the random set uses the seed, the others are fixed
+std::vector<glm::vec3> createSamples(const std::string& set, unsigned int seed) {
+	if (set == "sobol")
+		return sobolSamples(MAX_SAMPLE_NUM);
+	if (set == "poisson")
+		return poissonSamples(MAX_SAMPLE_NUM);
+	return createRandomSamples(MAX_SAMPLE_NUM, seed);
+}
+//生成采样用的随机纹理
+GLuint createRandomTexture(const std::vector<glm::vec3>& samples) {
 	GLuint randomTexture;
 	glGenTextures(1, &randomTexture);
 	glBindTexture(GL_TEXTURE_2D, randomTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, size, 1, 0, GL_RGB, GL_FLOAT, randomData);
+	gpuTexImage2D(MEMORY_SAMPLING, GL_RGB32F, (GLsizei)samples.size(), 1, GL_RGB, GL_FLOAT, samples.data());
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	delete[] randomData;
 	return randomTexture;
+}
+
+//tileable blue noise, one float channel
+GLuint createBlueNoiseTexture(const std::vector<float>& noise) {
+	GLuint noiseTexture;
+	glGenTextures(1, &noiseTexture);
+	glBindTexture(GL_TEXTURE_2D, noiseTexture);
+	gpuTexImage2D(MEMORY_SAMPLING, GL_R32F, BLUE_NOISE_SIZE, BLUE_NOISE_SIZE, GL_RED, GL_FLOAT, noise.data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	return noiseTexture;
+}
+
+//RGB texels of a 2D texture as floats, rows bottom to top
+void readTexture(GLuint texture, int width, int height, std::vector<glm::vec3>& texels) {
+	texels.resize((size_t)width * height);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, texels.data());
+}
+
+//shading inputs of the current frame, for the shaders and the CPU renderer
+RenderParams currentRenderParams() {
+	RenderParams params;
+	params.width = render_width;
+	params.height = render_height;
+	params.rsmWidth = rsm_size;
+	params.rsmHeight = rsm_size;
+	params.halfRSM = rsm_half_format;
+	//the window's aspect, the render targets may lag behind it during a resize
+	float aspect = framebuffer_height > 0 ? (float)framebuffer_width / (float)framebuffer_height : (float)SCR_WIDTH / (float)SCR_HEIGHT;
+	params.projection = glm::perspective(glm::radians(camera.Zoom), aspect, 0.1f, 100.0f);
+	params.view = camera.GetViewMatrix();
+	glm::mat4 lightProjection = glm::perspective(glm::radians(60.0f), 1.0f, light_near_plane, light_far_plane);
+	glm::mat4 lightView = glm::lookAt(lightPos, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	params.lightSpaceMatrix = lightProjection * lightView;
+	params.viewPos = camera.Position;
+	params.lightPos = lightPos;
+	params.lightDiffuse = light_diffuse;
+	params.nearPlane = light_near_plane;
+	params.farPlane = light_far_plane;
+	params.sampleNum = sample_num;
+	params.sampleRadius = sample_radius;
+	params.blueNoise = blue_noise;
+	params.adaptiveSampling = adaptive_sampling;
+	params.adaptiveBatch = ADAPTIVE_BATCH;
+	params.adaptiveThreshold = adaptive_threshold;
+	params.lpv = light_propagation;
+	params.lpvIterations = lpv_iterations;
+	params.lpvIntensity = lpv_intensity;
+	params.probes = irradiance_probes;
+	params.probeGrid = probe_grid;
+	params.probeIntensity = probe_intensity;
+	params.lightmap = use_lightmap;
+	params.ism = imperfect_shadows;
+	params.ismBias = ism_bias;
+	if (animate_noise) {
+		params.noiseOffset = frame_index * GOLDEN_RATIO_CONJUGATE;
+		params.noiseOffset -= std::floor(params.noiseOffset);
+	}
+	return params;
+}
+
+void setViewpoint(const Viewpoint& view) {
+	camera = Camera(view.position, glm::vec3(0.0f, 1.0f, 0.0f), view.yaw, view.pitch);
+}
+
+//the reference renderer and the lightmap bake, run without a GL context
+int renderCpu(const Options& options) {
+	bool bake = !options.bakeLightmap.empty();
+	Lightmap lightmap;
+	Planes planes(scene.geometry);
+	CubeFrame cubeFrame(scene.geometry);
+	if ((bake || use_lightmap) && !lightmap.unwrap(scene.geometry))
+		return -1;
+	planes.addTo(scene);
+	cubeFrame.addTo(scene);
+	scene.build();
+	if (bake || use_lightmap)
+		lightmap.pack(scene);
+	if (use_lightmap && !lightmap.load(options.lightmap))
+		return -1;
+	//forked before this process starts any thread
+	if (options.workers > 0)
+		return renderCpuTiled(options, lightmap);
+
+	ThreadPool pool(options.threads);
+	CpuRenderer renderer(pool);
+	renderer.setBlueNoise(BlueNoise::generate(BLUE_NOISE_SIZE, REGRESSION_SEED), BLUE_NOISE_SIZE);
+	renderer.setLightmap(&lightmap);
+
+	if (bake) {
+		//every sample of the set, the bake runs once
+		std::vector<glm::vec3> samples = createSamples(options.sampleSet, REGRESSION_SEED);
+		RenderParams params = currentRenderParams();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		renderer.bakeLightmap(scene, params, samples, lightmap);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "lightmap " << lightmap.width << "x" << lightmap.height << " baked with " << samples.size()
+			<< " samples: " << ms << " ms on " << pool.size() << " threads\n";
+		if (!lightmap.save(options.bakeLightmap)) {
+			std::cout << "ERROR::LIGHTMAP::WRITE_FAILED " << options.bakeLightmap << "\n";
+			return -1;
+		}
+		return 0;
+	}
+
+	if (options.regressCpu) {
+		std::vector<glm::vec3> samples = createSamples(options.sampleSet, REGRESSION_SEED);
+		Regression regression(options.regressDir, options.regressUpdate);
+		for (int i = 0; i < REGRESSION_VIEW_COUNT; ++i) {
+			const Viewpoint& view = REGRESSION_VIEWS[i];
+			setViewpoint(view);
+			RenderParams params = currentRenderParams();
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			renderer.render(scene, params, samples);
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			regression.check(view.name, renderer.color.data(), params.width, params.height, ms);
+		}
+		bool passed = regression.report();
+		return passed ? 0 : 1;
+	}
+
+	std::vector<glm::vec3> samples = createSamples(options.sampleSet, (unsigned int)std::time(0));
+	RenderParams params = currentRenderParams();
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	renderer.render(scene, params, samples);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "CPU frame: " << ms << " ms on " << pool.size() << " threads\n";
+
+	const std::string& path = options.cpuOutput;
+	bool ppm = path.size() >= 4 && path.compare(path.size() - 4, 4, ".ppm") == 0;
+	bool ok = ppm ? writePPM(path, renderer.color.data(), params.width, params.height, 4)
+		: writePNG(path, renderer.color.data(), params.width, params.height, 4);
+	if (!ok) {
+		std::cout << "ERROR::CPU_RENDER::WRITE_FAILED " << path << "\n";
+		return -1;
+	}
+	return 0;
+}
+
+//the --cpu frame in tiles over worker processes, each with its own RSM and thread pool
+int renderCpuTiled(const Options& options, const Lightmap& lightmap) {
+	//tile origins on the noise period keep every pixel's rotation of a single-process render
+	if (blue_noise && options.tileSize % BLUE_NOISE_SIZE != 0) {
+		std::cout << "ERROR::TILE_FARM::TILE_SIZE_NOT_NOISE_ALIGNED " << options.tileSize << "\n";
+		return -1;
+	}
+	int threads = options.threads;
+	if (threads <= 0)
+		threads = std::max(1, (int)std::thread::hardware_concurrency() / options.workers);
+	//drawn once, all workers gather with the same samples
+	std::vector<glm::vec3> samples = createSamples(options.sampleSet, (unsigned int)std::time(0));
+	std::vector<float> noise = BlueNoise::generate(BLUE_NOISE_SIZE, REGRESSION_SEED);
+	RenderParams params = currentRenderParams();
+	TileFarm farm(params.width, params.height, options.tileSize);
+
+	std::vector<unsigned char> image;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool rendered = farm.render(options.workers, [&]() -> TileFarm::TileRenderer {
+		std::shared_ptr<ThreadPool> pool(new ThreadPool(threads));
+		std::shared_ptr<CpuRenderer> renderer(new CpuRenderer(*pool));
+		renderer->setBlueNoise(noise, BLUE_NOISE_SIZE);
+		renderer->setLightmap(&lightmap);
+		renderer->renderLight(scene, params);
+		return [&, pool, renderer](const TileFarm::Tile& tile, std::vector<unsigned char>& pixels) {
+			RenderParams tileParams = params;
+			tileParams.width = tile.width();
+			tileParams.height = tile.height();
+			tileParams.projection = farm.tileProjection(tile) * params.projection;
+			renderer->renderCamera(scene, tileParams, samples);
+			pixels.swap(renderer->color);
+		};
+	}, image);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	if (!rendered)
+		return -1;
+	std::cout << "CPU frame: " << ms << " ms, " << farm.tiles.size() << " tiles of " << options.tileSize
+		<< " on " << options.workers << " workers x " << threads << " threads, " << farm.stolen << " stolen\n";
+	for (size_t w = 0; w < farm.workerTiles.size(); ++w)
+		std::cout << "  worker " << w << ": " << farm.workerTiles[w] << " tiles\n";
+
+	const std::string& path = options.cpuOutput;
+	bool ppm = path.size() >= 4 && path.compare(path.size() - 4, 4, ".ppm") == 0;
+	bool ok = ppm ? writePPM(path, image.data(), params.width, params.height, 4)
+		: writePNG(path, image.data(), params.width, params.height, 4);
+	if (!ok) {
+		std::cout << "ERROR::CPU_RENDER::WRITE_FAILED " << path << "\n";
+		return -1;
+	}
+	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,22 @@
+#version 330 core
+layout (location=0) in vec3 aPos;
+
+//must match result_shader.vert bit for bit, the lighting pass uses GL_EQUAL
+invariant gl_Position;
+
+layout (std140) uniform PerFrame {
+	mat4 projection;
+	mat4 view;
+	mat4 lightSpaceMatrix;
+	vec4 viewPos;
+};
+layout (std140) uniform PerDraw {
+	mat4 model;
+	vec4 diffuse;
+	vec4 lightmap;
+};
+
+void main()
+{
+	gl_Position=projection*view*model*vec4(aPos, 1.0f);
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+#version 430 core
+layout (location=0) in vec3 aPos;
+layout (location=2) in uint aObjectId;
+
+//must match result_shader_gpu.vert bit for bit, the lighting pass uses GL_EQUAL
+invariant gl_Position;
+
+struct ObjectData {
+	mat4 model;
+	vec4 diffuse;
+	vec4 boundsMin;
+	vec4 boundsMax;
+	uvec4 draw;
+	vec4 lightmap;
+};
+layout (std430, binding=0) readonly buffer Objects {
+	ObjectData objects[];
+};
+
+layout (std140) uniform PerFrame {
+	mat4 projection;
+	mat4 view;
+	mat4 lightSpaceMatrix;
+	vec4 viewPos;
+};
+
+void main()
+{
+	mat4 model=objects[aObjectId].model;
+	gl_Position=projection*view*model*vec4(aPos, 1.0f);
+}
\ No newline at end of file
@@ -0,0 +1,12 @@
+#version 330 core
+in vec3 Normal;
+in vec3 FragPos;
+
+//G-buffer of the irradiance cache, w marks covered pixels
+layout (location=0) out vec4 Position;
+layout (location=1) out vec4 NormalOut;
+
+void main(){
+	Position=vec4(FragPos, 1.0);
+	NormalOut=vec4(normalize(Normal), 0.0);
+}
\ No newline at end of file
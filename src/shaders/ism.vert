@@ -0,0 +1,36 @@
+#version 330 core
+layout (location=0) in vec3 aPos;
+
+//point gl_VertexID belongs to VPL gl_VertexID/ism_points, splatted into its paraboloid map
+uniform sampler2D normalMap;
+uniform sampler2D worldPosMap;
+
+uniform int ism_grid;
+uniform int ism_tile;
+uniform int ism_points;
+uniform float ism_far;
+
+void main()
+{
+	int vpl=gl_VertexID/ism_points;
+	ivec2 cell=ivec2(vpl%ism_grid, vpl/ism_grid);
+	ivec2 size=textureSize(normalMap, 0);
+	ivec2 texel=cell*size/ism_grid+size/(2*ism_grid);
+	vec3 n=texelFetch(normalMap, texel, 0).xyz;
+	vec3 d=aPos-texelFetch(worldPosMap, texel, 0).xyz;
+	float dist=length(d);
+	//outside the clip volume: no VPL here, or the point is behind it
+	gl_Position=vec4(2.0, 2.0, 2.0, 1.0);
+	if (dot(n, n)<0.25 || dist<=1e-4)
+		return;
+	n=normalize(n);
+	vec3 t=normalize(cross(abs(n.y)<0.99?vec3(0.0, 1.0, 0.0):vec3(1.0, 0.0, 0.0), n));
+	vec3 b=cross(n, t);
+	vec3 local=vec3(dot(d, t), dot(d, b), dot(d, n))/dist;
+	if (local.z<=0.0)
+		return;
+	vec2 uv=local.xy/(1.0+local.z);
+	vec2 coord=vec2(cell*ism_tile+1)+(uv*0.5+0.5)*float(ism_tile-2);
+	vec2 atlas=vec2(float(ism_grid*ism_tile));
+	gl_Position=vec4(coord/atlas*2.0-1.0, dist/ism_far*2.0-1.0, 1.0);
+}
\ No newline at end of file
@@ -5,6 +5,7 @@ layout (location=2) out vec3 flux;
 
 in vec3 FS_normal;
 in vec3 FS_position;
+in vec3 FS_albedo;
 
 struct Material {
 	vec3 ambient;
@@ -36,5 +37,5 @@ void main()
 	vec3 norm=normalize(FS_normal);
 	float diff=max(0.0, dot(norm, lightDir));
 
-	flux=diff*material.diffuse*light.diffuse;
+	flux=diff*FS_albedo*light.diffuse;
 }
\ No newline at end of file
@@ -4,14 +4,25 @@ layout (location=1) in vec3 normal;
 
 out vec3 FS_normal;
 out vec3 FS_position;
+out vec3 FS_albedo;
 
-uniform mat4 lightSpaceMatrix;
-uniform mat4 model;
+layout (std140) uniform PerFrame {
+	mat4 projection;
+	mat4 view;
+	mat4 lightSpaceMatrix;
+	vec4 viewPos;
+};
+layout (std140) uniform PerDraw {
+	mat4 model;
+	vec4 diffuse;
+	vec4 lightmap;
+};
 
 void main()
 {
 	FS_normal=mat3(transpose(inverse(model)))*normal;
 	vec4 worldPos=model*vec4(position, 1.0);
 	FS_position=worldPos.xyz;
+	FS_albedo=diffuse.rgb;
 	gl_Position=lightSpaceMatrix*model*vec4(position, 1.0f);
 }
\ No newline at end of file
@@ -0,0 +1,37 @@
+#version 430 core
+layout (location=0) in vec3 position;
+layout (location=1) in vec3 normal;
+layout (location=2) in uint objectId;
+
+out vec3 FS_normal;
+out vec3 FS_position;
+out vec3 FS_albedo;
+
+struct ObjectData {
+	mat4 model;
+	vec4 diffuse;
+	vec4 boundsMin;
+	vec4 boundsMax;
+	uvec4 draw;
+	vec4 lightmap;
+};
+layout (std430, binding=0) readonly buffer Objects {
+	ObjectData objects[];
+};
+
+layout (std140) uniform PerFrame {
+	mat4 projection;
+	mat4 view;
+	mat4 lightSpaceMatrix;
+	vec4 viewPos;
+};
+
+void main()
+{
+	mat4 model=objects[objectId].model;
+	FS_normal=mat3(transpose(inverse(model)))*normal;
+	vec4 worldPos=model*vec4(position, 1.0);
+	FS_position=worldPos.xyz;
+	FS_albedo=objects[objectId].diffuse.rgb;
+	gl_Position=lightSpaceMatrix*worldPos;
+}
\ No newline at end of file
@@ -0,0 +1,15 @@
+#version 330 core
+in vec4 shRed;
+in vec4 shGreen;
+in vec4 shBlue;
+
+layout (location=0) out vec4 outRed;
+layout (location=1) out vec4 outGreen;
+layout (location=2) out vec4 outBlue;
+
+void main()
+{
+	outRed=shRed;
+	outGreen=shGreen;
+	outBlue=shBlue;
+}
\ No newline at end of file
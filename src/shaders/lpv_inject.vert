@@ -0,0 +1,42 @@
+#version 330 core
+//one VPL per point, RSM texels on an inject_size grid; points outside layer are dropped
+uniform sampler2D normalMap;
+uniform sampler2D worldPosMap;
+uniform sampler2D fluxMap;
+
+uniform int inject_size;
+uniform int layer;
+uniform int lpv_grid;
+uniform vec3 lpv_min;
+uniform float lpv_cell_size;
+uniform float inject_weight;
+
+out vec4 shRed;
+out vec4 shGreen;
+out vec4 shBlue;
+
+//clamped cosine lobe in two band SH
+vec4 cosineLobe(vec3 d)
+{
+	return vec4(0.886226925, -1.02332671*d.y, 1.02332671*d.z, -1.02332671*d.x);
+}
+
+void main()
+{
+	ivec2 size=textureSize(fluxMap, 0);
+	ivec2 texel=ivec2(gl_VertexID%inject_size, gl_VertexID/inject_size)*size/inject_size;
+	vec3 flux=texelFetch(fluxMap, texel, 0).rgb;
+	vec3 normal=normalize(texelFetch(normalMap, texel, 0).xyz);
+	//half a cell in front of the surface so the light does not leak behind it
+	vec3 position=texelFetch(worldPosMap, texel, 0).xyz+normal*0.5*lpv_cell_size;
+	ivec3 cell=ivec3(floor((position-lpv_min)/lpv_cell_size));
+
+	gl_Position=vec4(2.0, 2.0, 2.0, 1.0);
+	if (flux==vec3(0.0) || cell.z!=layer || any(lessThan(cell, ivec3(0))) || any(greaterThanEqual(cell, ivec3(lpv_grid))))
+		return;
+	gl_Position=vec4((vec2(cell.xy)+0.5)/float(lpv_grid)*2.0-1.0, 0.0, 1.0);
+	vec4 lobe=cosineLobe(normal)*inject_weight;
+	shRed=lobe*flux.r;
+	shGreen=lobe*flux.g;
+	shBlue=lobe*flux.b;
+}
\ No newline at end of file
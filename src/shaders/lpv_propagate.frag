@@ -0,0 +1,69 @@
+#version 330 core
+//one propagation step: every neighbour sends its intensity through the five faces of this cell it sees
+uniform sampler3D lpvRed;
+uniform sampler3D lpvGreen;
+uniform sampler3D lpvBlue;
+
+uniform int layer;
+uniform int lpv_grid;
+uniform float direct_face;
+uniform float side_face;
+
+//next volume, written
+layout (location=0) out vec4 nextRed;
+layout (location=1) out vec4 nextGreen;
+layout (location=2) out vec4 nextBlue;
+//accumulated volume, added
+layout (location=3) out vec4 sumRed;
+layout (location=4) out vec4 sumGreen;
+layout (location=5) out vec4 sumBlue;
+
+const ivec3 AXES[6]=ivec3[6](ivec3(1, 0, 0), ivec3(-1, 0, 0), ivec3(0, 1, 0), ivec3(0, -1, 0), ivec3(0, 0, 1), ivec3(0, 0, -1));
+
+vec4 basis(vec3 d)
+{
+	return vec4(0.282094792, -0.488602512*d.y, 0.488602512*d.z, -0.488602512*d.x);
+}
+vec4 cosineLobe(vec3 d)
+{
+	return vec4(0.886226925, -1.02332671*d.y, 1.02332671*d.z, -1.02332671*d.x);
+}
+
+void main()
+{
+	ivec3 cell=ivec3(ivec2(gl_FragCoord.xy), layer);
+	vec4 red=vec4(0.0), green=vec4(0.0), blue=vec4(0.0);
+	for (int m=0; m<6; m=m+1){
+		ivec3 neighbour=cell-AXES[m];
+		if (any(lessThan(neighbour, ivec3(0))) || any(greaterThanEqual(neighbour, ivec3(lpv_grid))))
+			continue;
+		vec4 sourceRed=texelFetch(lpvRed, neighbour, 0);
+		vec4 sourceGreen=texelFetch(lpvGreen, neighbour, 0);
+		vec4 sourceBlue=texelFetch(lpvBlue, neighbour, 0);
+		vec3 main_dir=vec3(AXES[m]);
+
+		//the face opposite the neighbour
+		vec4 evaluate=basis(main_dir);
+		vec4 reproject=direct_face*cosineLobe(main_dir);
+		red+=max(dot(sourceRed, evaluate), 0.0)*reproject;
+		green+=max(dot(sourceGreen, evaluate), 0.0)*reproject;
+		blue+=max(dot(sourceBlue, evaluate), 0.0)*reproject;
+		//the four side faces
+		for (int s=0; s<6; s=s+1){
+			if (s/2==m/2)
+				continue;
+			vec3 side=vec3(AXES[s]);
+			evaluate=basis(main_dir*0.894427191+side*0.447213595);
+			reproject=side_face*cosineLobe(side);
+			red+=max(dot(sourceRed, evaluate), 0.0)*reproject;
+			green+=max(dot(sourceGreen, evaluate), 0.0)*reproject;
+			blue+=max(dot(sourceBlue, evaluate), 0.0)*reproject;
+		}
+	}
+	nextRed=red;
+	nextGreen=green;
+	nextBlue=blue;
+	sumRed=red;
+	sumGreen=green;
+	sumBlue=blue;
+}
\ No newline at end of file
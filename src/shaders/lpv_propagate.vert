@@ -0,0 +1,7 @@
+#version 330 core
+//full-screen triangle over one layer of the volume
+void main()
+{
+	vec2 position=vec2(gl_VertexID==1?3.0:-1.0, gl_VertexID==2?3.0:-1.0);
+	gl_Position=vec4(position, 0.0, 1.0);
+}
\ No newline at end of file
@@ -2,6 +2,8 @@
 in vec3 Normal;
 in vec3 FragPos;
 in vec4 FragPosLightSpace;
+in vec3 Albedo;
+in vec2 LightmapUV;
 
 out vec4 FragColor;
 
@@ -10,11 +12,59 @@ uniform sampler2D normalMap;
 uniform sampler2D worldPosMap;
 uniform sampler2D fluxMap;
 uniform sampler2D randomMap;
+uniform sampler2D blueNoiseMap;
+uniform sampler2D indirectMap;
+uniform sampler3D lpvRed;
+uniform sampler3D lpvGreen;
+uniform sampler3D lpvBlue;
+uniform sampler3D probeMap;
+uniform sampler2D lightMap;
+uniform sampler2D ismMap;
 
 uniform float shadow_bias;
 uniform int sample_num;
 uniform float sample_radius;
-uniform vec3 viewPos;
+uniform bool blue_noise;
+uniform bool adaptive_sampling;
+uniform int adaptive_batch;
+uniform float adaptive_threshold;
+
+//where the indirect term comes from
+const int INDIRECT_GATHER=0;
+const int INDIRECT_CACHE=1;
+const int INDIRECT_LPV=2;
+const int INDIRECT_PROBES=3;
+const int INDIRECT_LIGHTMAP=4;
+uniform int indirect_mode;
+
+//imperfect shadow maps of the gather, one paraboloid tile per RSM cell
+uniform bool use_ism;
+uniform int ism_grid;
+uniform int ism_tile;
+uniform float ism_far;
+uniform float ism_bias;
+uniform float ism_same_surface;
+uniform float ism_offset;
+
+//light propagation volume, cubic cells from lpv_min
+uniform vec3 lpv_min;
+uniform float lpv_cell_size;
+uniform int lpv_grid;
+uniform float lpv_intensity;
+
+//irradiance probes over probe_min..probe_max, nine SH coefficients stacked along z
+uniform vec3 probe_min;
+uniform vec3 probe_max;
+uniform int probe_grid;
+uniform float probe_intensity;
+
+layout (std140) uniform PerFrame {
+	mat4 projection;
+	mat4 view;
+	mat4 lightSpaceMatrix;
+	vec4 viewPos;
+	vec4 noise;
+};
 
 uniform float near_plane;
 uniform float far_plane;
@@ -40,6 +90,33 @@ struct Light {
 };
 uniform Light light;
 
+//1 if the VPL at the center of the sample's RSM cell sees the receiver in its paraboloid map,
+//samples outside the RSM or on another surface than the VPL are not represented
+float ismVisibility(vec3 position, vec3 sample_normal, vec2 sample_coord)
+{
+	if (any(lessThan(sample_coord, vec2(0.0))) || any(greaterThanEqual(sample_coord, vec2(1.0))))
+		return 1.0;
+	ivec2 cell=clamp(ivec2(floor(sample_coord*float(ism_grid))), ivec2(0), ivec2(ism_grid-1));
+	ivec2 size=textureSize(normalMap, 0);
+	ivec2 texel=cell*size/ism_grid+size/(2*ism_grid);
+	vec3 n=texelFetch(normalMap, texel, 0).xyz;
+	vec3 d=position-texelFetch(worldPosMap, texel, 0).xyz;
+	float dist=length(d);
+	if (dot(n, n)<0.25 || dist<=1e-4)
+		return 1.0;
+	n=normalize(n);
+	if (dot(n, sample_normal)<ism_same_surface)
+		return 1.0;
+	vec3 t=normalize(cross(abs(n.y)<0.99?vec3(0.0, 1.0, 0.0):vec3(1.0, 0.0, 0.0), n));
+	vec3 b=cross(n, t);
+	vec3 local=vec3(dot(d, t), dot(d, b), dot(d, n))/dist;
+	if (local.z<=0.0)
+		return 1.0;
+	vec2 uv=local.xy/(1.0+local.z);
+	ivec2 map_texel=ivec2(vec2(cell*ism_tile+1)+(uv*0.5+0.5)*float(ism_tile-2));
+	return dist*(1.0-ism_bias)>texelFetch(ismMap, map_texel, 0).r*ism_far?0.0:1.0;
+}
+
 float LinerizeDepth(float depth)
 {
 	float z=depth*2.0-1.0;
@@ -57,20 +134,77 @@ void main(){
 
 	//计算间接光照
 	vec3 indirect=vec3(0.0,0.0,0.0);
-	for (int i=0; i<sample_num; i=i+1){
-		vec3 r=texelFetch(randomMap, ivec2(i, 0), 0).xyz;
-		vec2 sample_coord=projCoords.xy+r.xy*sample_radius;
-		float weight=r.z;
-
-		vec3 target_normal=normalize(texture(normalMap, sample_coord).xyz);
-		vec3 target_worldPos=texture(worldPosMap, sample_coord).xyz;
-		vec3 target_flux=texture(fluxMap, sample_coord).rgb;
-
-		vec3 indirect_result=target_flux*max(0, dot(target_normal, FragPos-target_worldPos))*max(0, dot(Normal, target_worldPos-FragPos))/pow(length(FragPos-target_worldPos),4.0);
-		indirect_result*=weight;
-		indirect+=indirect_result;
+	if (indirect_mode==INDIRECT_CACHE){
+		indirect=texelFetch(indirectMap, ivec2(gl_FragCoord.xy), 0).rgb;
+	}
+	else if (indirect_mode==INDIRECT_LPV){
+		//one trilinear lookup half a cell off the surface, the SH is evaluated for light arriving along -normal
+		vec3 norm=normalize(Normal);
+		vec3 coord=(FragPos+norm*0.5*lpv_cell_size-lpv_min)/(lpv_cell_size*float(lpv_grid));
+		vec4 lobe=vec4(0.886226925, 1.02332671*norm.y, -1.02332671*norm.z, 1.02332671*norm.x);
+		vec3 irradiance=vec3(dot(texture(lpvRed, coord), lobe), dot(texture(lpvGreen, coord), lobe), dot(texture(lpvBlue, coord), lobe));
+		indirect=clamp(irradiance/3.14159265*lpv_intensity, 0.0, 1.0);
+	}
+	else if (indirect_mode==INDIRECT_PROBES){
+		vec3 n=normalize(Normal);
+		float basis[9]=float[9](0.282094792, 0.488602512*n.y, 0.488602512*n.z, 0.488602512*n.x,
+			1.092548431*n.x*n.y, 1.092548431*n.y*n.z, 0.315391565*(3.0*n.z*n.z-1.0), 1.092548431*n.x*n.z, 0.546274215*(n.x*n.x-n.y*n.y));
+		vec3 coord=(FragPos-probe_min)/(probe_max-probe_min);
+		//z stays inside one slab, x and y clamp to the edge probes
+		float half_texel=0.5/float(probe_grid);
+		coord.z=clamp(coord.z, half_texel, 1.0-half_texel);
+		vec3 irradiance=vec3(0.0);
+		for (int i=0; i<9; i=i+1)
+			irradiance+=basis[i]*texture(probeMap, vec3(coord.xy, (coord.z+float(i))/9.0)).rgb;
+		indirect=clamp(irradiance*probe_intensity, 0.0, 1.0);
+	}
+	else if (indirect_mode==INDIRECT_LIGHTMAP){
+		indirect=clamp(texture(lightMap, LightmapUV).rgb, 0.0, 1.0);
+	}
+	else {
+		//per-pixel rotation of the sample pattern, animated by the frame's golden ratio offset
+		float angle=0.0;
+		if (blue_noise){
+			ivec2 noise_coord=ivec2(gl_FragCoord.xy)%textureSize(blueNoiseMap, 0);
+			angle=6.2831853*fract(texelFetch(blueNoiseMap, noise_coord, 0).r+noise.x);
+		}
+		mat2 rotation=mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+
+		float lum_sum=0.0, lum_sq_sum=0.0;
+		int taken=sample_num;
+		for (int i=0; i<sample_num; i=i+1){
+			vec3 r=texelFetch(randomMap, ivec2(i, 0), 0).xyz;
+			vec2 sample_coord=projCoords.xy+rotation*r.xy*sample_radius;
+			float weight=r.z;
+
+			vec3 target_normal=normalize(texture(normalMap, sample_coord).xyz);
+			vec3 target_worldPos=texture(worldPosMap, sample_coord).xyz;
+			vec3 target_flux=texture(fluxMap, sample_coord).rgb;
+
+			vec3 indirect_result=target_flux*max(0, dot(target_normal, FragPos-target_worldPos))*max(0, dot(Normal, target_worldPos-FragPos))/pow(length(FragPos-target_worldPos),4.0);
+			indirect_result*=weight;
+			if (use_ism)
+				indirect_result*=ismVisibility(FragPos+normalize(Normal)*ism_offset, target_normal, sample_coord);
+			indirect+=indirect_result;
+
+			//adaptive: stop after a batch once the standard error of the (scaled) mean is below the threshold
+			if (adaptive_sampling){
+				float lum=dot(indirect_result, vec3(0.2126, 0.7152, 0.0722));
+				lum_sum+=lum;
+				lum_sq_sum+=lum*lum;
+				int n=i+1;
+				if (n%adaptive_batch==0 && n<sample_num){
+					float mean=lum_sum/float(n);
+					float variance=max(lum_sq_sum/float(n)-mean*mean, 0.0);
+					if (20.0*sqrt(variance/float(n))<adaptive_threshold){
+						taken=n;
+						break;
+					}
+				}
+			}
+		}
+		indirect=clamp(indirect/float(taken), 0.0, 1.0);
 	}
-	indirect=clamp(indirect/sample_num, 0.0, 1.0);
 
 
 
@@ -83,10 +217,10 @@ void main(){
 	//漫反射
 	vec3 norm = normalize(Normal);
 	float diff=max(dot(norm,lightDir),0.0);  
-	vec3 diffuse = light.diffuse * diff * material.diffuse;
+	vec3 diffuse = light.diffuse * diff * Albedo;
 
 	//镜面反射
-	vec3 viewDir=normalize(viewPos-FragPos);
+	vec3 viewDir=normalize(viewPos.xyz-FragPos);
 	//vec3 reflectDir=reflect(-lightDir, norm);
 	vec3 halfwayDir=normalize(lightDir+viewDir);
 	float spec = pow(max(dot(norm, halfwayDir), 0.0), material.shininess);
@@ -1,16 +1,28 @@
 #version 330 core
 layout (location=0) in vec3 aPos;
 layout (location=1) in vec3 aNormal;
+layout (location=3) in vec2 aLightmapUV;
+
+invariant gl_Position;
 
 out vec3 Normal;
 out vec3 FragPos;
 out vec4 FragPosLightSpace;
+out vec3 Albedo;
+out vec2 LightmapUV;
 
-
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 lightSpaceMatrix;
+layout (std140) uniform PerFrame {
+	mat4 projection;
+	mat4 view;
+	mat4 lightSpaceMatrix;
+	vec4 viewPos;
+	vec4 noise;
+};
+layout (std140) uniform PerDraw {
+	mat4 model;
+	vec4 diffuse;
+	vec4 lightmap;
+};
 
 void main()
 {
@@ -18,4 +30,6 @@ void main()
 	Normal=mat3(transpose(inverse(model)))*aNormal;
 	FragPos=vec3(model*vec4(aPos,1.0));
 	FragPosLightSpace=lightSpaceMatrix*vec4(FragPos, 1.0);
+	Albedo=diffuse.rgb;
+	LightmapUV=aLightmapUV*lightmap.xy+lightmap.zw;
 }
\ No newline at end of file
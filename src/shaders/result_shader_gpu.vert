@@ -0,0 +1,45 @@
+#version 430 core
+layout (location=0) in vec3 aPos;
+layout (location=1) in vec3 aNormal;
+layout (location=2) in uint aObjectId;
+layout (location=3) in vec2 aLightmapUV;
+
+invariant gl_Position;
+
+out vec3 Normal;
+out vec3 FragPos;
+out vec4 FragPosLightSpace;
+out vec3 Albedo;
+out vec2 LightmapUV;
+
+struct ObjectData {
+	mat4 model;
+	vec4 diffuse;
+	vec4 boundsMin;
+	vec4 boundsMax;
+	uvec4 draw;
+	vec4 lightmap;
+};
+layout (std430, binding=0) readonly buffer Objects {
+	ObjectData objects[];
+};
+
+layout (std140) uniform PerFrame {
+	mat4 projection;
+	mat4 view;
+	mat4 lightSpaceMatrix;
+	vec4 viewPos;
+	vec4 noise;
+};
+
+void main()
+{
+	mat4 model=objects[aObjectId].model;
+	gl_Position=projection*view*model*vec4(aPos, 1.0f);
+	Normal=mat3(transpose(inverse(model)))*aNormal;
+	FragPos=vec3(model*vec4(aPos,1.0));
+	FragPosLightSpace=lightSpaceMatrix*vec4(FragPos, 1.0);
+	Albedo=objects[aObjectId].diffuse.rgb;
+	vec4 lightmap=objects[aObjectId].lightmap;
+	LightmapUV=aLightmapUV*lightmap.xy+lightmap.zw;
+}
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include <glad/glad.h>
+
+#include<map>
+#include<string>
+#include<vector>
+#include<iostream>
+
+#include "render_graph.h"
+
+/*
+Scheduling, culling, aliasing and barriers of RenderGraph, without a GL context.
+The GL entry points the graph and the pool call are replaced by stubs that hand out
+texture names and record the barriers issued before every pass.
+*/
+
+static GLuint nextName = 1;
+static GLuint boundName = 0;
+static std::vector<std::string> executed;
+static std::map<std::string, GLbitfield> barriersBefore;	//by pass name
+static GLbitfield issued = 0;
+
+static void APIENTRY stubGen(GLsizei count, GLuint* names) {
+	for (GLsizei i = 0; i < count; ++i)
+		names[i] = nextName++;
+}
+static void APIENTRY stubDelete(GLsizei, const GLuint*) {}
+static void APIENTRY stubBind(GLenum, GLuint name) {
+	boundName = name;
+}
+static void APIENTRY stubTexImage2D(GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, const void*) {}
+static void APIENTRY stubTexParameteri(GLenum, GLenum, GLint) {}
+static void APIENTRY stubGetIntegerv(GLenum, GLint* value) {
+	*value = (GLint)boundName;
+}
+static void APIENTRY stubMemoryBarrier(GLbitfield bits) {
+	issued |= bits;
+}
+
+static void stubGL() {
+	glad_glGenTextures = stubGen;
+	glad_glDeleteTextures = stubDelete;
+	glad_glBindTexture = stubBind;
+	glad_glTexImage2D = stubTexImage2D;
+	glad_glTexParameteri = stubTexParameteri;
+	glad_glGetIntegerv = stubGetIntegerv;
+	glad_glMemoryBarrier = stubMemoryBarrier;
+	glad_glGenQueries = stubGen;
+	glad_glDeleteQueries = stubDelete;
+}
+
+static int failures = 0;
+static void check(bool passed, const std::string& what) {
+	if (passed)
+		return;
+	std::cout << "ERROR::RENDER_GRAPH_TEST::" << what << "\n";
+	++failures;
+}
+
+//a pass that logs its name and the barriers the graph issued right before it
+static int addPass(RenderGraph& graph, const std::string& name) {
+	return graph.addPass(name, [name]() {
+		executed.push_back(name);
+		barriersBefore[name] = issued;
+		issued = 0;
+	});
+}
+static void run(RenderGraph& graph) {
+	executed.clear();
+	barriersBefore.clear();
+	issued = 0;
+	graph.execute();
+}
+
+//readers declared before their producer still run after it, passes nothing reads are dropped
+static void testOrderAndCull() {
+	RenderTargetPool pool;
+	RenderGraph graph(pool);
+	graph.importTexture("shadow", 100);
+	graph.importTexture("color", 101);
+	graph.importTexture("unused", 102);
+	int mainPass = addPass(graph, "main");
+	graph.read(mainPass, "shadow");
+	graph.write(mainPass, "color");
+	int shadow = addPass(graph, "shadow");
+	graph.write(shadow, "shadow");
+	int debugPass = addPass(graph, "debug");
+	graph.write(debugPass, "unused");
+	graph.output("color");
+	check(graph.compile(), "COMPILE_FAILED order");
+	run(graph);
+	std::vector<std::string> expected;
+	expected.push_back("shadow");
+	expected.push_back("main");
+	check(executed == expected, "WRONG_ORDER");
+	check(graph.scheduledPasses() == expected, "CULLED_PASS_SCHEDULED");
+}
+
+//a writer of a texture read by another writer forms a cycle
+static void testCycle() {
+	RenderTargetPool pool;
+	RenderGraph graph(pool);
+	graph.importTexture("a", 100);
+	graph.importTexture("b", 101);
+	int first = addPass(graph, "first");
+	graph.read(first, "b");
+	graph.write(first, "a");
+	int second = addPass(graph, "second");
+	graph.read(second, "a");
+	graph.write(second, "b");
+	graph.output("a");
+	graph.output("b");
+	//prints ERROR::RENDER_GRAPH::CYCLE
+	check(!graph.compile(), "CYCLE_NOT_DETECTED");
+}
+
+//low resolution indirect light stored by a compute pass, then blurred into a second target of
+//the same size: the blur's output may take over the storage of the unblurred light once that is read
+static void testAliasAndBarriers() {
+	RenderTargetPool pool;
+	RenderGraph graph(pool);
+	RenderGraph::TextureDesc lowRes(GL_RGBA16F, 200, 150);
+	graph.importTexture("color", 100);
+	graph.createTexture("indirect", lowRes);
+	graph.createTexture("horizontal", lowRes);
+	graph.createTexture("blurred", lowRes);
+	int gather = addPass(graph, "gather");
+	graph.write(gather, "indirect", RenderGraph::IMAGE);
+	int horizontal = addPass(graph, "horizontal");
+	graph.read(horizontal, "indirect");
+	graph.write(horizontal, "horizontal");
+	int vertical = addPass(graph, "vertical");
+	graph.read(vertical, "horizontal");
+	graph.write(vertical, "blurred");
+	int composite = addPass(graph, "composite");
+	graph.read(composite, "blurred");
+	graph.write(composite, "color");
+	graph.output("color");
+	check(graph.compile(), "COMPILE_FAILED alias");
+
+	GLuint indirect = graph.texture("indirect"), blurred = graph.texture("blurred");
+	check(indirect != 0 && graph.texture("horizontal") != 0, "TRANSIENT_NOT_ALLOCATED");
+	check(blurred == indirect, "DISJOINT_TRANSIENTS_NOT_ALIASED");
+	check(graph.texture("horizontal") != indirect, "OVERLAPPING_TRANSIENTS_ALIASED");
+
+	run(graph);
+	check(barriersBefore["horizontal"] == GL_TEXTURE_FETCH_BARRIER_BIT, "MISSING_FETCH_BARRIER");
+	//the blur writes the attachment the gather stored to as an image
+	check((barriersBefore["vertical"] & GL_FRAMEBUFFER_BARRIER_BIT) != 0, "MISSING_BARRIER_ON_ALIASED_WRITE");
+	check(barriersBefore["composite"] == 0, "REDUNDANT_BARRIER");
+
+	//an unchanged graph gets its textures back from the pool
+	check(graph.compile() && graph.texture("indirect") == indirect, "SLOTS_NOT_REUSED");
+	//another size no longer matches the other transients
+	graph.createTexture("blurred", RenderGraph::TextureDesc(GL_RGBA16F, 400, 300));
+	check(graph.compile() && graph.texture("blurred") != graph.texture("indirect"), "DIFFERENT_DESCRIPTIONS_ALIASED");
+}
+
+int main() {
+	stubGL();
+	testOrderAndCull();
+	testCycle();
+	testAliasAndBarriers();
+	if (failures == 0)
+		std::cout << "render graph: all checks passed\n";
+	return failures == 0 ? 0 : 1;
+}